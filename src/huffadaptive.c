@@ -0,0 +1,366 @@
+/*************************************/
+/* This file defines adaptive        */
+/* Huffman coding: a tree that the   */
+/* encoder and decoder both update   */
+/* after every symbol (the FGK       */
+/* algorithm), so a stream is coded  */
+/* in one pass as it arrives, with   */
+/* no code lengths sent ahead of it. */
+/*************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "huffman.h"
+
+#define TRUE 1
+#define FALSE 0
+
+/* the leaf symbols not yet seen are escaped with */
+#define ESCAPE NUM_CHAR
+
+/* number of the root of an adaptive tree */
+#define TOP (ADAPTIVE_NODES - 1)
+
+/* bits of a code gathered into one word on the way */
+/* up from a leaf, and words enough for the deepest */
+#define PATH_WORD_BITS 32
+#define PATH_WORDS ((ADAPTIVE_SYMBOLS - 2) / PATH_WORD_BITS + 1)
+
+/*********************************************************/
+/* Sets up an adaptive tree holding only the escape.     */
+/* in -- the tree                                        */
+/* out -- void                                           */
+/*********************************************************/
+void initAdaptiveTree(struct AdaptiveTree* tree)
+{
+  int i;
+
+  for(i = 0; i < ADAPTIVE_SYMBOLS; i++)
+  {
+    tree->position[i] = -1;
+  }
+  tree->position[ESCAPE] = TOP;
+  tree->weight[TOP] = 0;
+  tree->parent[TOP] = TOP;
+  tree->child[TOP] = -1 - ESCAPE;
+}
+
+/*********************************************************/
+/* Points the children of a node, or the position of its */
+/* symbol, back at the node after it has moved.          */
+/* in -- tree, number of the node                        */
+/* out -- void                                           */
+/*********************************************************/
+static void adopt(struct AdaptiveTree* tree, int node)
+{
+  int child = tree->child[node];
+
+  if(child < 0)
+  {
+    tree->position[-1 - child] = (short)node;
+  }
+  else
+  {
+    tree->parent[child] = (short)node;
+    tree->parent[child - 1] = (short)node;
+  }
+}
+
+/*********************************************************/
+/* Swaps two subtrees of the same weight. Each keeps the */
+/* parent of the place it moves to.                      */
+/* in -- tree, numbers of the two nodes                  */
+/* out -- void                                           */
+/*********************************************************/
+static void swapNodes(struct AdaptiveTree* tree, int a, int b)
+{
+  short child = tree->child[a];
+
+  tree->child[a] = tree->child[b];
+  tree->child[b] = child;
+  adopt(tree, a);
+  adopt(tree, b);
+}
+
+/*********************************************************/
+/* Counts one more of a symbol in an adaptive tree. A    */
+/* symbol not yet seen first takes the place of the      */
+/* escape, as the parent of a new leaf for the symbol    */
+/* and of the escape. Then, from the leaf up, each node  */
+/* is swapped with the highest numbered node of the same */
+/* weight, unless that is its parent, before its weight  */
+/* goes up, which keeps the weights in order of number.  */
+/* in -- the tree, the symbol                            */
+/* out -- void                                           */
+/*********************************************************/
+void updateAdaptiveTree(struct AdaptiveTree* tree, int symbol)
+{
+  int node = tree->position[symbol], escape, leader;
+  uint64_t weight;
+
+  if(node < 0)
+  {
+    escape = tree->position[ESCAPE];
+    tree->child[escape] = (short)(escape - 1);
+    tree->weight[escape - 1] = 0;
+    tree->weight[escape - 2] = 0;
+    tree->parent[escape - 1] = (short)escape;
+    tree->parent[escape - 2] = (short)escape;
+    tree->child[escape - 1] = (short)(-1 - symbol);
+    tree->child[escape - 2] = -1 - ESCAPE;
+    tree->position[symbol] = (short)(escape - 1);
+    tree->position[ESCAPE] = (short)(escape - 2);
+    node = escape - 1;
+  }
+
+  while(node != TOP)
+  {
+    weight = tree->weight[node];
+    for(leader = node; leader < TOP && tree->weight[leader + 1] == weight;
+        leader++)
+    {
+    }
+    if(leader != node && leader != tree->parent[node])
+    {
+      swapNodes(tree, node, leader);
+      node = leader;
+    }
+    tree->weight[node]++;
+    node = tree->parent[node];
+  }
+  tree->weight[TOP]++;
+}
+
+/*********************************************************/
+/* Most bytes encodeAdaptive and endAdaptive write for   */
+/* a number of symbols and one escape.                   */
+/* in -- number of symbols                               */
+/* out -- bound on the bytes written                     */
+/*********************************************************/
+unsigned long adaptiveBound(unsigned long rawSize)
+{
+  return ((rawSize + 1) * ADAPTIVE_MAX_BITS + 7) / 8 + 1;
+}
+
+/*********************************************************/
+/* Appends bits to a bit writer, storing each whole      */
+/* byte as it fills.                                     */
+/* in -- writer, the bits in the low bits of code and    */
+/*       their number, at most PATH_WORD_BITS            */
+/* out -- void                                           */
+/*********************************************************/
+static void putBits(struct BitWriter* writer, uint64_t code, int length)
+{
+  if(length == 0)
+  {
+    return;
+  }
+  writer->bits |= code << (64 - writer->count - length);
+  writer->count += length;
+  while(writer->count >= 8)
+  {
+    *writer->next++ = (unsigned char)(writer->bits >> 56);
+    writer->bits <<= 8;
+    writer->count -= 8;
+  }
+}
+
+/*********************************************************/
+/* Appends the code of a node: the path to it from the   */
+/* root, a 1 for every right child. The path is found    */
+/* from the node up, so it is gathered in words and the  */
+/* words written last to first.                          */
+/* in -- tree, number of the node, writer                */
+/* out -- void                                           */
+/*********************************************************/
+static void putPath(const struct AdaptiveTree* tree, int node,
+                    struct BitWriter* writer)
+{
+  uint64_t word[PATH_WORDS];
+  uint64_t code = 0;
+  int words = 0, length = 0, parent;
+
+  while(node != TOP)
+  {
+    parent = tree->parent[node];
+    code |= (uint64_t)(node == tree->child[parent]) << length;
+    if(++length == PATH_WORD_BITS)
+    {
+      word[words++] = code;
+      code = 0;
+      length = 0;
+    }
+    node = parent;
+  }
+  putBits(writer, code, length);
+  while(words > 0)
+  {
+    putBits(writer, word[--words], PATH_WORD_BITS);
+  }
+}
+
+/*********************************************************/
+/* Appends the codes of symbols to a bit writer,         */
+/* updating the tree after each one. A symbol not yet    */
+/* seen is the code of the escape and then the symbol.   */
+/* in -- tree, symbols and their number, writer whose    */
+/*       output has room for adaptiveBound(n) bytes      */
+/* out -- void                                           */
+/*********************************************************/
+void encodeAdaptive(struct AdaptiveTree* tree, const unsigned char* src,
+                    unsigned long n, struct BitWriter* writer)
+{
+  unsigned long i;
+
+  for(i = 0; i < n; i++)
+  {
+    if(tree->position[src[i]] < 0)
+    {
+      putPath(tree, tree->position[ESCAPE], writer);
+      putBits(writer, src[i], ADAPTIVE_ESCAPE_BITS);
+    }
+    else
+    {
+      putPath(tree, tree->position[src[i]], writer);
+    }
+    updateAdaptiveTree(tree, src[i]);
+  }
+}
+
+/*********************************************************/
+/* Appends an escape to a bit writer, and the zero bits  */
+/* that take it to a whole byte.                         */
+/* in -- tree, ADAPTIVE_FLUSH or ADAPTIVE_END, writer    */
+/* out -- void                                           */
+/*********************************************************/
+void endAdaptive(const struct AdaptiveTree* tree, int escape,
+                 struct BitWriter* writer)
+{
+  putPath(tree, tree->position[ESCAPE], writer);
+  putBits(writer, (uint64_t)escape, ADAPTIVE_ESCAPE_BITS);
+  flushBits(writer);
+}
+
+/*********************************************************/
+/* Sets up an adaptive decoder at the start of a stream, */
+/* where the escape is the whole tree and has no code,   */
+/* so the stream starts with the bits after an escape.   */
+/* in -- the decoder                                     */
+/* out -- void                                           */
+/*********************************************************/
+void initAdaptiveDecoder(struct AdaptiveDecoder* decoder)
+{
+  initAdaptiveTree(&decoder->tree);
+  decoder->node = TOP;
+  decoder->state = ADAPTIVE_ESCAPE;
+  decoder->count = 0;
+  decoder->value = 0;
+  decoder->decoded = 0;
+}
+
+/*********************************************************/
+/* Decodes the next piece of an adaptive stream a bit at */
+/* a time, walking the tree from the root to a leaf.     */
+/* After an escape come ADAPTIVE_ESCAPE_BITS bits: a     */
+/* symbol not yet seen, or a flush or end, which skip    */
+/* the rest of the byte. The end is followed by the      */
+/* decoded size, checked against the bytes decoded, and  */
+/* nothing else.                                         */
+/* in -- decoder, the bytes and their number, where to   */
+/*       write, room for 8 bytes per byte read, pointer  */
+/*       that receives the number of bytes written       */
+/* out -- 0, or -1 if the stream is damaged or goes on   */
+/*        past its end                                   */
+/*********************************************************/
+int decodeAdaptive(struct AdaptiveDecoder* decoder, const unsigned char* src,
+                   unsigned long size, unsigned char* dst,
+                   unsigned long* written)
+{
+  struct AdaptiveTree* tree = &decoder->tree;
+  unsigned long i, n = 0;
+  int node = decoder->node, state = decoder->state, count = decoder->count;
+  int shift, symbol, status = 0;
+  uint64_t value = decoder->value;
+
+  for(i = 0; status == 0 && i < size; i++)
+  {
+    if(state == ADAPTIVE_DONE)
+    {
+      status = -1;
+    }
+    else if(state == ADAPTIVE_SIZE)
+    {
+      value |= (uint64_t)src[i] << (8 * count);
+      if(++count == 8)
+      {
+        status = value == decoder->decoded + n ? 0 : -1;
+        state = ADAPTIVE_DONE;
+      }
+    }
+
+    for(shift = 7; state < ADAPTIVE_SIZE && shift >= 0; shift--)
+    {
+      if(state == ADAPTIVE_CODE)
+      {
+        node = tree->child[node] - 1 + ((src[i] >> shift) & 1);
+        if(tree->child[node] >= 0)
+        {
+          continue;
+        }
+        symbol = -1 - tree->child[node];
+        node = TOP;
+        if(symbol != ESCAPE)
+        {
+          dst[n++] = (unsigned char)symbol;
+          updateAdaptiveTree(tree, symbol);
+          continue;
+        }
+        state = ADAPTIVE_ESCAPE;
+        count = 0;
+        value = 0;
+        continue;
+      }
+
+      value = value << 1 | ((src[i] >> shift) & 1);
+      if(++count < ADAPTIVE_ESCAPE_BITS)
+      {
+        continue;
+      }
+      if(value < NUM_CHAR && tree->position[value] < 0)
+      {
+        dst[n++] = (unsigned char)value;
+        updateAdaptiveTree(tree, (int)value);
+        state = ADAPTIVE_CODE;
+      }
+      else if(value == ADAPTIVE_FLUSH)
+      {
+        /* before the first symbol the escape still has no code */
+        state = tree->child[TOP] < 0 ? ADAPTIVE_ESCAPE : ADAPTIVE_CODE;
+        count = 0;
+        value = 0;
+        break;
+      }
+      else if(value == ADAPTIVE_END)
+      {
+        state = ADAPTIVE_SIZE;
+        count = 0;
+        value = 0;
+        break;
+      }
+      else
+      {
+        status = -1;
+        break;
+      }
+    }
+  }
+
+  decoder->node = node;
+  decoder->state = state;
+  decoder->count = count;
+  decoder->value = value;
+  decoder->decoded += n;
+  *written = n;
+  return status;
+}
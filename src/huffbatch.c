@@ -0,0 +1,231 @@
+/*************************************/
+/* This file defines batches: many   */
+/* files encoded or decoded by one   */
+/* process, with the threads, tables */
+/* and buffers set up once for all   */
+/* of them.                          */
+/*************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "huffman.h"
+
+#define TRUE 1
+#define FALSE 0
+
+/* what the batch jobs share */
+struct Batch
+{
+  struct BatchFile* files;
+  int (*code)(void* context, int worker, struct Input* in,
+              struct Output* out);
+  void* context;
+  struct Output* output;
+  struct Stats* stats;
+};
+
+/*********************************************************/
+/* Reads a list of files. The list is read whole; each   */
+/* line is copied into the names with its tab and end of */
+/* line turned into the ends of the two names, and a     */
+/* name alone is followed by the output name made from   */
+/* it.                                                   */
+/* in -- the open list, TRUE to add BATCH_SUFFIX or      */
+/*       FALSE to take it off, pointers that receive the */
+/*       files and their number, and the names           */
+/* out -- 0, or the line number of a name alone that     */
+/*        lacks the suffix, or -1 if memory ran out      */
+/*********************************************************/
+long readBatchList(FILE* list, int addSuffix, struct BatchFile** files,
+                   unsigned long* count, char** names)
+{
+  struct Input input;
+  const unsigned char* text;
+  unsigned char* buffer;
+  unsigned long size, lines = 1, pos, end, tab, length, i;
+  unsigned long suffix = strlen(BATCH_SUFFIX);
+  char* next;
+  long status = 0;
+
+  *files = NULL;
+  *names = NULL;
+  *count = 0;
+  openInput(&input, list);
+  text = viewAll(&input, &buffer, &size);
+  for(i = 0; text != NULL && i < size; i++)
+  {
+    if(text[i] == '\n')
+    {
+      lines++;
+    }
+  }
+  if(text != NULL)
+  {
+    *files = malloc(lines * sizeof(struct BatchFile));
+    *names = malloc(2 * size + lines * (suffix + 2));
+  }
+  if(*files == NULL || *names == NULL)
+  {
+    free(*files);
+    free(*names);
+    *files = NULL;
+    *names = NULL;
+    status = -1;
+  }
+
+  next = *names;
+  for(pos = 0, lines = 1; status == 0 && pos < size; pos = end + 1, lines++)
+  {
+    for(end = pos; end < size && text[end] != '\n'; end++)
+    {
+    }
+    length = end > pos && text[end - 1] == '\r' ? end - 1 - pos : end - pos;
+    if(length == 0)
+    {
+      continue;
+    }
+    for(tab = pos; tab < pos + length && text[tab] != '\t'; tab++)
+    {
+    }
+
+    (*files)[*count].input = next;
+    memcpy(next, text + pos, tab - pos);
+    next += tab - pos;
+    *next++ = '\0';
+    (*files)[*count].output = next;
+    if(tab < pos + length)
+    {
+      memcpy(next, text + tab + 1, pos + length - tab - 1);
+      next += pos + length - tab - 1;
+    }
+    else if(addSuffix)
+    {
+      memcpy(next, text + pos, length);
+      memcpy(next + length, BATCH_SUFFIX, suffix);
+      next += length + suffix;
+    }
+    else if(length > suffix
+            && memcmp(text + pos + length - suffix, BATCH_SUFFIX, suffix) == 0)
+    {
+      memcpy(next, text + pos, length - suffix);
+      next += length - suffix;
+    }
+    else
+    {
+      status = (long)lines;
+    }
+    *next++ = '\0';
+    (*count)++;
+  }
+  free(buffer);
+  closeInput(&input);
+  return status;
+}
+
+/*********************************************************/
+/* Opens the files of one job of a batch, codes them     */
+/* with the output of the thread that runs it, and       */
+/* closes them. An output that fails to write, or to     */
+/* close, fails the file.                                */
+/* in -- struct Batch, file, thread                      */
+/* out -- void                                           */
+/*********************************************************/
+static void batchJob(void* context, unsigned long job, int worker)
+{
+  struct Batch* batch = context;
+  struct BatchFile* file = &batch->files[job];
+  struct Output* output = &batch->output[worker];
+  struct Input input;
+  FILE* in;
+  FILE* out;
+  int status;
+
+  in = fopen(file->input, "rb");
+  if(in == NULL)
+  {
+    file->status = BATCH_NO_INPUT;
+    return;
+  }
+  out = fopen(file->output, "wb");
+  if(out == NULL)
+  {
+    fclose(in);
+    file->status = BATCH_NO_OUTPUT;
+    return;
+  }
+  openInput(&input, in);
+  switchOutput(output, out);
+  if(batch->stats != NULL)
+  {
+    input.stats = &batch->stats[worker];
+    output->stats = &batch->stats[worker];
+  }
+
+  status = batch->code(batch->context, worker, &input, output);
+  if(flushOutput(output) != 0)
+  {
+    status = -1;
+  }
+  closeInput(&input);
+  fclose(in);
+  if(fclose(out) != 0)
+  {
+    status = -1;
+  }
+  file->status = status == 0 ? BATCH_OK : BATCH_FAILED;
+}
+
+/*********************************************************/
+/* Codes a batch of files on a pool of threads, a        */
+/* thread that runs out of files taking some from the    */
+/* others, so one large file does not hold up the rest.  */
+/* Every thread has its own output buffer and stats,     */
+/* added up at the end.                                  */
+/* in -- the files, their number, number of threads,     */
+/*       function that codes one file, its context,      */
+/*       stats to add to or NULL                         */
+/* out -- 0, or -1 if memory ran out                     */
+/*********************************************************/
+int runBatch(struct BatchFile* files, unsigned long count, int threads,
+             int (*code)(void* context, int worker, struct Input* in,
+                         struct Output* out),
+             void* context, struct Stats* stats)
+{
+  struct ThreadPool* pool = createPool(threads);
+  struct Batch batch;
+  int i, status = 0;
+
+  batch.files = files;
+  batch.code = code;
+  batch.context = context;
+  batch.output = calloc(threads, sizeof(struct Output));
+  batch.stats = stats == NULL ? NULL : calloc(threads, sizeof(struct Stats));
+  if(pool == NULL || batch.output == NULL
+     || (stats != NULL && batch.stats == NULL))
+  {
+    status = -1;
+  }
+  for(i = 0; status == 0 && i < threads; i++)
+  {
+    status = openOutput(&batch.output[i], NULL);
+  }
+
+  if(status == 0)
+  {
+    runJobs(pool, count, batchJob, &batch);
+  }
+  for(i = 0; batch.stats != NULL && status == 0 && i < threads; i++)
+  {
+    addStats(stats, &batch.stats[i]);
+  }
+
+  for(i = 0; batch.output != NULL && i < threads; i++)
+  {
+    closeOutput(&batch.output[i]);
+  }
+  free(batch.output);
+  free(batch.stats);
+  destroyPool(pool);
+  return status;
+}
@@ -0,0 +1,587 @@
+/*************************************/
+/* This program measures how fast    */
+/* Huffman encoded blocks decode     */
+/* with the tree walk and with the   */
+/* decode table, on the same inputs, */
+/* and how block encoding and        */
+/* decoding scale with threads.      */
+/*************************************/
+
+#define _POSIX_C_SOURCE 200112L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include "huffman.h"
+
+#define TRUE 1
+#define FALSE 0
+
+/* decoders decodeAll can use */
+#define USE_TREE 0
+#define USE_TABLE 1
+#define USE_BLOCK 2
+#define USE_MULTI 3
+
+/* minimum CPU time spent timing each decoder, in seconds */
+/* (wall time when timing threads)                         */
+#define MIN_SECONDS 0.5
+
+/*******************************************************/
+/* Reads everything left in a file into memory,        */
+/* followed by DECODE_PAD zero bytes.                  */
+/* in -- file to read, pointer where the number of     */
+/*       bytes read is stored                          */
+/* out -- buffer holding the bytes, NULL on failure    */
+/*******************************************************/
+static unsigned char* readRest(FILE* in, unsigned long* length)
+{
+  unsigned long capacity = 65536;
+  unsigned char* buffer = malloc(capacity + DECODE_PAD);
+  unsigned char* grown;
+  size_t got;
+
+  *length = 0;
+  while(buffer != NULL)
+  {
+    got = fread(buffer + *length, sizeof(unsigned char),
+                capacity - *length, in);
+    *length += got;
+    if(*length < capacity)
+    {
+      memset(buffer + *length, 0, DECODE_PAD);
+      return buffer;
+    }
+    capacity *= 2;
+    grown = realloc(buffer, capacity + DECODE_PAD);
+    if(grown == NULL)
+    {
+      free(buffer);
+    }
+    buffer = grown;
+  }
+  return NULL;
+}
+
+/* one encoded block and what the decoders need for it */
+struct BenchBlock
+{
+  int type;
+  const unsigned char* body;
+  unsigned long compSize;
+  unsigned long rawSize;
+  unsigned long start;
+  int lengthsSize;
+  struct DecodeTable table;
+  struct MultiTable multi;
+  struct Tree* tree;
+};
+
+/*******************************************************/
+/* Encodes the input block after block into one buffer */
+/* and sets up the decoders for every block.           */
+/* in -- options, input and its length, buffer with    */
+/*       room for every block, array that receives the */
+/*       blocks, tree nodes to encode with             */
+/* out -- number of encoded bytes                      */
+/*******************************************************/
+static unsigned long encodeAll(const struct EncodeOptions* options,
+                               const unsigned char* input,
+                               unsigned long length, unsigned char* encoded,
+                               struct BenchBlock block[], struct Tree* scratch)
+{
+  unsigned long frequency[NUM_CHAR];
+  unsigned char codeLength[NUM_CHAR];
+  struct CodeTable codes;
+  unsigned long offset, size, b, encodedSize = 0;
+
+  for(b = 0, offset = 0; offset < length; b++, offset += size)
+  {
+    size = length - offset < options->blockSize
+           ? length - offset : options->blockSize;
+    block[b].body = encoded + encodedSize + BLOCK_HEADER_SIZE;
+    encodedSize += encodeBlock(options, input + offset, size,
+                               encoded + encodedSize, scratch,
+                               frequency, &codes, NULL);
+    readBlockHeader(block[b].body - BLOCK_HEADER_SIZE, &block[b].type,
+                    &block[b].rawSize, &block[b].compSize);
+    block[b].start = offset;
+    /* raw blocks and runs have no codes */
+    memset(codeLength, 0, NUM_CHAR);
+    block[b].lengthsSize = 0;
+    if(block[b].type == BLOCK_HUFFMAN || block[b].type == BLOCK_HUFFMAN_STREAMS)
+    {
+      block[b].lengthsSize = readLengths(block[b].body, block[b].compSize,
+                                         codeLength);
+    }
+    block[b].tree = buildCanonicalTree(codeLength);
+    buildCanonicalTable(codeLength, &block[b].table);
+    buildMultiTable(&block[b].table, &block[b].multi);
+  }
+  memset(encoded + encodedSize, 0, DECODE_PAD);
+  return encodedSize;
+}
+
+/*******************************************************/
+/* Reads the length table of every block and fills     */
+/* its decode table repeatedly, the work a decoder     */
+/* does before it can emit the first byte of a block.  */
+/* in -- blocks and their number                       */
+/* out -- microseconds per block                       */
+/*******************************************************/
+static double timeSetup(struct BenchBlock block[], unsigned long blocks)
+{
+  unsigned char codeLength[NUM_CHAR];
+  clock_t start = clock();
+  double seconds;
+  unsigned long runs = 0, i;
+
+  if(blocks == 0)
+  {
+    return 0.0;
+  }
+  do
+  {
+    for(i = 0; i < blocks; i++)
+    {
+      if(block[i].lengthsSize > 0)
+      {
+        readLengths(block[i].body, block[i].compSize, codeLength);
+        buildCanonicalTable(codeLength, &block[i].table);
+      }
+    }
+    runs += blocks;
+    seconds = (double)(clock() - start) / CLOCKS_PER_SEC;
+  } while(seconds < MIN_SECONDS);
+
+  return seconds * 1e6 / runs;
+}
+
+/*******************************************************/
+/* Decodes every block once with one of the decoders:  */
+/* USE_TREE, USE_TABLE and USE_MULTI decode the single */
+/* stream of a block with decodeTree, decodeTable or   */
+/* decodeMulti, USE_BLOCK decodes blocks of any type   */
+/* with decodeBlock.                                   */
+/* in -- blocks and their number, decoder, output      */
+/*       buffer                                        */
+/* out -- number of bytes decoded                      */
+/*******************************************************/
+static unsigned long decodeAll(const struct BenchBlock block[],
+                               unsigned long blocks, int decoder,
+                               unsigned char* output)
+{
+  unsigned long i, bitPos, total = 0;
+
+  for(i = 0; i < blocks; i++)
+  {
+    bitPos = (unsigned long)block[i].lengthsSize * 8;
+    if(decoder == USE_TABLE)
+    {
+      total += decodeTable(&block[i].table, block[i].body, block[i].compSize,
+                           &bitPos, output + block[i].start,
+                           block[i].rawSize);
+    }
+    else if(decoder == USE_MULTI)
+    {
+      total += decodeMulti(&block[i].table, &block[i].multi, block[i].body,
+                           block[i].compSize, &bitPos,
+                           output + block[i].start, block[i].rawSize);
+    }
+    else if(decoder == USE_TREE)
+    {
+      total += decodeTree(block[i].tree, block[i].body, block[i].compSize,
+                          &bitPos, output + block[i].start,
+                          block[i].rawSize);
+    }
+    else if(decodeBlock(block[i].type, block[i].body, block[i].compSize,
+                        output + block[i].start, block[i].rawSize,
+                        NULL) == 0)
+    {
+      total += block[i].rawSize;
+    }
+  }
+  return total;
+}
+
+/*******************************************************/
+/* Decodes every block repeatedly with one of the      */
+/* decoders until MIN_SECONDS of CPU time have passed. */
+/* in -- blocks and their number, decoder, output      */
+/*       buffer, total decoded size                    */
+/* out -- decoded megabytes per second                 */
+/*******************************************************/
+static double timeDecode(const struct BenchBlock block[],
+                         unsigned long blocks, int decoder,
+                         unsigned char* output, unsigned long length)
+{
+  clock_t start = clock();
+  double seconds;
+  unsigned long runs = 0;
+
+  do
+  {
+    decodeAll(block, blocks, decoder, output);
+    runs++;
+    seconds = (double)(clock() - start) / CLOCKS_PER_SEC;
+  } while(seconds < MIN_SECONDS);
+
+  return (double)length * runs / seconds / 1e6;
+}
+
+/*******************************************************/
+/* Counts the symbols of every block repeatedly until  */
+/* MIN_SECONDS of CPU time have passed, the first step */
+/* of encoding a block.                                */
+/* in -- options, input and its length                 */
+/* out -- megabytes counted per second                 */
+/*******************************************************/
+static double timeCount(const struct EncodeOptions* options,
+                        const unsigned char* input, unsigned long length)
+{
+  unsigned long frequency[NUM_CHAR];
+  clock_t start = clock();
+  double seconds;
+  unsigned long runs = 0, offset, size;
+
+  do
+  {
+    for(offset = 0; offset < length; offset += size)
+    {
+      size = length - offset < options->blockSize
+             ? length - offset : options->blockSize;
+      countSymbols(input + offset, size, frequency);
+    }
+    runs++;
+    seconds = (double)(clock() - start) / CLOCKS_PER_SEC;
+  } while(seconds < MIN_SECONDS);
+
+  return (double)length * runs / seconds / 1e6;
+}
+
+/* what a thread needs to encode a block for timing */
+struct WorkerScratch
+{
+  struct Tree* tree;
+  unsigned long frequency[NUM_CHAR];
+  struct CodeTable codes;
+};
+
+/* what the timed parallel jobs share */
+struct ScaleBatch
+{
+  const struct EncodeOptions* options;
+  const unsigned char* input;
+  unsigned long length;
+  unsigned char* encoded;
+  const struct BenchBlock* block;
+  unsigned char* output;
+  struct WorkerScratch* scratch;
+};
+
+/*******************************************************/
+/* Encodes one block of the input into its own part of */
+/* the encoded buffer.                                 */
+/* in -- struct ScaleBatch, block, thread              */
+/* out -- void                                         */
+/*******************************************************/
+static void encodeScaleJob(void* context, unsigned long job, int worker)
+{
+  struct ScaleBatch* batch = context;
+  unsigned long size = batch->options->blockSize;
+  unsigned long offset = job * size;
+
+  if(batch->length - offset < size)
+  {
+    size = batch->length - offset;
+  }
+  encodeBlock(batch->options, batch->input + offset, size,
+              batch->encoded + job * blockBound(batch->options->blockSize),
+              batch->scratch[worker].tree, batch->scratch[worker].frequency,
+              &batch->scratch[worker].codes, NULL);
+}
+
+/*******************************************************/
+/* Decodes one block, length table included.           */
+/* in -- struct ScaleBatch, block, thread              */
+/* out -- void                                         */
+/*******************************************************/
+static void decodeScaleJob(void* context, unsigned long job, int worker)
+{
+  struct ScaleBatch* batch = context;
+  const struct BenchBlock* block = &batch->block[job];
+
+  decodeBlock(block->type, block->body, block->compSize,
+              batch->output + block->start, block->rawSize, NULL);
+}
+
+/*******************************************************/
+/* Seconds on a clock that keeps running while the     */
+/* threads work, unlike the CPU time from clock().     */
+/* in -- void                                          */
+/* out -- seconds since some fixed time                */
+/*******************************************************/
+static double wallSeconds(void)
+{
+  struct timespec now;
+
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return now.tv_sec + now.tv_nsec / 1e9;
+}
+
+/*******************************************************/
+/* Runs a job for every block on a pool repeatedly     */
+/* until MIN_SECONDS of wall time have passed.         */
+/* in -- pool, job, batch, number of blocks, bytes of  */
+/*       input they cover                              */
+/* out -- megabytes of input per second                */
+/*******************************************************/
+static double timeParallel(struct ThreadPool* pool,
+                           void (*work)(void* context, unsigned long job,
+                                        int worker),
+                           struct ScaleBatch* batch, unsigned long blocks,
+                           unsigned long length)
+{
+  double start = wallSeconds(), seconds;
+  unsigned long runs = 0;
+
+  do
+  {
+    runJobs(pool, blocks, work, batch);
+    runs++;
+    seconds = wallSeconds() - start;
+  } while(seconds < MIN_SECONDS);
+
+  return (double)length * runs / seconds / 1e6;
+}
+
+/*******************************************************/
+/* Prints how encoding and decoding whole blocks       */
+/* scales from 1 thread up to maxThreads, doubling     */
+/* each time.                                          */
+/* in -- batch with the input and its blocks, number   */
+/*       of blocks, most threads to try                */
+/* out -- 0, or -1 if memory ran out                   */
+/*******************************************************/
+static int printScaling(struct ScaleBatch* batch, unsigned long blocks,
+                        int maxThreads)
+{
+  struct ThreadPool* pool;
+  double encodeSpeed, decodeSpeed, encodeBase = 0, decodeBase = 0;
+  int threads, i, status = 0;
+
+  batch->scratch = calloc(maxThreads, sizeof(struct WorkerScratch));
+  batch->encoded = malloc(blocks * blockBound(batch->options->blockSize));
+  if(batch->scratch == NULL || batch->encoded == NULL)
+  {
+    status = -1;
+  }
+  for(i = 0; status == 0 && i < maxThreads; i++)
+  {
+    batch->scratch[i].tree = allocateTree();
+    if(batch->scratch[i].tree == NULL)
+    {
+      status = -1;
+    }
+  }
+
+  printf("  %8s %12s %12s %9s %9s\n", "threads", "encode MB/s",
+         "decode MB/s", "encode x", "decode x");
+  for(threads = 1; status == 0; threads *= 2)
+  {
+    if(threads > maxThreads)
+    {
+      threads = maxThreads;
+    }
+    pool = createPool(threads);
+    if(pool == NULL)
+    {
+      status = -1;
+      break;
+    }
+    encodeSpeed = timeParallel(pool, encodeScaleJob, batch, blocks,
+                               batch->length);
+    decodeSpeed = timeParallel(pool, decodeScaleJob, batch, blocks,
+                               batch->length);
+    destroyPool(pool);
+    if(threads == 1)
+    {
+      encodeBase = encodeSpeed;
+      decodeBase = decodeSpeed;
+    }
+    printf("  %8d %12.1f %12.1f %8.2fx %8.2fx\n", threads, encodeSpeed,
+           decodeSpeed, encodeBase > 0 ? encodeSpeed / encodeBase : 0.0,
+           decodeBase > 0 ? decodeSpeed / decodeBase : 0.0);
+    if(threads == maxThreads)
+    {
+      break;
+    }
+  }
+
+  for(i = 0; batch->scratch != NULL && i < maxThreads; i++)
+  {
+    freeTree(batch->scratch[i].tree);
+  }
+  free(batch->scratch);
+  free(batch->encoded);
+  return status;
+}
+
+/*******************************************************/
+/* Main function. Encodes every file named on the      */
+/* command line in blocks, in memory, decodes the      */
+/* blocks with every decoder, checks that the outputs  */
+/* match the input, and prints the throughput of each  */
+/* along with the time taken to set up the decoder for */
+/* a block and the speed of counting symbols. The      */
+/* tree walk, the table decoder and the multi-symbol   */
+/* table decoder run on single stream blocks, the tree */
+/* walk with the tree of the canonical codes of each   */
+/* block, the multi-symbol table whether it pays or    */
+/* not; the streams column decodes blocks split into   */
+/* STREAMS streams.                                    */
+/* Then prints how block encoding and decoding scale   */
+/* with threads, up to -T threads or the number of     */
+/* processors.                                         */
+/* in -- int argc, number of arguments                 */
+/*       char ** argv, [-T threads] and names of files */
+/*       to encode                                     */
+/* out -- 0 if every file decoded identically          */
+/*******************************************************/
+int main(int argc, char** argv)
+{
+  struct EncodeOptions options, single;
+  struct ScaleBatch batch;
+  struct BenchBlock* block;
+  struct BenchBlock* streamBlock;
+  struct Tree* scratch;
+  unsigned char* input;
+  unsigned char* encoded;
+  unsigned char* streamEncoded;
+  unsigned char* treeOutput;
+  unsigned char* tableOutput;
+  unsigned char* multiOutput;
+  unsigned char* streamOutput;
+  unsigned long length, blocks, encodedSize, b;
+  double treeSpeed, tableSpeed, multiSpeed, streamSpeed, countSpeed, setup;
+  FILE* in;
+  int i, status = 0, first = 1, maxThreads;
+
+  maxThreads = (int)sysconf(_SC_NPROCESSORS_ONLN);
+  if(argc > 2 && strcmp(argv[1], "-T") == 0)
+  {
+    maxThreads = atoi(argv[2]);
+    first = 3;
+  }
+  if(maxThreads < 1 || maxThreads > MAX_THREADS)
+  {
+    maxThreads = 1;
+  }
+  if(argc <= first)
+  {
+    printf("usage: %s [-T threads] file...\n", argv[0]);
+    return 1;
+  }
+
+  defaultEncodeOptions(&options);
+  single = options;
+  single.streams = FALSE;
+  single.storeFallback = FALSE;
+  printf("%-24s %12s %8s %11s %10s %12s %12s %12s %12s %8s %8s %8s\n",
+         "file", "bytes", "ratio", "count MB/s", "setup us", "tree MB/s",
+         "table MB/s", "multi MB/s", "streams MB/s", "table x", "multi x",
+         "stream x");
+  for(i = first; i < argc; i++)
+  {
+    in = fopen(argv[i], "rb");
+    if(in == NULL)
+    {
+      printf("couldn't open %s for reading\n", argv[i]);
+      return 2;
+    }
+    input = readRest(in, &length);
+    fclose(in);
+
+    blocks = (length + options.blockSize - 1) / options.blockSize;
+    block = malloc((blocks + 1) * sizeof(struct BenchBlock));
+    streamBlock = malloc((blocks + 1) * sizeof(struct BenchBlock));
+    encoded = malloc(blocks * blockBound(options.blockSize) + DECODE_PAD);
+    streamEncoded = malloc(blocks * blockBound(options.blockSize)
+                           + DECODE_PAD);
+    treeOutput = malloc(length + 1);
+    tableOutput = malloc(length + 1);
+    multiOutput = malloc(length + 1);
+    streamOutput = malloc(length + 1);
+    scratch = allocateTree();
+    if(input == NULL || block == NULL || streamBlock == NULL
+       || encoded == NULL || streamEncoded == NULL || treeOutput == NULL
+       || tableOutput == NULL || multiOutput == NULL || streamOutput == NULL
+       || scratch == NULL)
+    {
+      printf("out of memory for %s\n", argv[i]);
+      return 3;
+    }
+
+    encodeAll(&single, input, length, encoded, block, scratch);
+    encodedSize = encodeAll(&options, input, length, streamEncoded,
+                            streamBlock, scratch);
+
+    countSpeed = timeCount(&options, input, length);
+    setup = timeSetup(block, blocks);
+    treeSpeed = timeDecode(block, blocks, USE_TREE, treeOutput, length);
+    tableSpeed = timeDecode(block, blocks, USE_TABLE, tableOutput, length);
+    multiSpeed = timeDecode(block, blocks, USE_MULTI, multiOutput, length);
+    streamSpeed = timeDecode(streamBlock, blocks, USE_BLOCK, streamOutput,
+                             length);
+
+    if(decodeAll(block, blocks, USE_TREE, treeOutput) != length
+       || decodeAll(block, blocks, USE_TABLE, tableOutput) != length
+       || decodeAll(block, blocks, USE_MULTI, multiOutput) != length
+       || decodeAll(streamBlock, blocks, USE_BLOCK, streamOutput) != length
+       || memcmp(treeOutput, input, length) != 0
+       || memcmp(tableOutput, input, length) != 0
+       || memcmp(multiOutput, input, length) != 0
+       || memcmp(streamOutput, input, length) != 0)
+    {
+      printf("%s: decoders disagree\n", argv[i]);
+      status = 4;
+    }
+    printf("%-24s %12lu %8.3f %11.1f %10.2f %12.1f %12.1f %12.1f %12.1f"
+           " %7.2fx %7.2fx %7.2fx\n", argv[i], length,
+           length > 0 ? (double)encodedSize / length : 0.0, countSpeed, setup,
+           treeSpeed, tableSpeed, multiSpeed, streamSpeed,
+           treeSpeed > 0 ? tableSpeed / treeSpeed : 0.0,
+           tableSpeed > 0 ? multiSpeed / tableSpeed : 0.0,
+           tableSpeed > 0 ? streamSpeed / tableSpeed : 0.0);
+
+    batch.options = &options;
+    batch.input = input;
+    batch.length = length;
+    batch.block = streamBlock;
+    batch.output = streamOutput;
+    if(blocks > 0 && printScaling(&batch, blocks, maxThreads) != 0)
+    {
+      printf("out of memory for %s\n", argv[i]);
+      return 3;
+    }
+
+    for(b = 0; b < blocks; b++)
+    {
+      freeTree(block[b].tree);
+      freeTree(streamBlock[b].tree);
+    }
+    freeTree(scratch);
+    free(block);
+    free(streamBlock);
+    free(encoded);
+    free(streamEncoded);
+    free(input);
+    free(treeOutput);
+    free(tableOutput);
+    free(multiOutput);
+    free(streamOutput);
+  }
+  return status;
+}
@@ -0,0 +1,518 @@
+/*************************************/
+/* This file defines the blocks of   */
+/* the current format: each block of */
+/* input is coded with its own code  */
+/* lengths, in memory, so that the   */
+/* input never has to be read twice. */
+/*************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "huffman.h"
+
+#define TRUE 1
+#define FALSE 0
+
+/*****************************************************/
+/* Stores a number as four little endian bytes.      */
+/* in -- where to store, the number                  */
+/* out -- void                                       */
+/*****************************************************/
+void storeLE32(unsigned char* dst, unsigned long value)
+{
+  dst[0] = (unsigned char)value;
+  dst[1] = (unsigned char)(value >> 8);
+  dst[2] = (unsigned char)(value >> 16);
+  dst[3] = (unsigned char)(value >> 24);
+}
+
+/*****************************************************/
+/* Stores a number as three little endian bytes.     */
+/* in -- where to store, the number                  */
+/* out -- void                                       */
+/*****************************************************/
+static void storeLE24(unsigned char* dst, unsigned long value)
+{
+  dst[0] = (unsigned char)value;
+  dst[1] = (unsigned char)(value >> 8);
+  dst[2] = (unsigned char)(value >> 16);
+}
+
+/*****************************************************/
+/* Loads a number stored as three little endian      */
+/* bytes.                                            */
+/* in -- pointer to the bytes                        */
+/* out -- the number                                 */
+/*****************************************************/
+static unsigned long loadLE24(const unsigned char* src)
+{
+  return (unsigned long)src[0] | ((unsigned long)src[1] << 8)
+       | ((unsigned long)src[2] << 16);
+}
+
+/*****************************************************/
+/* Loads a number stored as four little endian bytes */
+/* in -- pointer to the bytes                        */
+/* out -- the number                                 */
+/*****************************************************/
+unsigned long loadLE32(const unsigned char* src)
+{
+  return (unsigned long)src[0] | ((unsigned long)src[1] << 8)
+       | ((unsigned long)src[2] << 16) | ((unsigned long)src[3] << 24);
+}
+
+/*****************************************************/
+/* Stores a number as eight little endian bytes.     */
+/* in -- where to store, the number                  */
+/* out -- void                                       */
+/*****************************************************/
+void storeLE64(unsigned char* dst, uint64_t value)
+{
+  int i;
+
+  for(i = 0; i < 8; i++)
+  {
+    dst[i] = (unsigned char)(value >> (8 * i));
+  }
+}
+
+/*****************************************************/
+/* Loads a number stored as eight little endian      */
+/* bytes.                                            */
+/* in -- pointer to the bytes                        */
+/* out -- the number                                 */
+/*****************************************************/
+uint64_t loadLE64(const unsigned char* src)
+{
+  uint64_t value = 0;
+  int i;
+
+  for(i = 7; i >= 0; i--)
+  {
+    value = (value << 8) | src[i];
+  }
+  return value;
+}
+
+/*********************************************************/
+/* Sets encode options to their defaults.                */
+/* in -- options to fill                                 */
+/* out -- void                                           */
+/*********************************************************/
+void defaultEncodeOptions(struct EncodeOptions* options)
+{
+  options->maxCodeLength = MAX_CODE_LENGTH;
+  options->blockSize = DEFAULT_BLOCK_SIZE;
+  options->threads = 1;
+  options->streams = TRUE;
+  options->contexts = FALSE;
+  options->storeFallback = TRUE;
+  options->index = FALSE;
+  options->report = NULL;
+  options->reportContext = NULL;
+}
+
+/********************************************************/
+/* Most bytes encodeBlock can produce for a block. An   */
+/* optimal code never takes more than 8 bits a symbol,  */
+/* and each stream pads its last byte.                  */
+/* in -- number of bytes in the block                   */
+/* out -- bound on the encoded size                     */
+/********************************************************/
+unsigned long blockBound(unsigned long rawSize)
+{
+  return BLOCK_HEADER_SIZE + LENGTHS_MAX_SIZE + JUMP_TABLE_SIZE
+         + rawSize + STREAMS + ENCODE_PAD;
+}
+
+/********************************************************/
+/* Size of each stream of a block split into streams.   */
+/* in -- number of bytes in the block, array that       */
+/*       receives the number of bytes in each stream    */
+/* out -- void                                          */
+/********************************************************/
+static void streamSizes(unsigned long rawSize, unsigned long size[STREAMS])
+{
+  unsigned long part = (rawSize + STREAMS - 1) / STREAMS;
+  int s;
+
+  for(s = 0; s < STREAMS; s++)
+  {
+    size[s] = rawSize < part ? rawSize : part;
+    rawSize -= size[s];
+  }
+}
+
+/********************************************************/
+/* Writes the header of a block whose body is written.  */
+/* in -- the block, its type, decoded size and body     */
+/*       size                                           */
+/* out -- number of bytes of the block                  */
+/********************************************************/
+static unsigned long finishBlock(unsigned char* dst, int type,
+                                 unsigned long rawSize,
+                                 unsigned long compSize)
+{
+  dst[0] = (unsigned char)type;
+  storeLE32(dst + 1, rawSize);
+  storeLE32(dst + 5, compSize);
+  return BLOCK_HEADER_SIZE + compSize;
+}
+
+/********************************************************/
+/* Encodes one block in memory. The histogram and the   */
+/* code lengths give the exact size of the Huffman      */
+/* coded block before any code is written; when the     */
+/* options allow it, a block that would not shrink is   */
+/* stored raw and a block of one repeated byte as a     */
+/* run, so no time goes into coding them. When the      */
+/* options ask for contexts, a block coded with an      */
+/* order-1 model is kept if it is the smallest.         */
+/* Otherwise the block is Huffman coded, as STREAMS     */
+/* streams when the options ask for them and the block  */
+/* is big enough to gain from them.                     */
+/* in -- options, the bytes to encode and their number, */
+/*       where to write, block of nodes for the tree,   */
+/*       arrays that receive the frequencies and codes, */
+/*       stats to add to or NULL                        */
+/* out -- number of bytes of the encoded block          */
+/********************************************************/
+unsigned long encodeBlock(const struct EncodeOptions* options,
+                          const unsigned char* src, unsigned long rawSize,
+                          unsigned char* dst, struct Tree* tree,
+                          unsigned long frequency[NUM_CHAR],
+                          struct CodeTable* codes, struct Stats* stats)
+{
+  unsigned char codeLength[NUM_CHAR];
+  struct BitWriter writer;
+  unsigned long size[STREAMS];
+  unsigned char* jump;
+  unsigned char* streamStart;
+  struct ContextModel model;
+  uint64_t bits = 0, fallbacks = 0;
+  unsigned long codedSize, contextSize;
+  int lengthsSize, s, symbol, used = 0, type = BLOCK_HUFFMAN;
+  int split = options->streams && rawSize >= MIN_STREAMS_SIZE;
+  double start;
+
+  STATS_ADD(stats, blocks, 1);
+  STATS_START(stats, start);
+  countSymbols(src, rawSize, frequency);
+  STATS_TIME(stats, countSeconds, start);
+
+  STATS_START(stats, start);
+  buildCodeLengths(tree, frequency, options->maxCodeLength, codeLength);
+  STATS_TIME(stats, treeSeconds, start);
+  STATS_ADD(stats, nodes, tree->used);
+  STATS_START(stats, start);
+  buildCodeTable(codeLength, codes);
+  STATS_TIME(stats, tableSeconds, start);
+  lengthsSize = writeLengths(dst + BLOCK_HEADER_SIZE, codeLength);
+
+  for(symbol = 0; symbol < NUM_CHAR; symbol++)
+  {
+    used += frequency[symbol] > 0;
+    bits += (uint64_t)frequency[symbol] * codeLength[symbol];
+    if(codeLength[symbol] > DECODE_BITS)
+    {
+      fallbacks += frequency[symbol];
+    }
+  }
+  codedSize = lengthsSize + (unsigned long)(bits / 8)
+              + (split ? JUMP_TABLE_SIZE + STREAMS : 1);
+  if(options->storeFallback && used == 1)
+  {
+    STATS_ADD(stats, storedBlocks, 1);
+    dst[BLOCK_HEADER_SIZE] = src[0];
+    return finishBlock(dst, BLOCK_RUN, rawSize, 1);
+  }
+  if(options->contexts && rawSize >= MIN_CONTEXT_SIZE)
+  {
+    contextSize = buildContextModel(tree, src, rawSize,
+                                    options->maxCodeLength, &model);
+    if(contextSize > 0 && contextSize < codedSize
+       && (!options->storeFallback || contextSize < rawSize))
+    {
+      return finishBlock(dst, BLOCK_HUFFMAN_CONTEXT, rawSize,
+                         writeContextBody(&model, src, rawSize,
+                                          dst + BLOCK_HEADER_SIZE));
+    }
+  }
+  if(options->storeFallback && codedSize >= rawSize)
+  {
+    STATS_ADD(stats, storedBlocks, 1);
+    memcpy(dst + BLOCK_HEADER_SIZE, src, rawSize);
+    return finishBlock(dst, BLOCK_RAW, rawSize, rawSize);
+  }
+
+  STATS_ADD(stats, symbols, rawSize);
+  STATS_ADD(stats, bits, bits);
+  STATS_ADD(stats, fallbacks, fallbacks);
+  STATS_START(stats, start);
+  writer.next = dst + BLOCK_HEADER_SIZE + lengthsSize;
+  writer.bits = 0;
+  writer.count = 0;
+  if(split)
+  {
+    /* each stream starts on a byte, after the jump table */
+    type = BLOCK_HUFFMAN_STREAMS;
+    jump = writer.next;
+    writer.next += JUMP_TABLE_SIZE;
+    streamSizes(rawSize, size);
+    for(s = 0; s < STREAMS; s++)
+    {
+      streamStart = writer.next;
+      encodeSymbols(codes, src, size[s], &writer);
+      flushBits(&writer);
+      src += size[s];
+      if(s < STREAMS - 1)
+      {
+        storeLE24(jump + 3 * s, (unsigned long)(writer.next - streamStart));
+      }
+    }
+  }
+  else
+  {
+    encodeSymbols(codes, src, rawSize, &writer);
+    flushBits(&writer);
+  }
+  STATS_TIME(stats, bitsSeconds, start);
+
+  return finishBlock(dst, type, rawSize,
+                     (unsigned long)(writer.next - dst) - BLOCK_HEADER_SIZE);
+}
+
+/********************************************************/
+/* Reads a block header.                                */
+/* in -- the header bytes, pointers that receive the    */
+/*       type, decoded size and body size               */
+/* out -- void                                          */
+/********************************************************/
+void readBlockHeader(const unsigned char* src, int* type,
+                     unsigned long* rawSize, unsigned long* compSize)
+{
+  *type = src[0];
+  *rawSize = loadLE32(src + 1);
+  *compSize = loadLE32(src + 5);
+}
+
+/********************************************************/
+/* Writes the end block: a BLOCK_END header, then the   */
+/* total decoded size of the file. The header carries   */
+/* the size of the index block where rawSize would be.  */
+/* in -- where to write, total decoded size, size of    */
+/*       the index block                                */
+/* out -- void                                          */
+/********************************************************/
+void writeEndBlock(unsigned char* dst, uint64_t totalSize,
+                   unsigned long indexSize)
+{
+  dst[0] = BLOCK_END;
+  storeLE32(dst + 1, indexSize);
+  storeLE32(dst + 5, END_BODY_SIZE);
+  storeLE64(dst + BLOCK_HEADER_SIZE, totalSize);
+}
+
+/********************************************************/
+/* Writes the header of an index block, whose entries   */
+/* follow it.                                           */
+/* in -- where to write, number of entries              */
+/* out -- void                                          */
+/********************************************************/
+void writeIndexHeader(unsigned char* dst, unsigned long entries)
+{
+  dst[0] = BLOCK_INDEX;
+  storeLE32(dst + 1, 0);
+  storeLE32(dst + 5, entries * INDEX_ENTRY_SIZE);
+}
+
+/********************************************************/
+/* Reads the total decoded size from an end block body. */
+/* in -- the body                                       */
+/* out -- total decoded size                            */
+/********************************************************/
+uint64_t readEndBody(const unsigned char* src)
+{
+  return loadLE64(src);
+}
+
+/********************************************************/
+/* Finds the bitstreams of a Huffman block: the one     */
+/* after the length table, or the STREAMS streams after */
+/* the jump table, each with its share of the output.   */
+/* in -- block type, body, body size, bytes of the      */
+/*       length table, output buffer, decoded size, and */
+/*       arrays that receive the bit position, byte     */
+/*       limit, output and symbol count of each stream  */
+/* out -- number of streams, or -1 if the jump table    */
+/*        points outside the block                      */
+/********************************************************/
+int findStreams(int type, const unsigned char* src, unsigned long compSize,
+                int used, unsigned char* dst, unsigned long rawSize,
+                unsigned long bitPos[STREAMS], unsigned long limit[STREAMS],
+                unsigned char* out[STREAMS], unsigned long count[STREAMS])
+{
+  unsigned long start;
+  int s;
+
+  if(type == BLOCK_HUFFMAN)
+  {
+    bitPos[0] = (unsigned long)used * 8;
+    limit[0] = compSize;
+    out[0] = dst;
+    count[0] = rawSize;
+    return 1;
+  }
+
+  start = used + JUMP_TABLE_SIZE;
+  if(start > compSize)
+  {
+    return -1;
+  }
+  streamSizes(rawSize, count);
+  for(s = 0; s < STREAMS; s++)
+  {
+    bitPos[s] = start * 8;
+    if(s < STREAMS - 1)
+    {
+      start += loadLE24(src + used + 3 * s);
+    }
+    else
+    {
+      start = compSize;
+    }
+    if(start > compSize)
+    {
+      return -1;
+    }
+    limit[s] = start;
+    out[s] = dst;
+    dst += count[s];
+  }
+  return STREAMS;
+}
+
+/********************************************************/
+/* Decodes the body of one block: a raw block is        */
+/* copied and a run filled in; a Huffman block has its  */
+/* length table, then the codes, which must give        */
+/* exactly rawSize symbols. A Huffman block of at least */
+/* MIN_MULTI_SIZE bytes whose codes are short enough    */
+/* decodes several symbols per probe, and any other of  */
+/* at least MIN_KERNEL_SIZE bytes with the decode       */
+/* kernel its code lengths pick. An index block decodes */
+/* to nothing.                                          */
+/* in -- block type, body, body size, output buffer,    */
+/*       number of bytes the block decodes to, stats to */
+/*       add to or NULL                                 */
+/* out -- 0 on success, -1 if the block is damaged      */
+/********************************************************/
+int decodeBlock(int type, const unsigned char* src, unsigned long compSize,
+                unsigned char* dst, unsigned long rawSize,
+                struct Stats* stats)
+{
+  unsigned char codeLength[NUM_CHAR];
+  struct DecodeTable table;
+  struct MultiTable multiTable;
+  struct KernelTable kernelTable;
+  const struct MultiTable* multi = NULL;
+  const struct Kernel* kernel = NULL;
+  unsigned long bitPos[STREAMS], limit[STREAMS], count[STREAMS];
+  unsigned long first[STREAMS];
+  unsigned char* out[STREAMS];
+  unsigned long decoded;
+  int used, streams, s;
+  double timer;
+
+  if(type == BLOCK_INDEX)
+  {
+    return rawSize == 0 && compSize % INDEX_ENTRY_SIZE == 0 ? 0 : -1;
+  }
+  STATS_ADD(stats, blocks, 1);
+  if(type == BLOCK_RAW || type == BLOCK_RUN)
+  {
+    STATS_ADD(stats, storedBlocks, 1);
+  }
+
+  if(type == BLOCK_RAW)
+  {
+    if(compSize != rawSize)
+    {
+      return -1;
+    }
+    memcpy(dst, src, rawSize);
+    return 0;
+  }
+  if(type == BLOCK_RUN)
+  {
+    if(compSize != 1)
+    {
+      return -1;
+    }
+    memset(dst, src[0], rawSize);
+    return 0;
+  }
+  if(type == BLOCK_HUFFMAN_CONTEXT)
+  {
+    return decodeContextBody(src, compSize, dst, rawSize);
+  }
+  if(type != BLOCK_HUFFMAN && type != BLOCK_HUFFMAN_STREAMS)
+  {
+    return -1;
+  }
+  STATS_START(stats, timer);
+  used = readLengths(src, compSize, codeLength);
+  if(used < 0)
+  {
+    return -1;
+  }
+  streams = findStreams(type, src, compSize, used, dst, rawSize, bitPos,
+                        limit, out, count);
+  if(streams < 0)
+  {
+    return -1;
+  }
+  buildCanonicalTable(codeLength, &table);
+  if(rawSize >= MIN_MULTI_SIZE && multiTablePays(&table))
+  {
+    buildMultiTable(&table, &multiTable);
+    multi = &multiTable;
+  }
+  else if(rawSize >= MIN_KERNEL_SIZE)
+  {
+    kernel = chooseKernel(&table, streams);
+    buildKernelTable(&table, kernel->bits, &kernelTable);
+  }
+  STATS_TIME(stats, tableSeconds, timer);
+
+  memcpy(first, bitPos, sizeof(first));
+  STATS_START(stats, timer);
+  if(multi != NULL)
+  {
+    decoded = streams == 1
+              ? decodeMulti(&table, multi, src, limit[0], bitPos, dst,
+                            rawSize)
+              : decodeStreamsMulti(&table, multi, src, limit, bitPos, out,
+                                   count);
+  }
+  else if(kernel != NULL)
+  {
+    decoded = kernel->decode(&table, &kernelTable, src, limit, bitPos, out,
+                             count);
+  }
+  else
+  {
+    decoded = streams == 1
+              ? decodeTable(&table, src, limit[0], bitPos, dst, rawSize)
+              : decodeStreams(&table, src, limit, bitPos, out, count);
+  }
+  STATS_TIME(stats, bitsSeconds, timer);
+  STATS_ADD(stats, symbols, decoded);
+  for(s = 0; s < streams; s++)
+  {
+    STATS_ADD(stats, bits, bitPos[s] - first[s]);
+  }
+  STATS_ADD(stats, fallbacks, countFallbacks(codeLength, dst, decoded));
+  return decoded == rawSize ? 0 : -1;
+}
@@ -0,0 +1,282 @@
+/*************************************/
+/* This file defines context blocks: */
+/* each byte is coded with a table   */
+/* chosen by the byte before it. The */
+/* 256 contexts share a handful of   */
+/* tables, so that the block header  */
+/* stays small.                      */
+/*************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "huffman.h"
+
+#define TRUE 1
+#define FALSE 0
+
+/* rounds of assigning every context to its cheapest table */
+/* and rebuilding the tables from their contexts           */
+#define CLUSTER_ROUNDS 4
+
+/* bits a symbol is charged, while clustering, in a table */
+/* that has no code for it yet                            */
+#define MISSING_CODE_COST 24
+
+/*********************************************************/
+/* Works out the code lengths of every table from the    */
+/* counts of the contexts assigned to it, dropping the   */
+/* tables no context is assigned to.                     */
+/* in -- counts of each symbol after each context, the   */
+/*       table of each context (-1 for none, renumbered  */
+/*       on return), block of nodes for the tree,        */
+/*       longest code allowed, model whose tables and    */
+/*       code lengths are filled                         */
+/* out -- void                                           */
+/*********************************************************/
+static void buildTables(unsigned int pairs[NUM_CHAR][NUM_CHAR],
+                        int assigned[NUM_CHAR], struct Tree* tree,
+                        int maxCodeLength, struct ContextModel* model)
+{
+  unsigned long frequency[CONTEXT_TABLES][NUM_CHAR];
+  int renumber[CONTEXT_TABLES];
+  int c, s, k, empty, tables = 0;
+
+  memset(frequency, 0, sizeof(frequency));
+  for(c = 0; c < NUM_CHAR; c++)
+  {
+    if(assigned[c] < 0)
+    {
+      continue;
+    }
+    for(s = 0; s < NUM_CHAR; s++)
+    {
+      frequency[assigned[c]][s] += pairs[c][s];
+    }
+  }
+
+  for(k = 0; k < model->tables; k++)
+  {
+    renumber[k] = -1;
+    empty = TRUE;
+    for(s = 0; s < NUM_CHAR; s++)
+    {
+      if(frequency[k][s] > 0)
+      {
+        empty = FALSE;
+      }
+    }
+    if(empty)
+    {
+      continue;
+    }
+    renumber[k] = tables;
+    buildCodeLengths(tree, frequency[k], maxCodeLength,
+                     model->codeLength[tables]);
+    tables++;
+  }
+  for(c = 0; c < NUM_CHAR; c++)
+  {
+    if(assigned[c] >= 0)
+    {
+      assigned[c] = renumber[assigned[c]];
+    }
+  }
+  model->tables = tables;
+}
+
+/*********************************************************/
+/* Builds an order-1 model of a block. The contexts that */
+/* occur most seed the tables; then, for a few rounds,   */
+/* every context moves to the table that codes its bytes */
+/* in the fewest bits and the tables are rebuilt from    */
+/* the contexts they were given.                         */
+/* in -- block of nodes for the tree, the bytes and      */
+/*       their number, longest code allowed, model to    */
+/*       fill                                            */
+/* out -- exact size of the block body the model gives,  */
+/*        or 0 if memory ran out                         */
+/*********************************************************/
+unsigned long buildContextModel(struct Tree* tree, const unsigned char* src,
+                                unsigned long rawSize, int maxCodeLength,
+                                struct ContextModel* model)
+{
+  unsigned int (*pairs)[NUM_CHAR];
+  unsigned long total[NUM_CHAR] = {0};
+  unsigned int cost[CONTEXT_TABLES][NUM_CHAR];
+  unsigned char lengths[LENGTHS_MAX_SIZE];
+  int order[NUM_CHAR], assigned[NUM_CHAR];
+  int used = 0, prev = 0, c, s, k, i, round, best;
+  uint64_t bits, bestBits;
+  unsigned long n, size;
+
+  pairs = calloc(NUM_CHAR, sizeof(*pairs));
+  if(pairs == NULL)
+  {
+    return 0;
+  }
+  for(n = 0; n < rawSize; n++)
+  {
+    pairs[prev][src[n]]++;
+    prev = src[n];
+  }
+
+  /* order the contexts that occur by how often they occur */
+  for(c = 0; c < NUM_CHAR; c++)
+  {
+    for(s = 0; s < NUM_CHAR; s++)
+    {
+      total[c] += pairs[c][s];
+    }
+    assigned[c] = -1;
+    if(total[c] == 0)
+    {
+      continue;
+    }
+    for(i = used++; i > 0 && total[order[i - 1]] < total[c]; i--)
+    {
+      order[i] = order[i - 1];
+    }
+    order[i] = c;
+  }
+
+  model->tables = used < CONTEXT_TABLES ? used : CONTEXT_TABLES;
+  for(k = 0; k < model->tables; k++)
+  {
+    assigned[order[k]] = k;
+  }
+  for(round = 0; round < CLUSTER_ROUNDS; round++)
+  {
+    buildTables(pairs, assigned, tree, maxCodeLength, model);
+    for(k = 0; k < model->tables; k++)
+    {
+      for(s = 0; s < NUM_CHAR; s++)
+      {
+        cost[k][s] = model->codeLength[k][s] > 0
+                     ? model->codeLength[k][s] : MISSING_CODE_COST;
+      }
+    }
+    for(i = 0; i < used; i++)
+    {
+      c = order[i];
+      best = 0;
+      bestBits = 0;
+      for(k = 0; k < model->tables; k++)
+      {
+        bits = 0;
+        for(s = 0; s < NUM_CHAR; s++)
+        {
+          bits += (uint64_t)pairs[c][s] * cost[k][s];
+        }
+        if(k == 0 || bits < bestBits)
+        {
+          best = k;
+          bestBits = bits;
+        }
+      }
+      assigned[c] = best;
+    }
+  }
+  buildTables(pairs, assigned, tree, maxCodeLength, model);
+
+  /* every context's bytes are in its table, so all have codes */
+  bits = 0;
+  for(c = 0; c < NUM_CHAR; c++)
+  {
+    model->map[c] = (unsigned char)(assigned[c] < 0 ? 0 : assigned[c]);
+    for(s = 0; s < NUM_CHAR; s++)
+    {
+      bits += (uint64_t)pairs[c][s] * model->codeLength[model->map[c]][s];
+    }
+  }
+  size = 1 + CONTEXT_MAP_SIZE + (unsigned long)(bits / 8) + 1;
+  for(k = 0; k < model->tables; k++)
+  {
+    buildCodeTable(model->codeLength[k], &model->codes[k]);
+    size += writeLengths(lengths, model->codeLength[k]);
+  }
+  free(pairs);
+  return size;
+}
+
+/*********************************************************/
+/* Writes the body of a context block: number of tables, */
+/* context map, length tables and codes.                 */
+/* in -- the model, the bytes and their number, where to */
+/*       write                                           */
+/* out -- number of bytes of the body                    */
+/*********************************************************/
+unsigned long writeContextBody(const struct ContextModel* model,
+                               const unsigned char* src,
+                               unsigned long rawSize, unsigned char* dst)
+{
+  struct BitWriter writer;
+  unsigned long pos = 1 + CONTEXT_MAP_SIZE;
+  int c, k;
+
+  dst[0] = (unsigned char)model->tables;
+  for(c = 0; c < NUM_CHAR; c += 2)
+  {
+    dst[1 + c / 2] = (unsigned char)(model->map[c] | model->map[c + 1] << 4);
+  }
+  for(k = 0; k < model->tables; k++)
+  {
+    pos += writeLengths(dst + pos, model->codeLength[k]);
+  }
+
+  writer.next = dst + pos;
+  writer.bits = 0;
+  writer.count = 0;
+  encodeContextSymbols(model, src, rawSize, &writer);
+  flushBits(&writer);
+  return (unsigned long)(writer.next - dst);
+}
+
+/*********************************************************/
+/* Decodes the body of a context block.                  */
+/* in -- the body followed by DECODE_PAD readable bytes, */
+/*       its size, where to write and the number of      */
+/*       bytes the block decodes to                      */
+/* out -- 0 on success, -1 if the block is damaged       */
+/*********************************************************/
+int decodeContextBody(const unsigned char* src, unsigned long compSize,
+                      unsigned char* dst, unsigned long rawSize)
+{
+  struct DecodeTable decode[CONTEXT_TABLES];
+  const struct DecodeTable* table[NUM_CHAR];
+  unsigned char codeLength[NUM_CHAR];
+  unsigned long pos = 1 + CONTEXT_MAP_SIZE, bitPos;
+  int tables, used, c, k;
+
+  if(compSize < pos || src[0] < 1 || src[0] > CONTEXT_TABLES)
+  {
+    return -1;
+  }
+  tables = src[0];
+  for(k = 0; k < tables; k++)
+  {
+    used = readLengths(src + pos, compSize - pos, codeLength);
+    if(used < 0)
+    {
+      return -1;
+    }
+    buildCanonicalTable(codeLength, &decode[k]);
+    pos += used;
+  }
+  for(c = 0; c < NUM_CHAR; c++)
+  {
+    k = (src[1 + c / 2] >> (4 * (c & 1))) & 0x0f;
+    if(k >= tables)
+    {
+      return -1;
+    }
+    table[c] = &decode[k];
+  }
+
+  bitPos = pos * 8;
+  if(decodeContexts(table, src, compSize, &bitPos, dst, rawSize) != rawSize)
+  {
+    return -1;
+  }
+  return 0;
+}
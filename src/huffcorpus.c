@@ -0,0 +1,783 @@
+/*************************************/
+/* This program benchmarks the coder */
+/* on a corpus it generates itself:  */
+/* text, logs, binary data, random   */
+/* bytes, one repeated byte and all  */
+/* 256 byte values, from 1 KB up to  */
+/* 1 GB. Every phase of encoding and */
+/* decoding is timed, adaptive       */
+/* coding as well, and the result    */
+/* is written as JSON so that runs   */
+/* from two commits can be diffed.   */
+/*************************************/
+
+#define _XOPEN_SOURCE 600
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/resource.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include "huffman.h"
+#include "hufflib.h"
+
+#define TRUE 1
+#define FALSE 0
+
+/* the time stamp counter gives cycles where there is one */
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define HAVE_TSC
+#endif
+
+/* minimum wall time spent timing each phase, in seconds */
+#define MIN_SECONDS 0.2
+
+/* smallest and largest corpus sizes; each size is */
+/* SIZE_STEP times the one before                  */
+#define MIN_SIZE 1024UL
+#define MAX_SIZE (1024UL * 1024 * 1024)
+#define SIZE_STEP 16
+
+/* largest size run unless -m says otherwise, in MB */
+#define DEFAULT_MAX_MB 64
+
+/* the timed phases, in the order they run */
+#define PHASE_HISTOGRAM 0
+#define PHASE_TREE 1
+#define PHASE_CODES 2
+#define PHASE_ENCODE 3
+#define PHASE_DECODE 4
+#define PHASE_ADAPTIVE_ENCODE 5
+#define PHASE_ADAPTIVE_DECODE 6
+#define PHASES 7
+
+static const char* const phaseName[PHASES] =
+{
+  "histogram", "tree", "codes", "encode", "decode", "fgk-encode",
+  "fgk-decode"
+};
+
+/* bytes the adaptive encode phase codes at a time */
+#define ADAPTIVE_CHUNK 65536
+
+/* state of the generator every corpus is drawn from */
+static uint64_t randomState;
+
+/*******************************************************/
+/* Restarts the generator, so that every corpus is the */
+/* same on every run and every machine.                */
+/* in -- void                                          */
+/* out -- void                                         */
+/*******************************************************/
+static void seedRandom(void)
+{
+  randomState = (uint64_t)0x9e3779b9UL << 32 | 0x7f4a7c15UL;
+}
+
+/*******************************************************/
+/* Next number from a 64-bit xorshift generator.       */
+/* in -- void                                          */
+/* out -- 32 random bits                               */
+/*******************************************************/
+static unsigned long nextRandom(void)
+{
+  randomState ^= randomState << 13;
+  randomState ^= randomState >> 7;
+  randomState ^= randomState << 17;
+  return (unsigned long)(randomState >> 32);
+}
+
+/*******************************************************/
+/* Appends bytes to a corpus, as many as still fit.    */
+/* in -- the corpus and its size, pointer to the       */
+/*       number of bytes written so far, the bytes and */
+/*       their number                                  */
+/* out -- void                                         */
+/*******************************************************/
+static void append(unsigned char* dst, unsigned long size, unsigned long* pos,
+                   const char* text, unsigned long n)
+{
+  if(n > size - *pos)
+  {
+    n = size - *pos;
+  }
+  memcpy(dst + *pos, text, n);
+  *pos += n;
+}
+
+/*******************************************************/
+/* English-like text: sentences of common words, the   */
+/* most common ones far more often than the rest.      */
+/* in -- where to write and how many bytes             */
+/* out -- void                                         */
+/*******************************************************/
+static void generateText(unsigned char* dst, unsigned long size)
+{
+  static const char* const words[64] =
+  {
+    "the", "of", "and", "to", "in", "a", "is", "that", "for", "it", "as",
+    "was", "with", "be", "by", "on", "not", "he", "i", "this", "are", "or",
+    "his", "from", "at", "which", "but", "have", "an", "had", "they", "you",
+    "were", "their", "one", "all", "we", "can", "her", "has", "there",
+    "been", "if", "more", "when", "will", "would", "who", "so", "no", "time",
+    "data", "encoder", "block", "table", "symbol", "stream", "value", "code",
+    "length", "frequency", "buffer", "memory", "thread"
+  };
+  char word[16];
+  unsigned long pos = 0, r;
+  int count, i;
+
+  while(pos < size)
+  {
+    count = 5 + (int)(nextRandom() % 12);
+    for(i = 0; i < count; i++)
+    {
+      r = nextRandom();
+      strcpy(word, words[(r & 63) * ((r >> 6) & 63) >> 6]);
+      if(i == 0)
+      {
+        word[0] = (char)(word[0] - 'a' + 'A');
+      }
+      append(dst, size, &pos, word, strlen(word));
+      append(dst, size, &pos, i + 1 < count ? " " : ".", 1);
+    }
+    append(dst, size, &pos, nextRandom() % 4 == 0 ? "\n" : " ", 1);
+  }
+}
+
+/*******************************************************/
+/* Web server logs: a timestamp, level, worker and a   */
+/* request with its status, size and latency a line.   */
+/* in -- where to write and how many bytes             */
+/* out -- void                                         */
+/*******************************************************/
+static void generateLog(unsigned char* dst, unsigned long size)
+{
+  static const char* const methods[3] = {"GET", "POST", "PUT"};
+  static const char* const resources[5] =
+  {
+    "users", "orders", "items", "sessions", "search"
+  };
+  char line[256];
+  unsigned long pos = 0, ms = 0, r, status;
+  const char* level;
+
+  while(pos < size)
+  {
+    r = nextRandom();
+    ms += r % 50;
+    level = "INFO";
+    status = 200;
+    if((r >> 8 & 15) == 0)
+    {
+      level = "ERROR";
+      status = 500;
+    }
+    else if((r >> 8 & 15) < 3)
+    {
+      level = "WARN";
+      status = 404;
+    }
+    sprintf(line, "2026-10-17T%02lu:%02lu:%02lu.%03luZ %-5s [worker-%lu] %s"
+            " /api/v1/%s/%lu status=%lu bytes=%lu latency_ms=%lu\n",
+            ms / 3600000 % 24, ms / 60000 % 60, ms / 1000 % 60, ms % 1000,
+            level, (r >> 12) % 8, methods[(r >> 16) % 3],
+            resources[(r >> 20) % 5], nextRandom() % 100000, status,
+            nextRandom() % 20000, nextRandom() % 250);
+    append(dst, size, &pos, line, strlen(line));
+  }
+}
+
+/*******************************************************/
+/* Binary data like that of a program: runs of machine */
+/* code built from a few common opcodes, tables of     */
+/* small little endian integers and zero padding.      */
+/* in -- where to write and how many bytes             */
+/* out -- void                                         */
+/*******************************************************/
+static void generateBinary(unsigned char* dst, unsigned long size)
+{
+  static const unsigned char opcodes[16] =
+  {
+    0x48, 0x89, 0x8b, 0xe8, 0x0f, 0x83, 0xc4, 0x24,
+    0x00, 0xff, 0x85, 0xc0, 0x74, 0x75, 0x5d, 0xc3
+  };
+  unsigned char chunk[64];
+  unsigned long pos = 0, value = 0, r;
+  int kind, i;
+
+  while(pos < size)
+  {
+    kind = (int)(nextRandom() % 4);
+    for(i = 0; i < 64; i++)
+    {
+      if(kind < 2)
+      {
+        r = nextRandom();
+        chunk[i] = r % 4 == 0 ? (unsigned char)(r >> 8)
+                              : opcodes[(r >> 2) % 16];
+      }
+      else if(kind == 2)
+      {
+        if(i % 4 == 0)
+        {
+          value += nextRandom() % 64;
+        }
+        chunk[i] = (unsigned char)(value >> (8 * (i % 4)));
+      }
+      else
+      {
+        chunk[i] = 0;
+      }
+    }
+    append(dst, size, &pos, (const char*)chunk, sizeof(chunk));
+  }
+}
+
+/*******************************************************/
+/* Random bytes, which no coding can shrink.           */
+/* in -- where to write and how many bytes             */
+/* out -- void                                         */
+/*******************************************************/
+static void generateRandom(unsigned char* dst, unsigned long size)
+{
+  unsigned long i;
+
+  for(i = 0; i < size; i++)
+  {
+    dst[i] = (unsigned char)nextRandom();
+  }
+}
+
+/*******************************************************/
+/* One byte repeated.                                  */
+/* in -- where to write and how many bytes             */
+/* out -- void                                         */
+/*******************************************************/
+static void generateSame(unsigned char* dst, unsigned long size)
+{
+  memset(dst, 'a', size);
+}
+
+/*******************************************************/
+/* The 256 byte values in turn, so that every symbol   */
+/* occurs equally often.                               */
+/* in -- where to write and how many bytes             */
+/* out -- void                                         */
+/*******************************************************/
+static void generateAll256(unsigned char* dst, unsigned long size)
+{
+  unsigned long i;
+
+  for(i = 0; i < size; i++)
+  {
+    dst[i] = (unsigned char)i;
+  }
+}
+
+/* a kind of input and how to make it */
+struct Corpus
+{
+  const char* name;
+  void (*generate)(unsigned char* dst, unsigned long size);
+};
+
+static const struct Corpus corpus[] =
+{
+  {"text", generateText},
+  {"log", generateLog},
+  {"binary", generateBinary},
+  {"random", generateRandom},
+  {"same", generateSame},
+  {"all256", generateAll256}
+};
+
+#define CORPORA (sizeof(corpus) / sizeof(corpus[0]))
+
+/* what the phases of one run work on */
+struct Bench
+{
+  const unsigned char* input;
+  unsigned long size;
+  unsigned long blockSize;
+  unsigned long blocks;
+  unsigned long (*frequency)[NUM_CHAR];
+  struct Tree* tree;
+  struct CodeTable codes;
+  struct HuffContext* context;
+  unsigned char* encoded;
+  unsigned long bound;
+  unsigned long encodedSize;
+  unsigned char* output;
+  unsigned char* adaptive;
+  unsigned long adaptiveRoom;
+  unsigned long adaptiveSize;
+};
+
+/* what a run of one corpus at one size measured */
+struct CaseResult
+{
+  int status;
+  unsigned long encodedSize;
+  unsigned long adaptiveSize;
+  double seconds[PHASES];
+  double cycles[PHASES];
+  long peakKB[PHASES];
+};
+
+/*******************************************************/
+/* Seconds on a clock that keeps running while the     */
+/* program waits, unlike the CPU time from clock().    */
+/* in -- void                                          */
+/* out -- seconds since some fixed time                */
+/*******************************************************/
+static double wallSeconds(void)
+{
+  struct timespec now;
+
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return now.tv_sec + now.tv_nsec / 1e9;
+}
+
+/*******************************************************/
+/* Cycles of the time stamp counter.                   */
+/* in -- void                                          */
+/* out -- cycles since some fixed time, 0 if the CPU   */
+/*        has no counter                               */
+/*******************************************************/
+static double readCycles(void)
+{
+#ifdef HAVE_TSC
+  return (double)__builtin_ia32_rdtsc();
+#else
+  return 0.0;
+#endif
+}
+
+/*******************************************************/
+/* Peak memory use of the process so far.              */
+/* in -- void                                          */
+/* out -- peak resident set size in KB                 */
+/*******************************************************/
+static long peakKB(void)
+{
+  struct rusage usage;
+
+  getrusage(RUSAGE_SELF, &usage);
+  return usage.ru_maxrss;
+}
+
+/*******************************************************/
+/* Encodes the whole input as one adaptive stream, a   */
+/* chunk at a time so that the room left is checked    */
+/* before each chunk.                                  */
+/* in -- what the phases work on                       */
+/* out -- 0, or -1 if the stream does not fit          */
+/*******************************************************/
+static int encodeAdaptiveBench(struct Bench* bench)
+{
+  struct AdaptiveTree tree;
+  struct BitWriter writer;
+  unsigned long offset, n;
+  unsigned char* end = bench->adaptive + bench->adaptiveRoom;
+
+  initAdaptiveTree(&tree);
+  writer.next = bench->adaptive;
+  writer.bits = 0;
+  writer.count = 0;
+  for(offset = 0; offset < bench->size; offset += n)
+  {
+    n = bench->size - offset < ADAPTIVE_CHUNK
+        ? bench->size - offset : ADAPTIVE_CHUNK;
+    if((unsigned long)(end - writer.next) < adaptiveBound(n))
+    {
+      return -1;
+    }
+    encodeAdaptive(&tree, bench->input + offset, n, &writer);
+  }
+  if((unsigned long)(end - writer.next) < adaptiveBound(0) + END_BODY_SIZE)
+  {
+    return -1;
+  }
+  endAdaptive(&tree, ADAPTIVE_END, &writer);
+  storeLE64(writer.next, bench->size);
+  bench->adaptiveSize = (unsigned long)(writer.next - bench->adaptive)
+                        + END_BODY_SIZE;
+  return 0;
+}
+
+/*******************************************************/
+/* Decodes the adaptive stream in one piece. It was    */
+/* encoded from the input, so the output, as big as    */
+/* the input, holds all it decodes to.                 */
+/* in -- what the phases work on                       */
+/* out -- 0, or -1 if decoding failed                  */
+/*******************************************************/
+static int decodeAdaptiveBench(struct Bench* bench)
+{
+  struct AdaptiveDecoder decoder;
+  unsigned long written;
+
+  initAdaptiveDecoder(&decoder);
+  if(decodeAdaptive(&decoder, bench->adaptive, bench->adaptiveSize,
+                    bench->output, &written) != 0)
+  {
+    return -1;
+  }
+  return decoder.state == ADAPTIVE_DONE && written == bench->size ? 0 : -1;
+}
+
+/*******************************************************/
+/* Runs one phase over the whole input, block after    */
+/* block where the phase works on blocks.              */
+/* in -- what the phases work on, the phase            */
+/* out -- 0, or -1 if encoding or decoding failed      */
+/*******************************************************/
+static int runPhase(struct Bench* bench, int phase)
+{
+  unsigned char codeLength[NUM_CHAR];
+  unsigned long b, offset, n;
+  struct Tree* tree;
+
+  if(phase == PHASE_ENCODE)
+  {
+    bench->encodedSize = huffCompress(bench->context, bench->encoded,
+                                      bench->bound, bench->input, bench->size);
+    return bench->encodedSize == HUFF_ERROR ? -1 : 0;
+  }
+  if(phase == PHASE_ADAPTIVE_ENCODE)
+  {
+    return encodeAdaptiveBench(bench);
+  }
+  if(phase == PHASE_ADAPTIVE_DECODE)
+  {
+    return decodeAdaptiveBench(bench);
+  }
+  if(phase == PHASE_DECODE)
+  {
+    return huffDecompress(bench->context, bench->output, bench->size,
+                          bench->encoded, bench->encodedSize) == bench->size
+           ? 0 : -1;
+  }
+
+  for(b = 0; b < bench->blocks; b++)
+  {
+    offset = b * bench->blockSize;
+    n = bench->size - offset < bench->blockSize
+        ? bench->size - offset : bench->blockSize;
+    tree = &bench->tree[b];
+    if(phase == PHASE_HISTOGRAM)
+    {
+      countSymbols(bench->input + offset, n, bench->frequency[b]);
+    }
+    else if(phase == PHASE_TREE)
+    {
+      buildTree(tree, bench->frequency[b]);
+    }
+    else
+    {
+      /* blocks of the default size never need their codes limited */
+      memset(codeLength, 0, NUM_CHAR);
+      if(tree->used > 0)
+      {
+        extractCodes(tree, ROOT, 0, codeLength);
+        if(isLeaf(&tree->nodes[ROOT]))
+        {
+          codeLength[tree->nodes[ROOT].symbol] = 1;
+        }
+      }
+      buildCodeTable(codeLength, &bench->codes);
+    }
+  }
+  return 0;
+}
+
+/*******************************************************/
+/* Runs a phase repeatedly until MIN_SECONDS of wall   */
+/* time have passed, at least once.                    */
+/* in -- what the phases work on, the phase, result    */
+/*       that receives the seconds and cycles of one   */
+/*       run and the peak memory use after it          */
+/* out -- 0, or -1 if encoding or decoding failed      */
+/*******************************************************/
+static int timePhase(struct Bench* bench, int phase, struct CaseResult* result)
+{
+  double start = wallSeconds(), cycles = readCycles(), seconds;
+  unsigned long runs = 0;
+
+  do
+  {
+    if(runPhase(bench, phase) != 0)
+    {
+      return -1;
+    }
+    runs++;
+    seconds = wallSeconds() - start;
+  } while(seconds < MIN_SECONDS);
+
+  result->seconds[phase] = seconds / runs;
+  result->cycles[phase] = (readCycles() - cycles) / runs;
+  result->peakKB[phase] = peakKB();
+  return 0;
+}
+
+/*******************************************************/
+/* Generates one corpus at one size and times every    */
+/* phase on it. Buffers are allocated just before the  */
+/* first phase that needs them, so that the peak       */
+/* memory after each phase shows what it added.        */
+/* in -- the corpus, its size, result to fill          */
+/* out -- void; result->status is 0, -1 if memory ran  */
+/*        out or -2 if the decoded bytes differ        */
+/*******************************************************/
+static void runCase(const struct Corpus* kind, unsigned long size,
+                    struct CaseResult* result)
+{
+  struct EncodeOptions options;
+  struct Bench bench;
+  unsigned char* input;
+  int phase;
+
+  memset(result, 0, sizeof(struct CaseResult));
+  memset(&bench, 0, sizeof(bench));
+  defaultEncodeOptions(&options);
+  bench.size = size;
+  bench.blockSize = options.blockSize;
+  bench.blocks = (size + options.blockSize - 1) / options.blockSize;
+  bench.bound = huffCompressBound(size);
+
+  input = malloc(size);
+  bench.frequency = malloc(bench.blocks * sizeof(*bench.frequency));
+  bench.tree = malloc(bench.blocks * sizeof(struct Tree));
+  bench.context = huffCreateContext();
+  result->status = -1;
+  if(input != NULL && bench.frequency != NULL && bench.tree != NULL
+     && bench.context != NULL)
+  {
+    seedRandom();
+    kind->generate(input, size);
+    bench.input = input;
+    result->status = 0;
+  }
+
+  for(phase = 0; result->status == 0 && phase < PHASES; phase++)
+  {
+    if(phase == PHASE_ENCODE)
+    {
+      bench.encoded = malloc(bench.bound);
+    }
+    if(phase == PHASE_DECODE)
+    {
+      bench.output = malloc(size);
+    }
+    if(phase == PHASE_ADAPTIVE_ENCODE)
+    {
+      /* an eighth more than the input, for random bytes */
+      bench.adaptiveRoom = size + size / 8 + adaptiveBound(ADAPTIVE_CHUNK);
+      bench.adaptive = malloc(bench.adaptiveRoom);
+    }
+    if((phase == PHASE_ENCODE && bench.encoded == NULL)
+       || (phase == PHASE_DECODE && bench.output == NULL)
+       || (phase == PHASE_ADAPTIVE_ENCODE && bench.adaptive == NULL)
+       || timePhase(&bench, phase, result) != 0)
+    {
+      result->status = -1;
+    }
+    else if((phase == PHASE_DECODE || phase == PHASE_ADAPTIVE_DECODE)
+            && memcmp(bench.output, input, size) != 0)
+    {
+      result->status = -2;
+    }
+  }
+  result->encodedSize = bench.encodedSize;
+  result->adaptiveSize = bench.adaptiveSize;
+
+  huffFreeContext(bench.context);
+  free(bench.frequency);
+  free(bench.tree);
+  free(bench.encoded);
+  free(bench.output);
+  free(bench.adaptive);
+  free(input);
+}
+
+/*******************************************************/
+/* Runs a case in a child process, so that its peak    */
+/* memory use is its own and not that of the cases     */
+/* before it.                                          */
+/* in -- the corpus, its size, result to fill          */
+/* out -- void; result->status is -3 if the child      */
+/*        could not be run or died                     */
+/*******************************************************/
+static void runChild(const struct Corpus* kind, unsigned long size,
+                     struct CaseResult* result)
+{
+  int channel[2];
+  pid_t child;
+  ssize_t got = 0;
+  int status;
+
+  memset(result, 0, sizeof(struct CaseResult));
+  result->status = -3;
+  fflush(NULL);
+  if(pipe(channel) != 0)
+  {
+    return;
+  }
+  child = fork();
+  if(child == 0)
+  {
+    close(channel[0]);
+    runCase(kind, size, result);
+    write(channel[1], result, sizeof(struct CaseResult));
+    _exit(0);
+  }
+  close(channel[1]);
+  if(child > 0)
+  {
+    got = read(channel[0], result, sizeof(struct CaseResult));
+    waitpid(child, &status, 0);
+  }
+  close(channel[0]);
+  if(got != (ssize_t)sizeof(struct CaseResult))
+  {
+    memset(result, 0, sizeof(struct CaseResult));
+    result->status = -3;
+  }
+}
+
+/*******************************************************/
+/* Writes the result of one case as a JSON object, one */
+/* phase a line so that two runs diff phase by phase.  */
+/* in -- file to write to, the corpus, its size, the   */
+/*       result, TRUE if another object follows        */
+/* out -- void                                         */
+/*******************************************************/
+static void writeCase(FILE* out, const struct Corpus* kind, unsigned long size,
+                      const struct CaseResult* result, int more)
+{
+  int phase;
+
+  fprintf(out, "    {\"corpus\": \"%s\", \"size\": %lu, ", kind->name, size);
+  if(result->status != 0)
+  {
+    fprintf(out, "\"error\": \"%s\"}%s\n",
+            result->status == -2 ? "decoded bytes differ" : "did not run",
+            more ? "," : "");
+    return;
+  }
+  fprintf(out, "\"encoded\": %lu, \"ratio\": %.4f, \"fgk_encoded\": %lu, "
+          "\"fgk_ratio\": %.4f,\n     \"phases\": {\n", result->encodedSize,
+          (double)result->encodedSize / size, result->adaptiveSize,
+          (double)result->adaptiveSize / size);
+  for(phase = 0; phase < PHASES; phase++)
+  {
+    fprintf(out, "      \"%s\": {\"mb_per_s\": %.1f, \"cycles_per_byte\": ",
+            phaseName[phase], size / result->seconds[phase] / 1e6);
+    if(result->cycles[phase] > 0)
+    {
+      fprintf(out, "%.3f", result->cycles[phase] / size);
+    }
+    else
+    {
+      fprintf(out, "null");
+    }
+    fprintf(out, ", \"peak_rss_kb\": %ld}%s\n", result->peakKB[phase],
+            phase + 1 < PHASES ? "," : "");
+  }
+  fprintf(out, "     }}%s\n", more ? "," : "");
+}
+
+/*******************************************************/
+/* Main function. Runs every corpus at every size from */
+/* MIN_SIZE up to the largest asked for, prints a line */
+/* for each to standard error and writes the JSON to   */
+/* standard output or the file named with -o.          */
+/* in -- int argc, number of arguments                 */
+/*       char ** argv, [-m maxMB] [-o file.json]       */
+/* out -- 0 if every case decoded identically          */
+/*******************************************************/
+int main(int argc, char** argv)
+{
+  struct EncodeOptions options;
+  struct CaseResult result;
+  unsigned long maxSize = DEFAULT_MAX_MB * 1024UL * 1024, size;
+  unsigned int c;
+  FILE* out = stdout;
+  int arg, phase, more, status = 0;
+
+  for(arg = 1; arg < argc; arg++)
+  {
+    if(strcmp(argv[arg], "-m") == 0 && arg + 1 < argc)
+    {
+      maxSize = strtoul(argv[++arg], NULL, 10);
+      if(maxSize < 1 || maxSize > MAX_SIZE >> 20)
+      {
+        printf("largest size must be 1 to %lu MB\n", MAX_SIZE >> 20);
+        return 1;
+      }
+      maxSize <<= 20;
+    }
+    else if(strcmp(argv[arg], "-o") == 0 && arg + 1 < argc)
+    {
+      out = fopen(argv[++arg], "w");
+      if(out == NULL)
+      {
+        printf("couldn't open %s for writing\n", argv[arg]);
+        return 2;
+      }
+    }
+    else
+    {
+      printf("usage: %s [-m maxMB] [-o file.json]\n", argv[0]);
+      return 1;
+    }
+  }
+
+  defaultEncodeOptions(&options);
+  fprintf(out, "{\n  \"block_size\": %lu,\n  \"min_seconds\": %.2f,\n"
+          "  \"cycles\": \"%s\",\n  \"results\": [\n", options.blockSize,
+          MIN_SECONDS, readCycles() > 0 ? "tsc" : "none");
+  fprintf(stderr, "%-8s %12s %8s", "corpus", "bytes", "ratio");
+  for(phase = 0; phase < PHASES; phase++)
+  {
+    fprintf(stderr, " %10s", phaseName[phase]);
+  }
+  fprintf(stderr, " %9s %9s %9s\n", "enc c/B", "dec c/B", "peak MB");
+
+  for(c = 0; c < CORPORA; c++)
+  {
+    for(size = MIN_SIZE, more = TRUE; more; size *= SIZE_STEP)
+    {
+      more = size <= maxSize / SIZE_STEP;
+      runChild(&corpus[c], size, &result);
+      writeCase(out, &corpus[c], size, &result, more || c + 1 < CORPORA);
+      fprintf(stderr, "%-8s %12lu", corpus[c].name, size);
+      if(result.status != 0)
+      {
+        fprintf(stderr, " %s\n", result.status == -2
+                ? "decoded bytes differ" : "did not run");
+        status = 4;
+        continue;
+      }
+      fprintf(stderr, " %8.3f", (double)result.encodedSize / size);
+      for(phase = 0; phase < PHASES; phase++)
+      {
+        fprintf(stderr, " %10.1f", size / result.seconds[phase] / 1e6);
+      }
+      fprintf(stderr, " %9.2f %9.2f %9.1f\n",
+              result.cycles[PHASE_ENCODE] / size,
+              result.cycles[PHASE_DECODE] / size,
+              result.peakKB[PHASE_DECODE] / 1024.0);
+    }
+  }
+  fprintf(out, "  ]\n}\n");
+  if(out != stdout)
+  {
+    fclose(out);
+  }
+  return status;
+}
@@ -0,0 +1,163 @@
+/*************************************/
+/* This file defines the histogram   */
+/* kernel that counts how often each */
+/* symbol occurs in a block of input */
+/*************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "huffman.h"
+
+#define TRUE 1
+#define FALSE 0
+
+/* the AVX2 path needs GCC or clang on x86 for the target */
+/* attribute and the runtime CPU check                    */
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define HAVE_AVX2_PATH 1
+#include <immintrin.h>
+#endif
+
+/* count tables; consecutive bytes go to different tables so */
+/* that repeated bytes do not wait on each other's stores    */
+#define COUNT_TABLES 8
+
+/* bytes counted between merges, so the 32-bit counts of a  */
+/* table never overflow                                     */
+#define COUNT_CHUNK (1UL << 30)
+
+/*********************************************************/
+/* Adds the count tables into the frequencies and clears */
+/* them.                                                 */
+/* in -- count tables, frequencies to add to             */
+/* out -- void                                           */
+/*********************************************************/
+static void mergeCounts(unsigned int count[COUNT_TABLES][NUM_CHAR],
+                        unsigned long frequency[NUM_CHAR])
+{
+  int table, symbol;
+
+  for(symbol = 0; symbol < NUM_CHAR; symbol++)
+  {
+    for(table = 0; table < COUNT_TABLES; table++)
+    {
+      frequency[symbol] += count[table][symbol];
+      count[table][symbol] = 0;
+    }
+  }
+}
+
+/* counts the eight bytes of a 64-bit word, one table each */
+#define COUNT_WORD(word)                  \
+  count[0][(word) & 0xff]++;              \
+  count[1][((word) >> 8) & 0xff]++;       \
+  count[2][((word) >> 16) & 0xff]++;      \
+  count[3][((word) >> 24) & 0xff]++;      \
+  count[4][((word) >> 32) & 0xff]++;      \
+  count[5][((word) >> 40) & 0xff]++;      \
+  count[6][((word) >> 48) & 0xff]++;      \
+  count[7][(word) >> 56]++
+
+/*********************************************************/
+/* Counts bytes into the count tables, eight at a time,  */
+/* one table for each byte of a 64-bit word.             */
+/* in -- bytes and their number, at most COUNT_CHUNK,    */
+/*       count tables                                    */
+/* out -- void                                           */
+/*********************************************************/
+static void countScalar(const unsigned char* src, unsigned long n,
+                        unsigned int count[COUNT_TABLES][NUM_CHAR])
+{
+  uint64_t word;
+  unsigned long i = 0;
+
+  for(; i + 8 <= n; i += 8)
+  {
+    memcpy(&word, src + i, 8);
+    COUNT_WORD(word);
+  }
+  for(; i < n; i++)
+  {
+    count[0][src[i]]++;
+  }
+}
+
+#ifdef HAVE_AVX2_PATH
+/*********************************************************/
+/* Counts bytes like countScalar, but first compares     */
+/* each 32 bytes with their first byte using AVX2. A run */
+/* of 32 equal bytes, common in zero padded binaries and */
+/* in logs, is counted with a single add.                */
+/* in -- bytes and their number, at most COUNT_CHUNK,    */
+/*       count tables                                    */
+/* out -- void                                           */
+/*********************************************************/
+__attribute__((target("avx2")))
+static void countAVX2(const unsigned char* src, unsigned long n,
+                      unsigned int count[COUNT_TABLES][NUM_CHAR])
+{
+  __m256i bytes, first;
+  uint64_t word;
+  unsigned long i = 0;
+  int j;
+
+  for(; i + 32 <= n; i += 32)
+  {
+    bytes = _mm256_loadu_si256((const __m256i*)(src + i));
+    first = _mm256_set1_epi8((char)src[i]);
+    if(_mm256_movemask_epi8(_mm256_cmpeq_epi8(bytes, first)) == -1)
+    {
+      count[0][src[i]] += 32;
+      continue;
+    }
+    for(j = 0; j < 32; j += 8)
+    {
+      memcpy(&word, src + i + j, 8);
+      COUNT_WORD(word);
+    }
+  }
+  countScalar(src + i, n - i, count);
+}
+#endif
+
+/*********************************************************/
+/* Counts how often each symbol occurs. Uses the AVX2    */
+/* kernel when the CPU has AVX2 and the scalar one       */
+/* otherwise; both spread the counts over COUNT_TABLES   */
+/* tables that are merged at the end.                    */
+/* in -- bytes and their number, array that receives     */
+/*       the count of each symbol                        */
+/* out -- void                                           */
+/*********************************************************/
+void countSymbols(const unsigned char* src, unsigned long n,
+                  unsigned long frequency[NUM_CHAR])
+{
+  unsigned int count[COUNT_TABLES][NUM_CHAR];
+  unsigned long chunk;
+  int useAVX2 = FALSE;
+
+#ifdef HAVE_AVX2_PATH
+  useAVX2 = __builtin_cpu_supports("avx2");
+#endif
+
+  memset(count, 0, sizeof(count));
+  memset(frequency, 0, NUM_CHAR * sizeof(unsigned long));
+  while(n > 0)
+  {
+    chunk = n < COUNT_CHUNK ? n : COUNT_CHUNK;
+#ifdef HAVE_AVX2_PATH
+    if(useAVX2)
+    {
+      countAVX2(src, chunk, count);
+    }
+    else
+#endif
+    {
+      countScalar(src, chunk, count);
+    }
+    mergeCounts(count, frequency);
+    src += chunk;
+    n -= chunk;
+  }
+}
@@ -10,109 +10,115 @@
 
 #include <stdio.h>
 #include <stdlib.h>
-#include<limits.h>
+#include <string.h>
+#include <ctype.h>
 #include "huffman.h"
 
-#define NUM_CHAR 256
 #define TRUE 1
 #define FALSE 0
 
-struct Node
+/*******************************************************/
+/* Decodes one file of a batch with the decoder of the */
+/* thread that runs it.                                */
+/* in -- the decoders, thread, input and output        */
+/* return -- 0, or -1 if the file is damaged           */
+/*******************************************************/
+static int decodeBatchFile(void* context, int worker, struct Input* in,
+                           struct Output* out)
 {
-  unsigned char symbol;
-  unsigned long frequency;
-  struct Node* left;
-  struct Node* right;
-  struct Node* next;
-  int codeArray[NUM_CHAR];
-  int codeLength;
-}; 
+  struct Decoder** decoder = context;
 
+  return decodeWith(decoder[worker], in, out);
+}
+
+/*******************************************************/
+/* Decodes a batch of files, threads files at a time,  */
+/* each with one thread. Every thread keeps one        */
+/* decoder for all its files, so its buffers are       */
+/* allocated once. Files that fail are named on the    */
+/* way out.                                            */
+/* in -- the files and their number, number of         */
+/*       threads, TRUE to print stats                  */
+/* return -- 0, or the exit code of the first file     */
+/*           that failed                               */
 /*******************************************************/
-/* Decodes a file encoded with the Huffman algorithm.  */
-/* Reads characters and their frequencies from a file, */
-/* stores them in two different arrays, then creates a */
-/* Huffman tree using the data in the arrays. It then  */
-/* continues reading from the file, and moves through  */
-/* the tree as indicated by individual bits. When it   */
-/* reaches a leaf, it outputs the decoded character to */
-/* the output file.                                    */
-/* in -- file containing input                         */
-/* out -- file that the output will be written into    */
-/******************************************************/
-void decodeFile(FILE* in, FILE* out)
+static int decodeBatch(struct BatchFile* files, unsigned long count,
+                       int threads, int showStats)
 {
-  unsigned char characters[NUM_CHAR];
-  unsigned long frequency[NUM_CHAR];
-  
-  unsigned char uniqueChar, buffer;
-  unsigned long totalChar;
-  struct Node* head;
-  struct Node* newNode;
-  struct Node* top;
-  struct Node* current;
+  struct Decoder** decoder;
+  struct Stats stats;
+  unsigned long i;
+  int status = 0;
+  double started = statsSeconds();
 
-  int i, bufferIndex, byteCounter;
-
-  head = NULL;
-  
-  fread(&uniqueChar, sizeof(unsigned char), 1, in);
-  for(i = 0; i < uniqueChar; i++)
+  memset(&stats, 0, sizeof(stats));
+  decoder = calloc(threads, sizeof(struct Decoder*));
+  for(i = 0; decoder != NULL && status == 0
+             && i < (unsigned long)threads; i++)
   {
-    fread(&characters[i], sizeof(unsigned char), 1, in);
-    fread(&frequency[i], sizeof(unsigned long), 1, in);
-    newNode = createNode(characters[i], frequency[i]);
-    head = insertSorted(head, newNode);
+    decoder[i] = createDecoder(1);
+    status = decoder[i] == NULL ? -1 : 0;
+  }
+  if(decoder == NULL || status != 0
+     || runBatch(files, count, threads, decodeBatchFile, decoder,
+                 showStats ? &stats : NULL) != 0)
+  {
+    fprintf(stderr, "out of memory\n");
+    status = 4;
+  }
+  for(i = 0; decoder != NULL && i < (unsigned long)threads; i++)
+  {
+    destroyDecoder(decoder[i]);
+  }
+  free(decoder);
+  if(status != 0)
+  {
+    return status;
   }
-  fread(&totalChar, sizeof(unsigned long), 1, in);
-
-  top = buildTree(head);
-
-  current = top;
-  byteCounter = 0;
-  bufferIndex = 0;
 
-  /* adapted from https://github.com/adeesha-savinda/huffman-encode-decode */
-  
-  while(byteCounter < totalChar)
+  for(i = 0; i < count; i++)
   {
-    if (bufferIndex == 0)
+    if(files[i].status == BATCH_NO_INPUT)
     {
-      fread(&buffer, sizeof(unsigned char), 1, in);
+      printf("couldn't open %s for reading\n", files[i].input);
     }
-    if(buffer & 128)
+    else if(files[i].status == BATCH_NO_OUTPUT)
     {
-      current = current->right;
+      printf("couldn't open %s for writing\n", files[i].output);
     }
-    else
+    else if(files[i].status == BATCH_FAILED)
     {
-      current = current->left;
+      fprintf(stderr, "%s: unsupported or damaged file\n", files[i].input);
     }
-    if(isLeaf(current))
+    if(status == 0)
     {
-      fwrite(&(current->symbol), sizeof(unsigned char), 1, out);
-      byteCounter++;
-      current = top;
-    }
-    buffer = buffer << 1;
-    if(++bufferIndex > 7)
-    {
-      bufferIndex = 0;
+      status = files[i].status;
     }
   }
-  freeTree(top);
+  if(showStats)
+  {
+    printStats(stderr, "decode", &stats, statsSeconds() - started);
+  }
+  return status;
 }
 
 /*******************************************************/
 /* Main function which open input and output files,    */
 /* checks whether the number of arguments is correct,  */
 /* then calls the decodeFile function. When decoding   */
-/* is finished, it closes the input and output files,  */
-/* and free memory allocated to the Huffman tree       */
+/* is finished, it closes the input and output files.  */
+/* A file name of - stands for standard input or       */
+/* standard output. With -t the input is a message     */
+/* encoded with a trained table. --range start:len     */
+/* decodes only len bytes from byte start on. --stats  */
+/* prints where the time went to standard error.       */
+/* Several pairs of files, or --batch and a list of    */
+/* them, are decoded by one process, -T files at a     */
+/* time.                                               */
 /* in -- int argc, number of arguments                 */ 
 /*       char ** argv, pointer to a pointers to arrays */
 /*	 of strings containing command line arguments  */
-/* out -- returns 0 at the end of main                 */
+/* out -- returns 0 if the whole file decoded          */
 /*******************************************************/
 int main(int argc, char** argv)
 {
@@ -120,34 +126,210 @@ int main(int argc, char** argv)
   char* outfile;
   FILE* in;
   FILE* out;
+  struct Input input;
+  struct Output output;
+  struct StaticTable table;
+  struct Stats stats;
+  struct BatchFile* files;
+  char* tableName = NULL;
+  char* batchName = NULL;
+  char* names;
+  char* end;
+  unsigned long count, i;
+  long line;
+  uint64_t rangeStart = 0, rangeLength = 0;
+  int arg, status, threads = 1, showStats = FALSE, range = FALSE;
+  double started = 0.0;
 
-  if(argc != 3) 
+  for(arg = 1; arg < argc && argv[arg][0] == '-' && argv[arg][1] != '\0'; arg++)
+  {
+    if(strcmp(argv[arg], "-T") == 0 && arg + 1 < argc)
+    {
+      threads = atoi(argv[++arg]);
+      if(threads < 1 || threads > MAX_THREADS)
+      {
+        printf("thread count must be 1 to %d\n", MAX_THREADS);
+        return 1;
+      }
+    }
+    else if(strcmp(argv[arg], "-t") == 0 && arg + 1 < argc)
+    {
+      tableName = argv[++arg];
+    }
+    else if(strcmp(argv[arg], "--batch") == 0 && arg + 1 < argc)
+    {
+      batchName = argv[++arg];
+    }
+    else if(strcmp(argv[arg], "--range") == 0 && arg + 1 < argc)
+    {
+      arg++;
+      rangeStart = strtoul(argv[arg], &end, 10);
+      if(isdigit((unsigned char)argv[arg][0]) && *end == ':'
+         && isdigit((unsigned char)end[1]))
+      {
+        rangeLength = strtoul(end + 1, &end, 10);
+      }
+      else
+      {
+        end = argv[arg];
+      }
+      if(*end != '\0')
+      {
+        printf("range must be start:length in bytes\n");
+        return 1;
+      }
+      range = TRUE;
+    }
+    else if(strcmp(argv[arg], "--stats") == 0)
+    {
+      showStats = TRUE;
+    }
+    else
+    {
+      printf("unknown option %s\n", argv[arg]);
+      return 1;
+    }
+  }
+
+  if(batchName != NULL ? argc != arg
+                       : argc - arg < 2 || (argc - arg) % 2 != 0)
   {
     printf("wrong number of args\n");
+    printf("usage: %s [-T threads] [-t table] [--range start:len] [--stats]"
+           " infile outfile...\n", argv[0]);
+    printf("       %s [-T threads] [--stats] --batch list\n", argv[0]);
     return 1;
   }
 
-  infile = argv[1];
-  outfile = argv[2];
+  if(batchName != NULL || argc - arg > 2)
+  {
+    if(tableName != NULL || range)
+    {
+      printf("a batch can't be decoded with -t or --range\n");
+      return 1;
+    }
+    names = NULL;
+    if(batchName == NULL)
+    {
+      count = (unsigned long)(argc - arg) / 2;
+      files = malloc(count * sizeof(struct BatchFile));
+      for(i = 0; files != NULL && i < count; i++)
+      {
+        files[i].input = argv[arg + 2 * i];
+        files[i].output = argv[arg + 2 * i + 1];
+      }
+      line = files == NULL ? -1 : 0;
+    }
+    else
+    {
+      in = strcmp(batchName, "-") == 0 ? stdin : fopen(batchName, "rb");
+      if(in == NULL)
+      {
+        printf("couldn't open %s for reading\n", batchName);
+        return 2;
+      }
+      line = readBatchList(in, FALSE, &files, &count, &names);
+      fclose(in);
+    }
+    if(line < 0)
+    {
+      fprintf(stderr, "out of memory\n");
+      return 4;
+    }
+    if(line > 0)
+    {
+      printf("line %ld of %s: a name alone must end in %s\n", line,
+             batchName, BATCH_SUFFIX);
+      status = 1;
+    }
+    else
+    {
+      status = decodeBatch(files, count, threads, showStats);
+    }
+    free(files);
+    free(names);
+    return status;
+  }
+
+  if(tableName != NULL)
+  {
+    in = fopen(tableName, "rb");
+    if(in == NULL)
+    {
+      printf("couldn't open %s for reading\n", tableName);
+      return 2;
+    }
+    openInput(&input, in);
+    status = loadStaticTable(&input, &table);
+    closeInput(&input);
+    fclose(in);
+    if(status != 0)
+    {
+      printf("%s is not a trained table\n", tableName);
+      return 1;
+    }
+  }
+
+  infile = argv[arg];
+  outfile = argv[arg + 1];
 
-  in = fopen(infile, "rb");
+  in = strcmp(infile, "-") == 0 ? stdin : fopen(infile, "rb");
   if(in == NULL)
   {
     printf("couldn't open %s for reading\n", infile);
     return 2;
   }
 
-  out = fopen(outfile, "wb");
+  out = strcmp(outfile, "-") == 0 ? stdout : fopen(outfile, "wb");
   if(out == NULL)
   {
     printf("couldn't open %s for writing\n", outfile);
     return 3;
   }
 
-  decodeFile(in, out);
+  openInput(&input, in);
+  if(openOutput(&output, out) != 0)
+  {
+    fprintf(stderr, "out of memory\n");
+    return 4;
+  }
+  if(showStats)
+  {
+    memset(&stats, 0, sizeof(stats));
+    input.stats = &stats;
+    output.stats = &stats;
+    started = statsSeconds();
+  }
+
+  if(tableName != NULL)
+  {
+    status = decodeMessageFile(&input, &output, &table);
+  }
+  else if(range)
+  {
+    status = decodeRangeFile(&input, &output, rangeStart, rangeLength);
+  }
+  else
+  {
+    status = decodeFile(&input, &output, threads);
+  }
+  if(status != 0)
+  {
+    fprintf(stderr, "unsupported or damaged file\n");
+  }
+  if(closeOutput(&output) != 0)
+  {
+    fprintf(stderr, "couldn't write %s\n", outfile);
+    status = -1;
+  }
+  if(showStats)
+  {
+    printStats(stderr, "decode", &stats, statsSeconds() - started);
+  }
+  closeInput(&input);
 
   fclose(in);
   fclose(out);
 
-  return 0;
+  return status == 0 ? 0 : 4;
 }
@@ -9,58 +9,43 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include "huffman.h"
 
-#define NUM_CHAR 256
 #define TRUE 1
 #define FALSE 0
 
-struct Node
-{
-  unsigned char symbol;
-  unsigned long frequency;
-  struct Node* left;
-  struct Node* right;
-  struct Node* next;
-  int codeArray[NUM_CHAR];
-  int codeLength;
-};
+/* how the code table of every block is printed */
+#define DUMP_NONE 0
+#define DUMP_TEXT 1
+#define DUMP_CSV 2
+#define DUMP_JSON 3
 
-/**************************************************/
-/* Inserts nodes in a list sorted by symbol value */
-/* in -- struct Node pointer to a pointer to the  */
-/*       head of the list                         */
-/* out -- struct Node pointer to the head of the  */
-/*        list sorted by symbol values            */
-/**************************************************/
-void sortSymbolValue(struct Node** head, struct Node* newNode)
+/* where and how the code tables are printed, and the */
+/* number of the next block                           */
+struct TableDump
 {
-  unsigned char symbol = newNode->symbol;
-  struct Node** current = head;
-
-  while(*current != NULL && (*current)->symbol < symbol)
-  {
-    current = &((*current)->next);
-  }
-  newNode->next = *current;
-  *current = newNode;
-}
+  FILE* file;
+  int format;
+  unsigned long block;
+};
 
 /***************************************************/
 /* Prints a character; If the character is not     */
 /* printable, the function prints its ASCII value. */
-/* in -- unsigned character to be printed          */
+/* in -- file to print to, unsigned character to   */
+/*       be printed                                */
 /* return -- void, does not return                    */
 /***************************************************/
-void printChar(unsigned char character)
+void printChar(FILE* report, unsigned char character)
 {
   if(character > ' ' && character <= '~')
   { 
-    printf("%c", character);
+    fprintf(report, "%c", character);
   } 
   else
   {
-    printf("=%u", character);
+    fprintf(report, "=%u", character);
   }  
 }
 
@@ -80,187 +65,283 @@ void printArray(int array[], int treeLevel)
   printf("\n");
 }
 
-/*************************************************************/
-/* Extracts codes from Huffman tree. Assigns zero to left    */
-/* branches, and 1 to right branches. The function is then   */
-/* called recursively until it reches a leaf. When it reaches*/
-/* a leaf, it stores the code for the leaf's character in    */
-/* an array, and inserts the leaf in a list sorted by        */
-/* character value.                                          */
-/* in -- struct node pointer to the root of the tree         */  
-/*       code array that stores bit values as integers       */
-/*       integer value representing the current depth        */
-/*       struct pointer to a pointer to the head of a list   */
-/* return -- void                                               */
-/*************************************************************/      
-void extractCodes(struct Node* root, int codeArray[], 
-                  int treeLevel, struct Node** symbolListHead)
+/********************************************************************/
+/* Prints the code of one symbol as a string of bits.               */
+/* in -- file to print to, code table, the symbol                   */
+/* return -- void                                                   */
+/********************************************************************/
+static void printCode(FILE* report, const struct CodeTable* codes, int symbol)
 {
-  int i;
-  
-  /* adapted from geeksforgeeks.org/huffman-coding-greedy-algo-3 */
-  if(root->left)
-  {
-    codeArray[treeLevel] = 0;
-    extractCodes(root->left, codeArray, treeLevel+1, symbolListHead);
-  }
-  if(root->right)
+  int j;
+
+  for(j = codes->length[symbol] - 1; j >= 0; j--)
   {
-    codeArray[treeLevel] = 1;
-    extractCodes(root->right, codeArray, treeLevel+1, symbolListHead);
+    fprintf(report, "%d", (int)(codes->code[symbol] >> j) & 1);
   }
+}
+
+/********************************************************************/
+/* Prints the table of characters, frequencies, and codes.          */
+/* in -- file to print to, frequency of each character, code table, */
+/*       unsigned long number of total characters                   */
+/* return -- void                                                   */
+/********************************************************************/
+void printTable(FILE* report, const unsigned long frequency[NUM_CHAR],
+                const struct CodeTable* codes, unsigned long totalChar)
+{
+  int i;
 
-  if(isLeaf(root))
+  for(i = 0; i < NUM_CHAR; i++)
   {
-    root->codeLength = treeLevel;
-    for(i = 0; i < treeLevel; ++i)
+    if(codes->length[i] == 0)
     {
-      root->codeArray[i] = codeArray[i];
+      continue;
     }
-    sortSymbolValue(symbolListHead, root);
+    printChar(report, (unsigned char)i);
+    fprintf(report, "\t%lu\t", frequency[i]);
+    printCode(report, codes, i);
+    fprintf(report, "\n");
   }
+  fprintf(report, "Total chars = %lu\n", totalChar);
 }
 
 /********************************************************************/
-/* Prints the table of characters, frequencies, and codes to        */
-/* standard output.                                                 */
-/* in -- struct node pointer to the head of the list                */
-/*       unsigned char number of unique characters                  */
-/*       unsigned long number of total characters                   */
+/* Prints the table of one block as CSV rows of block, symbol,      */
+/* frequency, code and code length, under a header row printed      */
+/* before the first block.                                          */
+/* in -- the dump, frequency of each character, code table          */
 /* return -- void                                                   */
 /********************************************************************/
-void printTable(struct Node* symbolListHead, 
-                unsigned char uniqueChar, unsigned long totalChar)
+static void printTableCSV(struct TableDump* dump,
+                          const unsigned long frequency[NUM_CHAR],
+                          const struct CodeTable* codes)
 {
-  struct Node* current = symbolListHead;
-  int i, j;
+  int i;
 
-  for(i = 0; i < uniqueChar; i++)
+  if(dump->block == 0)
+  {
+    fprintf(dump->file, "block,symbol,frequency,code,length\n");
+  }
+  for(i = 0; i < NUM_CHAR; i++)
   {
-    printChar(current->symbol);
-    printf("\t%lu\t", current->frequency);
-    for(j = 0; j < current->codeLength; j++)
+    if(codes->length[i] == 0)
     {
-      printf("%d", current->codeArray[j]);
+      continue;
     }
-    printf("\n");
-    current = current->next;
+    fprintf(dump->file, "%lu,%d,%lu,", dump->block, i, frequency[i]);
+    printCode(dump->file, codes, i);
+    fprintf(dump->file, ",%d\n", codes->length[i]);
   }
-  printf("Total chars = %lu\n", totalChar);
 }
 
-/***********************************************************/
-/* Encodes a file using the Huffman algorithm. Reads bytes */
-/* from a file, the looks up each character's code in the  */
-/* list. It uses a buffer to write the encodes bytes to    */
-/* an output file.                                         */
-/* in -- input file                                        */
-/* out -- output file                                      */
-/***********************************************************/
-void encodeFile(FILE* in, FILE* out)
+/********************************************************************/
+/* Prints the table of one block as a line of JSON.                 */
+/* in -- the dump, frequency of each character, code table, number  */
+/*       of characters in the block                                 */
+/* return -- void                                                   */
+/********************************************************************/
+static void printTableJSON(struct TableDump* dump,
+                           const unsigned long frequency[NUM_CHAR],
+                           const struct CodeTable* codes,
+                           unsigned long rawSize)
 {
+  int i, first = TRUE;
 
-  unsigned long frequencyAll[NUM_CHAR] = {0};
-  unsigned char characters[NUM_CHAR];
-  unsigned long frequency[NUM_CHAR];
-  int codesArray[NUM_CHAR];
-  unsigned char uniqueChar, charIn, buffer;
-  unsigned long totalChar;
-
-  int i, j, newIndex, bufferIndex;
+  fprintf(dump->file, "{\"block\": %lu, \"size\": %lu, \"symbols\": [",
+          dump->block, rawSize);
+  for(i = 0; i < NUM_CHAR; i++)
+  {
+    if(codes->length[i] == 0)
+    {
+      continue;
+    }
+    fprintf(dump->file, "%s{\"symbol\": %d, \"frequency\": %lu, \"code\": \"",
+            first ? "" : ", ", i, frequency[i]);
+    printCode(dump->file, codes, i);
+    fprintf(dump->file, "\", \"length\": %d}", codes->length[i]);
+    first = FALSE;
+  }
+  fprintf(dump->file, "]}\n");
+}
 
-  struct Node* head = NULL;
-  struct Node* symbolListHead = NULL;
-  struct Node* current;
+/********************************************************************/
+/* Prints the table of one block as the encoder writes it, in the   */
+/* format the dump asks for.                                        */
+/* in -- struct TableDump, frequency of each character, code table, */
+/*       number of characters in the block                          */
+/* return -- void                                                   */
+/********************************************************************/
+static void reportBlock(void* report, const unsigned long frequency[NUM_CHAR],
+                        const struct CodeTable* codes, unsigned long rawSize)
+{
+  struct TableDump* dump = report;
 
-  uniqueChar = 0;
-  totalChar = 0;
+  if(dump->format == DUMP_CSV)
+  {
+    printTableCSV(dump, frequency, codes);
+  }
+  else if(dump->format == DUMP_JSON)
+  {
+    printTableJSON(dump, frequency, codes, rawSize);
+  }
+  else
+  {
+    /* print symbols, frequencies, and codes */
+    fprintf(dump->file, "Symbol\tFreq\tCode\n");
+    printTable(dump->file, frequency, codes, rawSize);
+  }
+  dump->block++;
+}
 
-  while(fread(&charIn, sizeof(unsigned char), 1, in) == 1)
+/*******************************************************/
+/* Trains a table from sample files and writes it to a */
+/* table file.                                         */
+/* in -- name of the table file, names of the samples  */
+/*       and their number                              */
+/* return -- exit status of the program                */
+/*******************************************************/
+static int trainTable(const char* tableName, char** samples, int count)
+{
+  unsigned long frequency[NUM_CHAR] = {0};
+  unsigned char bytes[TABLE_MAX_SIZE];
+  struct StaticTable table;
+  struct Input input;
+  struct Tree* tree;
+  FILE* file;
+  unsigned long size;
+  int i, status;
+
+  for(i = 0; i < count; i++)
   {
-    if(frequencyAll[charIn] == 0)
+    file = fopen(samples[i], "rb");
+    if(file == NULL)
     {
-      uniqueChar++;
+      printf("couldn't open %s for reading\n", samples[i]);
+      return 2;
+    }
+    openInput(&input, file);
+    status = countFile(&input, frequency);
+    closeInput(&input);
+    fclose(file);
+    if(status != 0)
+    {
+      fprintf(stderr, "out of memory\n");
+      return 4;
     }
-    frequencyAll[charIn]++;
-    totalChar++;
   }
 
-  newIndex = 0;
-  for(i = 0; i < NUM_CHAR; ++i)
+  tree = allocateTree();
+  if(tree == NULL)
   {
-    if(frequencyAll[i] > 0)
-    {
-      characters[newIndex] = (char)i;
-      frequency[newIndex] = frequencyAll[i];
-      newIndex++;
-    }
+    fprintf(stderr, "out of memory\n");
+    return 4;
   }
-  
-  /* create linked list sorted by character frequencies */
-  for(i = 0; i < newIndex; ++i)
+  trainStaticTable(tree, frequency, &table);
+  freeTree(tree);
+
+  file = fopen(tableName, "wb");
+  if(file == NULL)
   {
-   struct Node* newNode = createNode(characters[i], frequency[i]);
-   head = insertSorted(head, newNode);
+    printf("couldn't open %s for writing\n", tableName);
+    return 3;
+  }
+  size = writeStaticTable(bytes, &table);
+  status = fwrite(bytes, 1, size, file) == size;
+  if(fclose(file) != 0 || !status)
+  {
+    fprintf(stderr, "couldn't write %s\n", tableName);
+    return 4;
   }
+  printf("table %08lx\n", table.id);
+  return 0;
+}
 
-  /* build the Huffman tree */
-  head = buildTree(head);
+/*******************************************************/
+/* Encodes one file of a batch with the encoder of the */
+/* thread that runs it.                                */
+/* in -- the encoders, thread, input and output        */
+/* return -- 0, or -1 if memory ran out                */
+/*******************************************************/
+static int encodeBatchFile(void* context, int worker, struct Input* in,
+                           struct Output* out)
+{
+  struct Encoder** encoder = context;
 
-  /* print symbols, frequencies, and codes */
-  printf("Symbol\tFreq\tCode\n");
-  extractCodes(head, codesArray, 0, &symbolListHead);
-  printTable(symbolListHead, uniqueChar, totalChar);
+  return encodeWith(encoder[worker], in, out);
+}
 
-  /* write header to output file */
-  fwrite(&uniqueChar, sizeof(unsigned char), 1, out);
-  /* write symbols and frequencies to output file */
-  current = symbolListHead;
-  for(i = 0; i < uniqueChar; i++)
-  {    
-    fwrite(&(current->symbol), sizeof(unsigned char), 1, out);
-    fwrite(&(current->frequency), sizeof(unsigned long), 1, out);
-    current = current->next;
+/*******************************************************/
+/* Encodes a batch of files, options->threads files at */
+/* a time, each with one thread. Every thread keeps    */
+/* one encoder for all its files, so its trees and     */
+/* buffers are allocated once. Files that fail are     */
+/* named on the way out.                               */
+/* in -- the files and their number, how to encode,    */
+/*       TRUE to print stats                           */
+/* return -- 0, or the exit code of the first file     */
+/*           that failed                               */
+/*******************************************************/
+static int encodeBatch(struct BatchFile* files, unsigned long count,
+                       const struct EncodeOptions* options, int showStats)
+{
+  struct EncodeOptions fileOptions = *options;
+  struct Encoder** encoder;
+  struct Stats stats;
+  unsigned long i;
+  int status = 0;
+  double started = statsSeconds();
+
+  fileOptions.threads = 1;
+  memset(&stats, 0, sizeof(stats));
+  encoder = calloc(options->threads, sizeof(struct Encoder*));
+  for(i = 0; encoder != NULL && status == 0
+             && i < (unsigned long)options->threads; i++)
+  {
+    encoder[i] = createEncoder(&fileOptions);
+    status = encoder[i] == NULL ? -1 : 0;
+  }
+  if(encoder == NULL || status != 0
+     || runBatch(files, count, options->threads, encodeBatchFile, encoder,
+                 showStats ? &stats : NULL) != 0)
+  {
+    fprintf(stderr, "out of memory\n");
+    status = 4;
+  }
+  for(i = 0; encoder != NULL && i < (unsigned long)options->threads; i++)
+  {
+    destroyEncoder(encoder[i]);
+  }
+  free(encoder);
+  if(status != 0)
+  {
+    return status;
   }
-  /* write total number of encoded symbols to output file */
-  fwrite(&totalChar, sizeof(unsigned long), 1, out);
-
-  buffer = 0;
-  bufferIndex = 0;
-
-  rewind(in);
 
-  while(fread(&charIn, sizeof(unsigned char), 1, in) == 1)
+  for(i = 0; i < count; i++)
   {
-    current = symbolListHead;
-    for(i = 0; i < uniqueChar; ++i)
+    if(files[i].status == BATCH_NO_INPUT)
     {
-      if(current->symbol == charIn)
-      {
-	for(j = 0; j < current->codeLength; ++j)
-	{
-	  buffer = (buffer << 1) | current->codeArray[j];
-	  bufferIndex++;
-
-	  if(bufferIndex == 8)
-	  {
-	    fwrite(&buffer, sizeof(unsigned char), 1, out);
-	    bufferIndex = 0;
-	    buffer = 0;
-	  }
-	}
-	break;
-      }
-      current = current->next;
+      printf("couldn't open %s for reading\n", files[i].input);
+    }
+    else if(files[i].status == BATCH_NO_OUTPUT)
+    {
+      printf("couldn't open %s for writing\n", files[i].output);
+    }
+    else if(files[i].status == BATCH_FAILED)
+    {
+      fprintf(stderr, "couldn't encode %s to %s\n", files[i].input,
+              files[i].output);
+    }
+    if(status == 0)
+    {
+      status = files[i].status;
     }
   }
-  /* pads the last byte */
-  if(bufferIndex > 0)
+  if(showStats)
   {
-    buffer <<= (8 - bufferIndex);
-    fwrite(&buffer, sizeof(unsigned char), 1, out);
+    printStats(stderr, "encode", &stats, statsSeconds() - started);
   }
-  freeTree(head);
+  return status;
 }
 
 /*******************************************************/
@@ -268,11 +349,23 @@ void encodeFile(FILE* in, FILE* out)
 /* and checks whether the number of command            */
 /* line arguments is correct. It calls the             */
 /* encodeFile function, then closes the input          */
-/* and output files                                    */
+/* and output files. A file name of - stands for       */
+/* standard input or standard output. With -t the      */
+/* input is encoded as one message with a trained      */
+/* table; --train makes such a table from samples.     */
+/* --index ends the file with an index of its blocks.  */
+/* -a encodes in one pass with an adaptive tree, so    */
+/* the output keeps up with input from a pipe.         */
+/* Several pairs of files, or --batch and a list of    */
+/* them, are encoded by one process, -T files at a     */
+/* time.                                               */
+/* --stats prints where the time went to standard      */
+/* error; -v or --dump-table prints the code table of  */
+/* every block, which is otherwise left out.           */
 /* in -- integer argc number of command line arguments */
 /*       character array containing strings of the     */
 /*       command line arguments                        */
-/* return - 0                                          */
+/* return - 0 on success                               */
 /*******************************************************/
 int main(int argc, char** argv)
 {
@@ -282,33 +375,271 @@ int main(int argc, char** argv)
   FILE* in;
   FILE* out;
 
-   if(argc != 3) 
+  struct Input input;
+  struct Output output;
+  struct EncodeOptions options;
+  struct StaticTable table;
+  struct Stats stats;
+  struct TableDump dump;
+  struct BatchFile* files;
+  char* tableName = NULL;
+  char* batchName = NULL;
+  char* names;
+  unsigned long count, i;
+  long line;
+  int arg, status, showStats = FALSE, adaptive = FALSE;
+  double started = 0.0;
+
+  defaultEncodeOptions(&options);
+  dump.format = DUMP_NONE;
+  dump.block = 0;
+  for(arg = 1; arg < argc && argv[arg][0] == '-' && argv[arg][1] != '\0'; arg++)
+  {
+    if(strcmp(argv[arg], "-l") == 0 && arg + 1 < argc)
+    {
+      options.maxCodeLength = atoi(argv[++arg]);
+      if(options.maxCodeLength < 1 || options.maxCodeLength > MAX_CODE_LENGTH)
+      {
+        printf("code length limit must be 1 to %d\n", MAX_CODE_LENGTH);
+        return 1;
+      }
+    }
+    else if(strcmp(argv[arg], "-T") == 0 && arg + 1 < argc)
+    {
+      options.threads = atoi(argv[++arg]);
+      if(options.threads < 1 || options.threads > MAX_THREADS)
+      {
+        printf("thread count must be 1 to %d\n", MAX_THREADS);
+        return 1;
+      }
+    }
+    else if(strcmp(argv[arg], "-s") == 0 && arg + 1 < argc)
+    {
+      options.streams = atoi(argv[++arg]) == STREAMS;
+      if(!options.streams && atoi(argv[arg]) != 1)
+      {
+        printf("stream count must be 1 or %d\n", STREAMS);
+        return 1;
+      }
+    }
+    else if(strcmp(argv[arg], "-c") == 0)
+    {
+      options.contexts = TRUE;
+    }
+    else if(strcmp(argv[arg], "-a") == 0)
+    {
+      adaptive = TRUE;
+    }
+    else if(strcmp(argv[arg], "--index") == 0)
+    {
+      options.index = TRUE;
+    }
+    else if(strcmp(argv[arg], "--stats") == 0)
+    {
+      showStats = TRUE;
+    }
+    else if(strcmp(argv[arg], "-v") == 0)
+    {
+      dump.format = DUMP_TEXT;
+    }
+    else if(strcmp(argv[arg], "--dump-table") == 0 && arg + 1 < argc)
+    {
+      arg++;
+      if(strcmp(argv[arg], "text") == 0)
+      {
+        dump.format = DUMP_TEXT;
+      }
+      else if(strcmp(argv[arg], "csv") == 0)
+      {
+        dump.format = DUMP_CSV;
+      }
+      else if(strcmp(argv[arg], "json") == 0)
+      {
+        dump.format = DUMP_JSON;
+      }
+      else
+      {
+        printf("table format must be text, csv or json\n");
+        return 1;
+      }
+    }
+    else if(strcmp(argv[arg], "--train") == 0 && arg + 2 < argc)
+    {
+      return trainTable(argv[arg + 1], argv + arg + 2, argc - arg - 2);
+    }
+    else if(strcmp(argv[arg], "-t") == 0 && arg + 1 < argc)
+    {
+      tableName = argv[++arg];
+    }
+    else if(strcmp(argv[arg], "--batch") == 0 && arg + 1 < argc)
+    {
+      batchName = argv[++arg];
+    }
+    else if(strcmp(argv[arg], "-b") == 0 && arg + 1 < argc)
+    {
+      options.blockSize = strtoul(argv[++arg], NULL, 10) * 1024;
+      if(options.blockSize < 1 || options.blockSize > MAX_BLOCK_SIZE)
+      {
+        printf("block size must be 1 to %d KB\n", MAX_BLOCK_SIZE / 1024);
+        return 1;
+      }
+    }
+    else
+    {
+      printf("unknown option %s\n", argv[arg]);
+      return 1;
+    }
+  }
+
+  if(batchName != NULL ? argc != arg
+                       : argc - arg < 2 || (argc - arg) % 2 != 0)
   {
     printf("wrong number of args\n");
+    printf("usage: %s [-l maxbits] [-b blockKB] [-s streams] [-c] [-T threads]"
+           " [--index]\n", argv[0]);
+    printf("       %*s [--stats] [-v | --dump-table text|csv|json] infile"
+           " outfile...\n", (int)strlen(argv[0]), "");
+    printf("       %s [options] --batch list\n", argv[0]);
+    printf("       %s [--stats] -t table infile outfile\n", argv[0]);
+    printf("       %s [--stats] -a infile outfile\n", argv[0]);
+    printf("       %s --train table sample...\n", argv[0]);
+    return 1;
+  }
+
+  if(batchName != NULL || argc - arg > 2)
+  {
+    if(tableName != NULL || adaptive || dump.format != DUMP_NONE)
+    {
+      printf("a batch can't be encoded with -t, -a, -v or --dump-table\n");
+      return 1;
+    }
+    names = NULL;
+    if(batchName == NULL)
+    {
+      count = (unsigned long)(argc - arg) / 2;
+      files = malloc(count * sizeof(struct BatchFile));
+      for(i = 0; files != NULL && i < count; i++)
+      {
+        files[i].input = argv[arg + 2 * i];
+        files[i].output = argv[arg + 2 * i + 1];
+      }
+      line = files == NULL ? -1 : 0;
+    }
+    else
+    {
+      in = strcmp(batchName, "-") == 0 ? stdin : fopen(batchName, "rb");
+      if(in == NULL)
+      {
+        printf("couldn't open %s for reading\n", batchName);
+        return 2;
+      }
+      line = readBatchList(in, TRUE, &files, &count, &names);
+      fclose(in);
+    }
+    if(line < 0)
+    {
+      fprintf(stderr, "out of memory\n");
+      return 4;
+    }
+    status = encodeBatch(files, count, &options, showStats);
+    free(files);
+    free(names);
+    return status;
+  }
+
+  if(adaptive && (tableName != NULL || dump.format != DUMP_NONE))
+  {
+    printf("-a can't be used with -t, -v or --dump-table\n");
     return 1;
   }
 
-  infile = argv[1];
-  outfile = argv[2];
+  if(tableName != NULL)
+  {
+    in = fopen(tableName, "rb");
+    if(in == NULL)
+    {
+      printf("couldn't open %s for reading\n", tableName);
+      return 2;
+    }
+    openInput(&input, in);
+    status = loadStaticTable(&input, &table);
+    closeInput(&input);
+    fclose(in);
+    if(status != 0)
+    {
+      printf("%s is not a trained table\n", tableName);
+      return 1;
+    }
+  }
 
-  in = fopen(infile, "rb");
+  infile = argv[arg];
+  outfile = argv[arg + 1];
+
+  in = strcmp(infile, "-") == 0 ? stdin : fopen(infile, "rb");
   if(in == NULL)
   {
     printf("couldn't open %s for reading\n", infile);
     return 2;
   }
 
-  out = fopen(outfile, "wb");
+  out = strcmp(outfile, "-") == 0 ? stdout : fopen(outfile, "wb");
   if(out == NULL)
   {
     printf("couldn't open %s for writing\n", outfile);
     return 3;
   }
 
-  encodeFile(in, out);
+  openInput(&input, in);
+  if(openOutput(&output, out) != 0)
+  {
+    fprintf(stderr, "out of memory\n");
+    return 4;
+  }
+  if(showStats)
+  {
+    memset(&stats, 0, sizeof(stats));
+    input.stats = &stats;
+    output.stats = &stats;
+    started = statsSeconds();
+  }
+
+  /* the tables go to standard error when the encoded */
+  /* data itself goes to standard output              */
+  if(dump.format != DUMP_NONE)
+  {
+    dump.file = out == stdout ? stderr : stdout;
+    options.report = reportBlock;
+    options.reportContext = &dump;
+  }
+  if(tableName != NULL)
+  {
+    status = encodeMessageFile(&input, &output, &table);
+  }
+  else if(adaptive)
+  {
+    status = encodeAdaptiveFile(&input, &output);
+  }
+  else
+  {
+    status = encodeFile(&input, &output, &options);
+  }
+  if(status != 0 && !output.failed)
+  {
+    fprintf(stderr, "out of memory\n");
+  }
+  if(closeOutput(&output) != 0)
+  {
+    fprintf(stderr, "couldn't write %s\n", outfile);
+    status = -1;
+  }
+  if(showStats)
+  {
+    printStats(stderr, "encode", &stats, statsSeconds() - started);
+  }
+  closeInput(&input);
 
   fclose(in);
   fclose(out);
   
-  return 0;
+  return status == 0 ? 0 : 4;
 }
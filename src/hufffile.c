@@ -0,0 +1,1001 @@
+/*************************************/
+/* This file defines the encoding    */
+/* and decoding of whole files, a    */
+/* batch of blocks at a time, for    */
+/* the programs and the library.     */
+/*************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "huffman.h"
+
+#define TRUE 1
+#define FALSE 0
+
+/* blocks read ahead for each thread, so that a thread  */
+/* that finishes early can take a block from another    */
+#define BLOCKS_PER_THREAD 2
+
+/* size of the chunks read from and written to the files */
+#define IO_BUFFER_SIZE 65536
+
+/* bytes kept unread at the end of a chunk so that a code */
+/* never runs past the data that has been read so far     */
+#define DECODE_MARGIN 64
+
+/* most entries an index block can hold; a file with more */
+/* blocks is written without an index                     */
+#define MAX_INDEX_ENTRIES \
+  ((0xffffffffUL - BLOCK_HEADER_SIZE) / INDEX_ENTRY_SIZE)
+
+/* decoded bytes decodeRangeFile writes at a time */
+#define RANGE_CHUNK_SIZE (4 * 1024 * 1024)
+
+/* one block of input and its encoding; input points */
+/* into the mapped file, or to buffer when the input  */
+/* is read                                            */
+struct EncodeSlot
+{
+  const unsigned char* input;
+  unsigned char* buffer;
+  unsigned long rawSize;
+  unsigned char* output;
+  unsigned long size;
+  unsigned long frequency[NUM_CHAR];
+  struct CodeTable codes;
+  struct Stats stats;
+};
+
+/* what the encode jobs share; stats is NULL unless */
+/* the input gathers stats                          */
+struct EncodeBatch
+{
+  const struct EncodeOptions* options;
+  struct EncodeSlot* slot;
+  struct Tree** tree;
+  struct Stats* stats;
+};
+
+/* entries of the index being built, INDEX_ENTRY_SIZE */
+/* bytes each, and the room allocated for them         */
+struct IndexBuilder
+{
+  unsigned char* entry;
+  unsigned long entries;
+  unsigned long capacity;
+};
+
+/*******************************************************/
+/* Adds the entry of one block to an index, doubling   */
+/* its room when it is full. An index that would       */
+/* outgrow MAX_INDEX_ENTRIES is dropped.               */
+/* in -- index, decoded bytes before the block, offset */
+/*       of its header in the file                     */
+/* out -- 0, or -1 if memory ran out                   */
+/*******************************************************/
+static int addIndexEntry(struct IndexBuilder* index, uint64_t rawOffset,
+                         uint64_t fileOffset)
+{
+  unsigned char* grown;
+
+  if(index->entries == index->capacity)
+  {
+    if(index->capacity == MAX_INDEX_ENTRIES)
+    {
+      return 0;
+    }
+    index->capacity = index->capacity == 0 ? 64 : 2 * index->capacity;
+    if(index->capacity > MAX_INDEX_ENTRIES)
+    {
+      index->capacity = MAX_INDEX_ENTRIES;
+    }
+    grown = realloc(index->entry, index->capacity * INDEX_ENTRY_SIZE);
+    if(grown == NULL)
+    {
+      return -1;
+    }
+    index->entry = grown;
+  }
+  storeLE64(index->entry + index->entries * INDEX_ENTRY_SIZE, rawOffset);
+  storeLE64(index->entry + index->entries * INDEX_ENTRY_SIZE + 8, fileOffset);
+  index->entries++;
+  return 0;
+}
+
+/*******************************************************/
+/* Encodes the block in one slot, using the tree nodes */
+/* of the thread that runs it.                         */
+/* in -- struct EncodeBatch, slot, thread              */
+/* out -- void                                         */
+/*******************************************************/
+static void encodeJob(void* context, unsigned long job, int worker)
+{
+  struct EncodeBatch* batch = context;
+  struct EncodeSlot* slot = &batch->slot[job];
+
+  memset(&slot->stats, 0, sizeof(struct Stats));
+  slot->size = encodeBlock(batch->options, slot->input, slot->rawSize,
+                           slot->output, batch->tree[worker],
+                           slot->frequency, &slot->codes,
+                           batch->stats != NULL ? &slot->stats : NULL);
+}
+
+/* the threads, slots, trees and index of encodeFile, */
+/* kept from one file to the next                      */
+struct Encoder
+{
+  struct EncodeOptions options;
+  struct ThreadPool* pool;
+  struct EncodeSlot* slot;
+  unsigned long slots;
+  struct Tree** tree;
+  struct IndexBuilder index;
+};
+
+/*******************************************************/
+/* Creates an encoder: a pool of options->threads      */
+/* threads, BLOCKS_PER_THREAD slots for each, and a    */
+/* tree for each thread.                               */
+/* in -- how to encode                                 */
+/* out -- the encoder, NULL if memory ran out          */
+/*******************************************************/
+struct Encoder* createEncoder(const struct EncodeOptions* options)
+{
+  struct Encoder* encoder = calloc(1, sizeof(struct Encoder));
+  int threads = options->threads, failed;
+  unsigned long i;
+
+  if(encoder == NULL)
+  {
+    return NULL;
+  }
+  encoder->options = *options;
+  encoder->slots = threads == 1 ? 1
+                                : (unsigned long)threads * BLOCKS_PER_THREAD;
+  encoder->pool = createPool(threads);
+  encoder->slot = calloc(encoder->slots, sizeof(struct EncodeSlot));
+  encoder->tree = calloc(threads, sizeof(struct Tree*));
+  failed = encoder->pool == NULL || encoder->slot == NULL
+           || encoder->tree == NULL;
+  for(i = 0; !failed && i < encoder->slots; i++)
+  {
+    encoder->slot[i].buffer = allocateBuffer(options->blockSize);
+    encoder->slot[i].output = allocateBuffer(blockBound(options->blockSize));
+    failed = encoder->slot[i].buffer == NULL
+             || encoder->slot[i].output == NULL;
+  }
+  for(i = 0; !failed && i < (unsigned long)threads; i++)
+  {
+    encoder->tree[i] = allocateTree();
+    failed = encoder->tree[i] == NULL;
+  }
+  if(failed)
+  {
+    destroyEncoder(encoder);
+    return NULL;
+  }
+  return encoder;
+}
+
+/*******************************************************/
+/* Frees an encoder.                                   */
+/* in -- the encoder, may be NULL                      */
+/* out -- void                                         */
+/*******************************************************/
+void destroyEncoder(struct Encoder* encoder)
+{
+  unsigned long i;
+
+  if(encoder == NULL)
+  {
+    return;
+  }
+  for(i = 0; encoder->tree != NULL
+             && i < (unsigned long)encoder->options.threads; i++)
+  {
+    freeTree(encoder->tree[i]);
+  }
+  for(i = 0; encoder->slot != NULL && i < encoder->slots; i++)
+  {
+    free(encoder->slot[i].buffer);
+    free(encoder->slot[i].output);
+  }
+  free(encoder->index.entry);
+  free(encoder->tree);
+  free(encoder->slot);
+  destroyPool(encoder->pool);
+  free(encoder);
+}
+
+/***********************************************************/
+/* Encodes a file using the Huffman algorithm, one block   */
+/* at a time. Each block is read into memory once, its     */
+/* characters counted, and its codes looked up in a table  */
+/* indexed by the character, so the input is only read a   */
+/* single time and may be a pipe; a regular file is mapped */
+/* and encoded where it lies. Blocks are read a batch      */
+/* at a time, encoded in parallel, and written in the      */
+/* order they were read, so the output does not depend on  */
+/* the number of threads. Writes the magic and version,    */
+/* every block, the index of the blocks if the options ask */
+/* for one, then an end block with the total size.         */
+/* The stats of every block are added to those of the      */
+/* input, if it has any.                                   */
+/* encoder -- threads and memory to encode with            */
+/* in -- input                                             */
+/* out -- output                                           */
+/* return -- 0, or -1 if memory ran out                    */
+/***********************************************************/
+int encodeWith(struct Encoder* encoder, struct Input* in, struct Output* out)
+{
+  const struct EncodeOptions* options = &encoder->options;
+  struct EncodeSlot* slot = encoder->slot;
+  struct IndexBuilder* index = &encoder->index;
+  unsigned char magic[4];
+  unsigned char end[END_BLOCK_SIZE];
+  unsigned char indexHeader[BLOCK_HEADER_SIZE];
+  struct EncodeBatch batch;
+  unsigned long filled, i, indexSize = 0;
+  uint64_t totalSize = 0, fileOffset = 4;
+  int status = 0, endOfFile = FALSE;
+  double start;
+
+  batch.options = options;
+  batch.slot = slot;
+  batch.tree = encoder->tree;
+  batch.stats = in->stats;
+  index->entries = 0;
+
+  magic[0] = MAGIC_0;
+  magic[1] = MAGIC_1;
+  magic[2] = MAGIC_2;
+  magic[3] = FORMAT_VERSION;
+  writeBytes(out, magic, 4);
+
+  while(status == 0 && !endOfFile)
+  {
+    for(filled = 0; filled < encoder->slots && !endOfFile; filled++)
+    {
+      slot[filled].input = viewBytes(in, slot[filled].buffer,
+                                     options->blockSize, 0,
+                                     &slot[filled].rawSize);
+      if(slot[filled].rawSize < options->blockSize)
+      {
+        endOfFile = TRUE;
+        if(slot[filled].rawSize == 0)
+        {
+          break;
+        }
+      }
+    }
+
+    STATS_START(in->stats, start);
+    runJobs(encoder->pool, filled, encodeJob, &batch);
+    STATS_TIME(in->stats, blockSeconds, start);
+
+    for(i = 0; i < filled; i++)
+    {
+      if(in->stats != NULL)
+      {
+        addStats(in->stats, &slot[i].stats);
+      }
+      if(options->report != NULL)
+      {
+        options->report(options->reportContext, slot[i].frequency,
+                        &slot[i].codes, slot[i].rawSize);
+      }
+      if(options->index
+         && addIndexEntry(index, totalSize, fileOffset) != 0)
+      {
+        status = -1;
+      }
+      writeBytes(out, slot[i].output, slot[i].size);
+      totalSize += slot[i].rawSize;
+      fileOffset += slot[i].size;
+    }
+  }
+  if(status == 0 && options->index && index->entries < MAX_INDEX_ENTRIES)
+  {
+    writeIndexHeader(indexHeader, index->entries);
+    writeBytes(out, indexHeader, BLOCK_HEADER_SIZE);
+    writeBytes(out, index->entry, index->entries * INDEX_ENTRY_SIZE);
+    indexSize = BLOCK_HEADER_SIZE + index->entries * INDEX_ENTRY_SIZE;
+  }
+  if(status == 0)
+  {
+    writeEndBlock(end, totalSize, indexSize);
+    writeBytes(out, end, END_BLOCK_SIZE);
+  }
+  return status;
+}
+
+/*******************************************************/
+/* Encodes a file with an encoder made for it alone.   */
+/* in -- input                                         */
+/* out -- output                                       */
+/* options -- how to encode                            */
+/* return -- 0, or -1 if memory ran out                */
+/*******************************************************/
+int encodeFile(struct Input* in, struct Output* out,
+               const struct EncodeOptions* options)
+{
+  struct Encoder* encoder = createEncoder(options);
+  int status;
+
+  if(encoder == NULL)
+  {
+    return -1;
+  }
+  status = encodeWith(encoder, in, out);
+  destroyEncoder(encoder);
+  return status;
+}
+
+/* one encoded block and its decoding; body points into */
+/* the mapped file, or to input when the file is read.  */
+/* The buffers only grow, to the largest block the slot */
+/* has held                                             */
+struct DecodeSlot
+{
+  int type;
+  unsigned long rawSize;
+  unsigned long compSize;
+  const unsigned char* body;
+  unsigned char* input;
+  unsigned long inputSize;
+  unsigned char* output;
+  unsigned long outputSize;
+  int status;
+  struct Stats stats;
+};
+
+/* what the decode jobs share; stats is NULL unless */
+/* the input gathers stats                          */
+struct DecodeBatch
+{
+  struct DecodeSlot* slot;
+  struct Stats* stats;
+};
+
+/*******************************************************/
+/* Reads the next block header and the block body into */
+/* a slot. The body of the end block is the total      */
+/* decoded size of the file. An index                  */
+/* block is skipped: the blocks are read in order.     */
+/* in -- input positioned at a block header, slot,     */
+/*       where to store the total decoded size         */
+/* out -- 1 if a block was read, 0 at the end block,   */
+/*        -1 if the file is damaged or memory ran out  */
+/*******************************************************/
+static int readBlock(struct Input* in, struct DecodeSlot* slot,
+                     uint64_t* totalSize)
+{
+  unsigned char buffer[END_BLOCK_SIZE];
+  const unsigned char* blockHeader;
+  unsigned long got;
+  unsigned char* grown;
+
+  do
+  {
+    blockHeader = viewBytes(in, buffer, BLOCK_HEADER_SIZE, 0, &got);
+    if(got != BLOCK_HEADER_SIZE)
+    {
+      return -1;
+    }
+    readBlockHeader(blockHeader, &slot->type, &slot->rawSize,
+                    &slot->compSize);
+    if(slot->type == BLOCK_INDEX
+       && (slot->rawSize != 0 || slot->compSize % INDEX_ENTRY_SIZE != 0
+           || skipBytes(in, slot->compSize) != slot->compSize))
+    {
+      return -1;
+    }
+  } while(slot->type == BLOCK_INDEX);
+  if(slot->type == BLOCK_END)
+  {
+    if(slot->compSize != END_BODY_SIZE
+       || readBytes(in, buffer, END_BODY_SIZE) != END_BODY_SIZE)
+    {
+      return -1;
+    }
+    *totalSize = readEndBody(buffer);
+    return 0;
+  }
+  if(slot->rawSize > MAX_BLOCK_SIZE
+     || slot->compSize > blockBound(MAX_BLOCK_SIZE))
+  {
+    return -1;
+  }
+
+  if(slot->compSize > slot->inputSize)
+  {
+    grown = realloc(slot->input, slot->compSize + DECODE_PAD);
+    if(grown == NULL)
+    {
+      return -1;
+    }
+    slot->input = grown;
+    slot->inputSize = slot->compSize;
+  }
+  if(slot->rawSize > slot->outputSize)
+  {
+    grown = realloc(slot->output, slot->rawSize);
+    if(grown == NULL)
+    {
+      return -1;
+    }
+    slot->output = grown;
+    slot->outputSize = slot->rawSize;
+  }
+
+  slot->body = viewBytes(in, slot->input, slot->compSize, DECODE_PAD, &got);
+  return got == slot->compSize ? 1 : -1;
+}
+
+/*******************************************************/
+/* Decodes the block in one slot.                      */
+/* in -- struct DecodeBatch, slot, thread              */
+/* out -- void                                         */
+/*******************************************************/
+static void decodeJob(void* context, unsigned long job, int worker)
+{
+  struct DecodeBatch* batch = context;
+  struct DecodeSlot* slot = &batch->slot[job];
+
+  memset(&slot->stats, 0, sizeof(struct Stats));
+  /* a raw block is written straight from its body */
+  if(slot->type == BLOCK_RAW)
+  {
+    slot->stats.blocks = 1;
+    slot->stats.storedBlocks = 1;
+    slot->status = slot->compSize == slot->rawSize ? 0 : -1;
+    return;
+  }
+  slot->status = decodeBlock(slot->type, slot->body, slot->compSize,
+                             slot->output, slot->rawSize,
+                             batch->stats != NULL ? &slot->stats : NULL);
+}
+
+/* the threads and slots of decodeFile, kept from one */
+/* file to the next                                    */
+struct Decoder
+{
+  struct ThreadPool* pool;
+  struct DecodeSlot* slot;
+  unsigned long slots;
+};
+
+/*******************************************************/
+/* Creates a decoder: a pool of threads and            */
+/* BLOCKS_PER_THREAD slots for each. The buffers of    */
+/* the slots are allocated by the first blocks.        */
+/* in -- number of blocks decoded at the same time     */
+/* out -- the decoder, NULL if memory ran out          */
+/*******************************************************/
+struct Decoder* createDecoder(int threads)
+{
+  struct Decoder* decoder = malloc(sizeof(struct Decoder));
+
+  if(decoder == NULL)
+  {
+    return NULL;
+  }
+  decoder->slots = threads == 1 ? 1
+                                : (unsigned long)threads * BLOCKS_PER_THREAD;
+  decoder->pool = createPool(threads);
+  decoder->slot = calloc(decoder->slots, sizeof(struct DecodeSlot));
+  if(decoder->pool == NULL || decoder->slot == NULL)
+  {
+    destroyDecoder(decoder);
+    return NULL;
+  }
+  return decoder;
+}
+
+/*******************************************************/
+/* Frees a decoder.                                    */
+/* in -- the decoder, may be NULL                      */
+/* out -- void                                         */
+/*******************************************************/
+void destroyDecoder(struct Decoder* decoder)
+{
+  unsigned long i;
+
+  if(decoder == NULL)
+  {
+    return;
+  }
+  for(i = 0; decoder->slot != NULL && i < decoder->slots; i++)
+  {
+    free(decoder->slot[i].input);
+    free(decoder->slot[i].output);
+  }
+  free(decoder->slot);
+  destroyPool(decoder->pool);
+  free(decoder);
+}
+
+/*******************************************************/
+/* Decodes the blocks of a file in the current format, */
+/* each read whole into memory with its length table,  */
+/* until the end block. The block headers give the     */
+/* size of every block, so a batch of blocks is read   */
+/* without decoding anything, the batch is decoded in  */
+/* parallel, and the blocks are written in order.      */
+/* The end block carries the total decoded size, which */
+/* must match what was written. The stats of every     */
+/* block are added to those of the input, if it has    */
+/* any.                                                */
+/* decoder -- threads and slots to decode with         */
+/* in -- input positioned after the magic and version  */
+/* out -- output the decoded bytes are written to      */
+/* return -- 0, or -1 if the file is damaged           */
+/*******************************************************/
+static int decodeBlocks(struct Decoder* decoder, struct Input* in,
+                        struct Output* out)
+{
+  struct DecodeSlot* slot = decoder->slot;
+  struct DecodeBatch batch;
+  unsigned long filled, i;
+  uint64_t written = 0, totalSize = 0;
+  int status = 1;
+  double start;
+
+  batch.slot = slot;
+  batch.stats = in->stats;
+
+  while(status == 1)
+  {
+    for(filled = 0; filled < decoder->slots; filled++)
+    {
+      status = readBlock(in, &slot[filled], &totalSize);
+      if(status != 1)
+      {
+        break;
+      }
+    }
+
+    STATS_START(in->stats, start);
+    runJobs(decoder->pool, filled, decodeJob, &batch);
+    STATS_TIME(in->stats, blockSeconds, start);
+
+    for(i = 0; i < filled; i++)
+    {
+      if(slot[i].status != 0)
+      {
+        status = -1;
+        break;
+      }
+      if(in->stats != NULL)
+      {
+        addStats(in->stats, &slot[i].stats);
+      }
+      writeBytes(out, slot[i].type == BLOCK_RAW ? slot[i].body
+                                                : slot[i].output,
+                 slot[i].rawSize);
+      written += slot[i].rawSize;
+    }
+  }
+  if(status == 0 && totalSize != written)
+  {
+    status = -1;
+  }
+  return status;
+}
+
+/*******************************************************/
+/* Decodes the rest of an adaptive file, as much of it */
+/* at a time as has arrived. What input that is not    */
+/* mapped decodes to is flushed at once, so a decoder  */
+/* at the end of a pipe keeps up with the encoder.     */
+/* in -- input, just past the magic and version        */
+/* out -- output                                       */
+/* return -- 0, or -1 if the file is damaged or memory */
+/*           ran out                                   */
+/*******************************************************/
+static int decodeAdaptiveFile(struct Input* in, struct Output* out)
+{
+  struct AdaptiveDecoder* decoder = malloc(sizeof(struct AdaptiveDecoder));
+  unsigned char* input = malloc(IO_BUFFER_SIZE);
+  unsigned char* output = malloc(8 * IO_BUFFER_SIZE);
+  unsigned long got, decoded;
+  int status = -1;
+  double start;
+
+  if(decoder != NULL && input != NULL && output != NULL)
+  {
+    initAdaptiveDecoder(decoder);
+    status = 0;
+  }
+  while(status == 0 && (got = readSome(in, input, IO_BUFFER_SIZE)) > 0)
+  {
+    STATS_START(in->stats, start);
+    status = decodeAdaptive(decoder, input, got, output, &decoded);
+    STATS_TIME(in->stats, bitsSeconds, start);
+    STATS_ADD(in->stats, symbols, decoded);
+    writeBytes(out, output, decoded);
+    if(in->map == NULL)
+    {
+      flushOutput(out);
+    }
+  }
+  if(status == 0 && decoder->state != ADAPTIVE_DONE)
+  {
+    status = -1;
+  }
+  free(decoder);
+  free(input);
+  free(output);
+  return status;
+}
+
+/*******************************************************/
+/* Decodes a file encoded with the Huffman algorithm.  */
+/* Files in the current format are decoded block by    */
+/* block and adaptive files as they arrive. For legacy */
+/* files it reads characters and their frequencies,    */
+/* creates a Huffman tree from them, and fills the     */
+/* decode table from the tree. It then reads the rest  */
+/* of the file in large chunks and decodes each code   */
+/* with a single table lookup, writing the decoded     */
+/* characters to the output file in large chunks.      */
+/* decoder -- threads and slots to decode with         */
+/* in -- input to decode                               */
+/* out -- output the decoded bytes are written to      */
+/* return -- 0, or -1 if the file is damaged or memory */
+/*           ran out                                   */
+/******************************************************/
+int decodeWith(struct Decoder* decoder, struct Input* in, struct Output* out)
+{
+  struct Header header;
+  struct DecodeTable table;
+  unsigned char* input;
+  unsigned char* output;
+  unsigned long totalChar, byteCounter, bitPos, decoded, want, limit;
+  unsigned long filled, keep, firstBit;
+  int endOfFile;
+  double start;
+
+  if(readHeader(in, &header) != 0)
+  {
+    return -1;
+  }
+  if(header.version == FORMAT_VERSION)
+  {
+    return decodeBlocks(decoder, in, out);
+  }
+  if(header.version == ADAPTIVE_VERSION)
+  {
+    return decodeAdaptiveFile(in, out);
+  }
+  buildDecodeTable(header.tree, &table);
+  totalChar = header.totalChar;
+
+  input = malloc(IO_BUFFER_SIZE + DECODE_PAD);
+  output = malloc(IO_BUFFER_SIZE);
+  if(input == NULL || output == NULL)
+  {
+    free(input);
+    free(output);
+    freeTree(header.tree);
+    return -1;
+  }
+
+  if(header.tree != NULL && header.tree->nodes[ROOT].left == 0)
+  {
+    /* a legacy tree that is a single leaf gave its symbol */
+    /* no code, so the file is just that symbol repeated   */
+    memset(output, header.tree->nodes[ROOT].symbol, IO_BUFFER_SIZE);
+    for(byteCounter = 0; byteCounter < totalChar; byteCounter += want)
+    {
+      want = totalChar - byteCounter;
+      if(want > IO_BUFFER_SIZE)
+      {
+        want = IO_BUFFER_SIZE;
+      }
+      writeBytes(out, output, want);
+    }
+    free(input);
+    free(output);
+    freeTree(header.tree);
+    return 0;
+  }
+
+  filled = readBytes(in, input, IO_BUFFER_SIZE);
+  endOfFile = filled < IO_BUFFER_SIZE;
+  byteCounter = 0;
+  bitPos = 0;
+
+  while(byteCounter < totalChar)
+  {
+    memset(input + filled, 0, DECODE_PAD);
+    want = totalChar - byteCounter;
+    if(want > IO_BUFFER_SIZE)
+    {
+      want = IO_BUFFER_SIZE;
+    }
+    limit = endOfFile ? filled : filled - DECODE_MARGIN;
+    firstBit = bitPos;
+    STATS_START(in->stats, start);
+    decoded = decodeTable(&table, input, limit, &bitPos, output, want);
+    STATS_TIME(in->stats, bitsSeconds, start);
+    STATS_ADD(in->stats, symbols, decoded);
+    STATS_ADD(in->stats, bits, bitPos - firstBit);
+    writeBytes(out, output, decoded);
+    byteCounter += decoded;
+
+    if(decoded < want)
+    {
+      if(endOfFile || (bitPos >> 3) < limit)
+      {
+        /* ran out of input before totalChar symbols, */
+        /* or hit bits that are not a code            */
+        break;
+      }
+      /* move the unread tail to the front and read the next chunk */
+      keep = filled - (bitPos >> 3);
+      memmove(input, input + (bitPos >> 3), keep);
+      bitPos &= 7;
+      filled = keep + readBytes(in, input + keep, IO_BUFFER_SIZE - keep);
+      endOfFile = filled < IO_BUFFER_SIZE;
+    }
+  }
+  free(input);
+  free(output);
+  freeTree(header.tree);
+  return byteCounter == totalChar ? 0 : -1;
+}
+
+/*******************************************************/
+/* Decodes a file with a decoder made for it alone.    */
+/* in -- input to decode                               */
+/* out -- output the decoded bytes are written to      */
+/* threads -- blocks decoded at the same time          */
+/* return -- 0, or -1 if the file is damaged or memory */
+/*           ran out                                   */
+/*******************************************************/
+int decodeFile(struct Input* in, struct Output* out, int threads)
+{
+  struct Decoder* decoder = createDecoder(threads);
+  int status;
+
+  if(decoder == NULL)
+  {
+    return -1;
+  }
+  status = decodeWith(decoder, in, out);
+  destroyDecoder(decoder);
+  return status;
+}
+
+/*******************************************************/
+/* Decodes part of a file in one of the block formats. */
+/* The file is mapped, or read whole when it is not a  */
+/* regular file, and only the blocks that hold the     */
+/* range are decoded, RANGE_CHUNK_SIZE bytes at a      */
+/* time, each chunk finding its first block anew.      */
+/* in -- input positioned at the start of the file     */
+/* out -- output the decoded bytes are written to      */
+/* start -- first decoded byte wanted                  */
+/* length -- number of bytes wanted                    */
+/* return -- 0, or -1 if the file is damaged, not in a */
+/*           block format, or memory ran out           */
+/*******************************************************/
+int decodeRangeFile(struct Input* in, struct Output* out, uint64_t start,
+                    uint64_t length)
+{
+  const unsigned char* file;
+  unsigned char* buffer;
+  unsigned char* chunk;
+  unsigned char* scratch = NULL;
+  unsigned long size, want, got, scratchSize = 0;
+  int status = -1;
+
+  file = viewAll(in, &buffer, &size);
+  chunk = file == NULL ? NULL : malloc(RANGE_CHUNK_SIZE);
+  if(chunk != NULL)
+  {
+    do
+    {
+      want = length < RANGE_CHUNK_SIZE ? (unsigned long)length
+                                       : RANGE_CHUNK_SIZE;
+      status = decodeRange(file, size, start, want, chunk, &got, &scratch,
+                           &scratchSize);
+      writeBytes(out, chunk, got);
+      start += got;
+      length -= got;
+    } while(status == 0 && got == want && length > 0);
+  }
+  free(scratch);
+  free(chunk);
+  free(buffer);
+  return status;
+}
+
+/*******************************************************/
+/* Adds the symbol counts of the rest of an input to   */
+/* frequency, one block of DEFAULT_BLOCK_SIZE bytes at */
+/* a time.                                             */
+/* in -- input                                         */
+/* frequency -- counts to add to                       */
+/* return -- 0, or -1 if memory ran out                */
+/*******************************************************/
+int countFile(struct Input* in, unsigned long frequency[NUM_CHAR])
+{
+  unsigned long counted[NUM_CHAR];
+  unsigned char* buffer = allocateBuffer(DEFAULT_BLOCK_SIZE);
+  const unsigned char* block;
+  unsigned long got;
+  int i;
+
+  if(buffer == NULL)
+  {
+    return -1;
+  }
+  do
+  {
+    block = viewBytes(in, buffer, DEFAULT_BLOCK_SIZE, 0, &got);
+    countSymbols(block, got, counted);
+    for(i = 0; i < NUM_CHAR; i++)
+    {
+      frequency[i] += counted[i];
+    }
+  } while(got == DEFAULT_BLOCK_SIZE);
+  free(buffer);
+  return 0;
+}
+
+/*******************************************************/
+/* Reads a trained table file.                         */
+/* in -- input holding the table                       */
+/* table -- table to fill                              */
+/* return -- 0, or -1 if it is not a valid table       */
+/*******************************************************/
+int loadStaticTable(struct Input* in, struct StaticTable* table)
+{
+  unsigned char bytes[TABLE_MAX_SIZE];
+  unsigned long size = readBytes(in, bytes, TABLE_MAX_SIZE);
+
+  return readStaticTable(bytes, size, table);
+}
+
+/*******************************************************/
+/* Encodes the whole of an input as one message with a */
+/* trained table: the table id, the size, the codes.   */
+/* in -- input                                         */
+/* out -- output                                       */
+/* table -- the trained table                          */
+/* return -- 0, or -1 if memory ran out                */
+/*******************************************************/
+int encodeMessageFile(struct Input* in, struct Output* out,
+                      const struct StaticTable* table)
+{
+  const unsigned char* message;
+  unsigned char* buffer;
+  unsigned char* encoded;
+  unsigned long size;
+
+  message = viewAll(in, &buffer, &size);
+  encoded = message == NULL ? NULL : malloc(messageBound(size));
+  if(encoded != NULL)
+  {
+    writeBytes(out, encoded, encodeMessage(table, message, size, encoded));
+  }
+  free(encoded);
+  free(buffer);
+  return encoded == NULL ? -1 : 0;
+}
+
+/*******************************************************/
+/* Encodes an input in one pass with an adaptive tree: */
+/* the magic and ADAPTIVE_VERSION, then the codes of   */
+/* each chunk as it is read. Input that is not mapped  */
+/* is read as it arrives, and each chunk ends with a   */
+/* flush escape and goes out at once, so nothing waits */
+/* for the rest of the input. The end escape and the   */
+/* number of bytes encoded close the file.             */
+/* in -- input                                         */
+/* out -- output                                       */
+/* return -- 0, or -1 if memory ran out or a write     */
+/*           failed                                    */
+/*******************************************************/
+int encodeAdaptiveFile(struct Input* in, struct Output* out)
+{
+  struct AdaptiveTree* tree = malloc(sizeof(struct AdaptiveTree));
+  unsigned char* input = malloc(IO_BUFFER_SIZE);
+  unsigned char* output = malloc(adaptiveBound(IO_BUFFER_SIZE)
+                                 + END_BODY_SIZE);
+  struct BitWriter writer;
+  uint64_t total = 0;
+  unsigned long got;
+  int status = -1;
+  double start;
+
+  if(tree != NULL && input != NULL && output != NULL)
+  {
+    initAdaptiveTree(tree);
+    output[0] = MAGIC_0;
+    output[1] = MAGIC_1;
+    output[2] = MAGIC_2;
+    output[3] = ADAPTIVE_VERSION;
+    writer.next = output + 4;
+    writer.bits = 0;
+    writer.count = 0;
+    status = 0;
+  }
+  while(status == 0 && (got = readSome(in, input, IO_BUFFER_SIZE)) > 0)
+  {
+    STATS_START(in->stats, start);
+    encodeAdaptive(tree, input, got, &writer);
+    if(in->map == NULL)
+    {
+      endAdaptive(tree, ADAPTIVE_FLUSH, &writer);
+    }
+    STATS_TIME(in->stats, bitsSeconds, start);
+    STATS_ADD(in->stats, symbols, got);
+    total += got;
+
+    /* pending bits stay in the writer for the next chunk */
+    writeBytes(out, output, (unsigned long)(writer.next - output));
+    writer.next = output;
+    if(in->map == NULL)
+    {
+      status = flushOutput(out);
+    }
+  }
+  if(status == 0)
+  {
+    endAdaptive(tree, ADAPTIVE_END, &writer);
+    storeLE64(writer.next, total);
+    writeBytes(out, output, (unsigned long)(writer.next - output)
+                            + END_BODY_SIZE);
+    status = out->failed ? -1 : 0;
+  }
+  free(tree);
+  free(input);
+  free(output);
+  return status;
+}
+
+/*******************************************************/
+/* Decodes a message encoded with a trained table. The */
+/* size in front of the codes says how much room the   */
+/* decoded message needs.                              */
+/* in -- input holding the message                     */
+/* out -- output                                       */
+/* table -- the trained table                          */
+/* return -- 0, or -1 if the message is damaged, was   */
+/*           coded with another table, or memory ran   */
+/*           out                                       */
+/*******************************************************/
+int decodeMessageFile(struct Input* in, struct Output* out,
+                      const struct StaticTable* table)
+{
+  const unsigned char* message;
+  unsigned char* buffer;
+  unsigned char* decoded = NULL;
+  unsigned long size, rawSize = 0;
+  int status = -1;
+
+  message = viewAll(in, &buffer, &size);
+  /* a first pass with no room only reads the size; it */
+  /* fails without a size if the message is damaged    */
+  if(message != NULL
+     && (decodeMessage(table, message, size, NULL, 0, &rawSize) == 0
+         || rawSize > 0))
+  {
+    decoded = malloc(rawSize > 0 ? rawSize : 1);
+  }
+  if(decoded != NULL)
+  {
+    status = decodeMessage(table, message, size, decoded, rawSize, &rawSize);
+    if(status == 0)
+    {
+      writeBytes(out, decoded, rawSize);
+    }
+  }
+  free(decoded);
+  free(buffer);
+  return status;
+}
@@ -0,0 +1,240 @@
+/*************************************/
+/* This file defines random access:  */
+/* finding the block that holds a    */
+/* given decoded byte, from the      */
+/* index at the end of the file or   */
+/* from the block headers, and       */
+/* decoding only the blocks a range  */
+/* of bytes needs.                   */
+/*************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "huffman.h"
+
+#define TRUE 1
+#define FALSE 0
+
+/* bytes of magic and version in front of the blocks */
+#define MAGIC_SIZE 4
+
+/*********************************************************/
+/* Finds the index block of a file from its end block.   */
+/* in -- the whole file and its size, pointer that       */
+/*       receives the number of entries                  */
+/* out -- the first entry, NULL if the file has no index */
+/*        or it is damaged                               */
+/*********************************************************/
+static const unsigned char* findIndex(const unsigned char* src,
+                                      unsigned long size,
+                                      unsigned long* entries)
+{
+  const unsigned char* end;
+  unsigned long indexSize, rawSize, compSize;
+  int type;
+
+  if(size < MAGIC_SIZE + END_BLOCK_SIZE || src[3] != FORMAT_VERSION)
+  {
+    return NULL;
+  }
+  end = src + size - END_BLOCK_SIZE;
+  readBlockHeader(end, &type, &indexSize, &compSize);
+  if(type != BLOCK_END || compSize != END_BODY_SIZE || indexSize == 0
+     || indexSize > size - MAGIC_SIZE - END_BLOCK_SIZE)
+  {
+    return NULL;
+  }
+  readBlockHeader(end - indexSize, &type, &rawSize, &compSize);
+  if(type != BLOCK_INDEX || rawSize != 0
+     || compSize != indexSize - BLOCK_HEADER_SIZE
+     || compSize % INDEX_ENTRY_SIZE != 0)
+  {
+    return NULL;
+  }
+  *entries = compSize / INDEX_ENTRY_SIZE;
+  return end - compSize;
+}
+
+/*********************************************************/
+/* Finds the block that holds a decoded byte. With an    */
+/* index that is a binary search for the last block      */
+/* that starts at or before the byte; without one, the   */
+/* headers are read one after another, skipping the      */
+/* bodies.                                               */
+/* in -- the whole file and its size, the decoded byte,  */
+/*       pointers that receive the offset of the block   */
+/*       header and the decoded bytes before the block   */
+/* out -- 0, or -1 if the file is damaged                */
+/*********************************************************/
+static int findBlock(const unsigned char* src, unsigned long size,
+                     uint64_t start, unsigned long* pos,
+                     uint64_t* blockStart)
+{
+  const unsigned char* index;
+  unsigned long entries, low, high, middle, rawSize, compSize;
+  uint64_t offset;
+  int type;
+
+  *pos = MAGIC_SIZE;
+  *blockStart = 0;
+  index = findIndex(src, size, &entries);
+  if(index != NULL)
+  {
+    /* the last entry whose block starts at or before start */
+    low = 0;
+    high = entries;
+    while(low < high)
+    {
+      middle = low + (high - low) / 2;
+      if(loadLE64(index + middle * INDEX_ENTRY_SIZE) <= start)
+      {
+        low = middle + 1;
+      }
+      else
+      {
+        high = middle;
+      }
+    }
+    if(low > 0)
+    {
+      offset = loadLE64(index + (low - 1) * INDEX_ENTRY_SIZE + 8);
+      if(offset < MAGIC_SIZE || offset >= size)
+      {
+        return -1;
+      }
+      *pos = (unsigned long)offset;
+      *blockStart = loadLE64(index + (low - 1) * INDEX_ENTRY_SIZE);
+    }
+    return 0;
+  }
+
+  for(;;)
+  {
+    if(size - *pos < BLOCK_HEADER_SIZE)
+    {
+      return -1;
+    }
+    readBlockHeader(src + *pos, &type, &rawSize, &compSize);
+    if(type == BLOCK_INDEX)
+    {
+      rawSize = 0;
+    }
+    if(type == BLOCK_END || *blockStart + rawSize > start)
+    {
+      return 0;
+    }
+    if(compSize > size - *pos - BLOCK_HEADER_SIZE)
+    {
+      return -1;
+    }
+    *pos += BLOCK_HEADER_SIZE + compSize;
+    *blockStart += rawSize;
+  }
+}
+
+/*********************************************************/
+/* Decodes a range of bytes of a file in memory. Blocks  */
+/* wanted whole are decoded straight into dst; the first */
+/* and last block, when only part of them is wanted, are */
+/* decoded into the scratch buffer and the part copied,  */
+/* except raw blocks, whose part is copied from the      */
+/* file. The end block that follows every block body     */
+/* leaves the DECODE_PAD readable bytes the decoder      */
+/* needs.                                                */
+/* in -- the whole file and its size, first byte and     */
+/*       number of bytes wanted, where to write them,    */
+/*       where to store the number written, scratch      */
+/*       buffer and its size                             */
+/* out -- 0, or -1 if the file is damaged, not in a      */
+/*        block format, or memory ran out                */
+/*********************************************************/
+int decodeRange(const unsigned char* src, unsigned long size, uint64_t start,
+                unsigned long length, unsigned char* dst,
+                unsigned long* written, unsigned char** scratch,
+                unsigned long* scratchSize)
+{
+  unsigned long pos, rawSize, compSize, from, n;
+  uint64_t blockStart;
+  unsigned char* grown;
+  int type;
+
+  *written = 0;
+  if(size < MAGIC_SIZE || src[0] != MAGIC_0 || src[1] != MAGIC_1
+     || src[2] != MAGIC_2 || src[3] != FORMAT_VERSION)
+  {
+    return -1;
+  }
+  if(findBlock(src, size, start, &pos, &blockStart) != 0)
+  {
+    return -1;
+  }
+
+  while(*written < length)
+  {
+    if(size - pos < BLOCK_HEADER_SIZE)
+    {
+      return -1;
+    }
+    readBlockHeader(src + pos, &type, &rawSize, &compSize);
+    pos += BLOCK_HEADER_SIZE;
+    if(type == BLOCK_END)
+    {
+      break;
+    }
+    if(rawSize > MAX_BLOCK_SIZE || compSize > size - pos
+       || size - pos - compSize < DECODE_PAD)
+    {
+      return -1;
+    }
+    if(type != BLOCK_INDEX && blockStart + rawSize > start + *written)
+    {
+      /* only the first block can start before the range */
+      from = (unsigned long)(start + *written - blockStart);
+      n = rawSize - from < length - *written ? rawSize - from
+                                             : length - *written;
+      if(n == rawSize)
+      {
+        if(decodeBlock(type, src + pos, compSize, dst + *written, rawSize,
+                       NULL) != 0)
+        {
+          return -1;
+        }
+      }
+      else if(type == BLOCK_RAW)
+      {
+        if(compSize != rawSize)
+        {
+          return -1;
+        }
+        memcpy(dst + *written, src + pos + from, n);
+      }
+      else
+      {
+        if(rawSize > *scratchSize)
+        {
+          grown = realloc(*scratch, rawSize);
+          if(grown == NULL)
+          {
+            return -1;
+          }
+          *scratch = grown;
+          *scratchSize = rawSize;
+        }
+        if(decodeBlock(type, src + pos, compSize, *scratch, rawSize,
+                       NULL) != 0)
+        {
+          return -1;
+        }
+        memcpy(dst + *written, *scratch + from, n);
+      }
+      *written += n;
+    }
+    pos += compSize;
+    if(type != BLOCK_INDEX)
+    {
+      blockStart += rawSize;
+    }
+  }
+  return 0;
+}
@@ -0,0 +1,911 @@
+/*************************************/
+/* This file defines the input and   */
+/* output layer of the encoder and   */
+/* decoder. Regular input files are  */
+/* mapped into memory and handed out */
+/* without copying, with the kernel  */
+/* asked to read ahead; pipes are    */
+/* read by a thread of their own a   */
+/* few chunks ahead. Output goes out */
+/* in large writes, by a thread that */
+/* writes one buffer while the coder */
+/* fills the next, so reading,       */
+/* coding and writing overlap.       */
+/*************************************/
+
+#define _POSIX_C_SOURCE 200112L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <pthread.h>
+#include "huffman.h"
+
+#define TRUE 1
+#define FALSE 0
+
+/* alignment of the buffers from allocateBuffer */
+#define BUFFER_ALIGNMENT 4096
+
+/* bytes of a mapped input the kernel is asked to read */
+/* ahead of the caller                                 */
+#define PREFETCH_SIZE (8 * 1024 * 1024)
+
+/* chunks a reader thread reads ahead, and their size */
+#define READ_CHUNKS 4
+#define READ_CHUNK_SIZE OUTPUT_BUFFER_SIZE
+
+/********************************************************/
+/* A thread reading a file a chunk ahead of its owner.  */
+/* The chunks form a ring: count of them from first on  */
+/* hold data, each filled by one read, and the owner    */
+/* has used the first used bytes of the first one.      */
+/* filled is signalled when a chunk is read or the end  */
+/* reached, emptied when the owner is done with one or  */
+/* asks the thread to stop.                             */
+/********************************************************/
+struct Reader
+{
+  pthread_t thread;
+  pthread_mutex_t lock;
+  pthread_cond_t filled;
+  pthread_cond_t emptied;
+  int fd;
+  unsigned char* chunk[READ_CHUNKS];
+  unsigned long size[READ_CHUNKS];
+  int first;
+  int count;
+  unsigned long used;
+  int end;
+  int stop;
+};
+
+/********************************************************/
+/* A thread writing the full buffer of an output while  */
+/* its owner fills the other one. busy is TRUE while    */
+/* spare holds size bytes still to be written to fd;    */
+/* ready is signalled when it is handed a buffer or     */
+/* asked to stop, done when it has written one.         */
+/********************************************************/
+struct Writer
+{
+  pthread_t thread;
+  pthread_mutex_t lock;
+  pthread_cond_t ready;
+  pthread_cond_t done;
+  int fd;
+  unsigned char* spare;
+  unsigned long size;
+  int busy;
+  int failed;
+  int stop;
+};
+
+/********************************************************/
+/* Allocates a buffer aligned to a page, so that reads  */
+/* into it can be done without extra copies.            */
+/* in -- number of bytes                                */
+/* out -- the buffer, freed with free, NULL on failure  */
+/********************************************************/
+unsigned char* allocateBuffer(unsigned long size)
+{
+  void* buffer;
+
+  if(posix_memalign(&buffer, BUFFER_ALIGNMENT, size > 0 ? size : 1) != 0)
+  {
+    return NULL;
+  }
+  return buffer;
+}
+
+/********************************************************/
+/* Reads once from a file, again if interrupted.        */
+/* in -- file descriptor, buffer, most bytes wanted     */
+/* out -- number of bytes read, 0 at the end of the     */
+/*        file or on an error                           */
+/********************************************************/
+static unsigned long readOnce(int fd, unsigned char* buffer,
+                              unsigned long want)
+{
+  ssize_t n;
+
+  do
+  {
+    n = read(fd, buffer, want);
+  }
+  while(n < 0 && errno == EINTR);
+  return n < 0 ? 0 : (unsigned long)n;
+}
+
+/********************************************************/
+/* Body of a reader thread: reads into the free chunks  */
+/* until the end of the file or until it is stopped.    */
+/* It can only be cancelled while it waits in read, for */
+/* input its owner will never ask for.                  */
+/* in -- struct Reader                                  */
+/* out -- NULL                                          */
+/********************************************************/
+static void* readerMain(void* context)
+{
+  struct Reader* reader = context;
+  unsigned long n;
+  int slot, old;
+
+  pthread_setcancelstate(PTHREAD_CANCEL_DISABLE, &old);
+  pthread_mutex_lock(&reader->lock);
+  while(!reader->stop && !reader->end)
+  {
+    if(reader->count == READ_CHUNKS)
+    {
+      pthread_cond_wait(&reader->emptied, &reader->lock);
+      continue;
+    }
+    slot = (reader->first + reader->count) % READ_CHUNKS;
+    pthread_mutex_unlock(&reader->lock);
+
+    pthread_setcancelstate(PTHREAD_CANCEL_ENABLE, &old);
+    n = readOnce(reader->fd, reader->chunk[slot], READ_CHUNK_SIZE);
+    pthread_setcancelstate(PTHREAD_CANCEL_DISABLE, &old);
+
+    pthread_mutex_lock(&reader->lock);
+    if(n == 0)
+    {
+      reader->end = TRUE;
+    }
+    else
+    {
+      reader->size[slot] = n;
+      reader->count++;
+    }
+    pthread_cond_signal(&reader->filled);
+  }
+  pthread_mutex_unlock(&reader->lock);
+  return NULL;
+}
+
+/********************************************************/
+/* Frees a reader whose thread has stopped, or was      */
+/* never started.                                       */
+/* in -- the reader                                     */
+/* out -- void                                          */
+/********************************************************/
+static void freeReader(struct Reader* reader)
+{
+  int i;
+
+  for(i = 0; i < READ_CHUNKS; i++)
+  {
+    free(reader->chunk[i]);
+  }
+  pthread_mutex_destroy(&reader->lock);
+  pthread_cond_destroy(&reader->filled);
+  pthread_cond_destroy(&reader->emptied);
+  free(reader);
+}
+
+/********************************************************/
+/* Starts a thread reading an input ahead of its owner. */
+/* Without memory or threads for it the input is read   */
+/* by its owner instead.                                */
+/* in -- the input, not mapped                          */
+/* out -- void                                          */
+/********************************************************/
+static void startReader(struct Input* input)
+{
+  struct Reader* reader = calloc(1, sizeof(struct Reader));
+  int i, status = 0;
+
+  if(reader == NULL)
+  {
+    return;
+  }
+  reader->fd = input->fd;
+  pthread_mutex_init(&reader->lock, NULL);
+  pthread_cond_init(&reader->filled, NULL);
+  pthread_cond_init(&reader->emptied, NULL);
+  for(i = 0; i < READ_CHUNKS; i++)
+  {
+    reader->chunk[i] = allocateBuffer(READ_CHUNK_SIZE);
+    if(reader->chunk[i] == NULL)
+    {
+      status = -1;
+    }
+  }
+  if(status != 0
+     || pthread_create(&reader->thread, NULL, readerMain, reader) != 0)
+  {
+    freeReader(reader);
+    return;
+  }
+  input->reader = reader;
+}
+
+/********************************************************/
+/* Copies bytes out of the chunks of a reader, waiting  */
+/* for the thread to read more when there are none.     */
+/* in -- input with a reader, buffer, most bytes        */
+/*       wanted, TRUE to wait until they have all been  */
+/*       read or FALSE to stop at the first wait once   */
+/*       there are some                                 */
+/* out -- number of bytes copied, fewer than wanted     */
+/*        only at the end of the file, on a read error  */
+/*        or when not waiting                           */
+/********************************************************/
+static unsigned long takeChunks(struct Input* input, unsigned char* buffer,
+                                unsigned long want, int all)
+{
+  struct Reader* reader = input->reader;
+  const unsigned char* chunk;
+  unsigned long got = 0, n;
+  double start;
+
+  STATS_START(input->stats, start);
+  pthread_mutex_lock(&reader->lock);
+  while(got < want)
+  {
+    if(reader->count == 0)
+    {
+      if(reader->end || (!all && got > 0))
+      {
+        break;
+      }
+      pthread_cond_wait(&reader->filled, &reader->lock);
+      continue;
+    }
+
+    /* the thread never reads into the first chunk while it */
+    /* holds data, so it is copied without the lock         */
+    chunk = reader->chunk[reader->first] + reader->used;
+    n = reader->size[reader->first] - reader->used;
+    n = n < want - got ? n : want - got;
+    pthread_mutex_unlock(&reader->lock);
+    memcpy(buffer + got, chunk, n);
+    got += n;
+    pthread_mutex_lock(&reader->lock);
+
+    reader->used += n;
+    if(reader->used == reader->size[reader->first])
+    {
+      reader->first = (reader->first + 1) % READ_CHUNKS;
+      reader->count--;
+      reader->used = 0;
+      STATS_ADD(input->stats, reads, 1);
+      pthread_cond_signal(&reader->emptied);
+    }
+  }
+  pthread_mutex_unlock(&reader->lock);
+  STATS_ADD(input->stats, bytesRead, got);
+  STATS_TIME(input->stats, readSeconds, start);
+  return got;
+}
+
+/********************************************************/
+/* Asks the kernel to start reading the next            */
+/* PREFETCH_SIZE bytes of a mapped input, once the      */
+/* caller is within half of that of where it last       */
+/* asked, so that the pages are in before they are      */
+/* touched.                                             */
+/* in -- the mapped input                               */
+/* out -- void                                          */
+/********************************************************/
+static void prefetchInput(struct Input* input)
+{
+  unsigned long page = (unsigned long)sysconf(_SC_PAGESIZE);
+  unsigned long skip = (unsigned long)(input->map
+                                       - (const unsigned char*)input->base);
+  unsigned long from, to;
+
+  if(input->prefetched >= input->size
+     || input->offset + PREFETCH_SIZE / 2 < input->prefetched)
+  {
+    return;
+  }
+  to = input->size - input->offset < PREFETCH_SIZE
+       ? input->size : input->offset + PREFETCH_SIZE;
+  from = skip + input->prefetched;
+  from -= from % page;
+  posix_madvise((char*)input->base + from, (size_t)(skip + to - from),
+                POSIX_MADV_WILLNEED);
+  input->prefetched = to;
+}
+
+/********************************************************/
+/* Sets up reading from an open file. A regular file is */
+/* mapped from its current position to its end; other   */
+/* files, or files that cannot be mapped, are read by a */
+/* thread of their own, which may read past what the    */
+/* caller takes.                                        */
+/* in -- input to set up, open file                     */
+/* out -- void                                          */
+/********************************************************/
+void openInput(struct Input* input, FILE* file)
+{
+  struct stat status;
+  off_t start;
+  void* map;
+
+  input->fd = fileno(file);
+  input->base = NULL;
+  input->mapSize = 0;
+  input->map = NULL;
+  input->size = 0;
+  input->offset = 0;
+  input->prefetched = 0;
+  input->reader = NULL;
+  input->stats = NULL;
+
+  start = lseek(input->fd, 0, SEEK_CUR);
+  if(start < 0 || fstat(input->fd, &status) != 0
+     || !S_ISREG(status.st_mode))
+  {
+    startReader(input);
+    return;
+  }
+  if(status.st_size <= start)
+  {
+    return;
+  }
+  map = mmap(NULL, (size_t)status.st_size, PROT_READ, MAP_PRIVATE,
+             input->fd, 0);
+  if(map == MAP_FAILED)
+  {
+    startReader(input);
+    return;
+  }
+  posix_madvise(map, (size_t)status.st_size, POSIX_MADV_SEQUENTIAL);
+  input->base = map;
+  input->mapSize = (unsigned long)status.st_size;
+  input->map = (const unsigned char*)map + start;
+  input->size = (unsigned long)(status.st_size - start);
+  prefetchInput(input);
+}
+
+/********************************************************/
+/* Copies the next bytes of an input into a buffer,     */
+/* from its reader if it has one, or else reading as    */
+/* often as needed to fill it, timing and counting the  */
+/* reads when the input has stats.                      */
+/* in -- input, buffer, number of bytes wanted          */
+/* out -- number of bytes copied, fewer only at the end */
+/*        of the input or on a read error               */
+/********************************************************/
+unsigned long readBytes(struct Input* input, unsigned char* buffer,
+                        unsigned long want)
+{
+  unsigned long got = 0;
+  ssize_t n;
+  double start;
+
+  if(input->map != NULL)
+  {
+    got = input->size - input->offset < want
+          ? input->size - input->offset : want;
+    memcpy(buffer, input->map + input->offset, got);
+    input->offset += got;
+    STATS_ADD(input->stats, bytesMapped, got);
+    prefetchInput(input);
+    return got;
+  }
+  if(input->reader != NULL)
+  {
+    return takeChunks(input, buffer, want, TRUE);
+  }
+
+  STATS_START(input->stats, start);
+  while(got < want)
+  {
+    n = read(input->fd, buffer + got, want - got);
+    STATS_ADD(input->stats, reads, 1);
+    if(n < 0 && errno == EINTR)
+    {
+      continue;
+    }
+    if(n <= 0)
+    {
+      break;
+    }
+    got += (unsigned long)n;
+  }
+  STATS_ADD(input->stats, bytesRead, got);
+  STATS_TIME(input->stats, readSeconds, start);
+  return got;
+}
+
+/********************************************************/
+/* Copies the bytes of an input that have arrived into  */
+/* a buffer. A mapped input has all of them; any other  */
+/* hands over what its reader has read, or is read      */
+/* once, so a pipe hands over what its writer has       */
+/* written so far instead of waiting for more.          */
+/* in -- input, buffer, most bytes wanted               */
+/* out -- number of bytes copied, 0 only at the end of  */
+/*        the input or on a read error                  */
+/********************************************************/
+unsigned long readSome(struct Input* input, unsigned char* buffer,
+                       unsigned long want)
+{
+  unsigned long got;
+  double start;
+
+  if(input->map != NULL)
+  {
+    return readBytes(input, buffer, want);
+  }
+  if(input->reader != NULL)
+  {
+    return takeChunks(input, buffer, want, FALSE);
+  }
+
+  STATS_START(input->stats, start);
+  got = readOnce(input->fd, buffer, want);
+  STATS_ADD(input->stats, reads, 1);
+  STATS_ADD(input->stats, bytesRead, got);
+  STATS_TIME(input->stats, readSeconds, start);
+  return got;
+}
+
+/********************************************************/
+/* Gives access to the next bytes of an input, followed */
+/* by pad readable bytes. A mapped input hands out its  */
+/* own memory; otherwise, or when the pad would run     */
+/* past the end of the mapping, the bytes are read into */
+/* the buffer and the pad is zeroed. Buffers that are   */
+/* never used are never touched, so they cost no        */
+/* memory beyond their address space.                   */
+/* in -- input, buffer of want + pad bytes, number of   */
+/*       bytes wanted, pad, where to store the number   */
+/*       of bytes available                             */
+/* out -- pointer to the bytes                          */
+/********************************************************/
+const unsigned char* viewBytes(struct Input* input, unsigned char* buffer,
+                               unsigned long want, unsigned long pad,
+                               unsigned long* got)
+{
+  const unsigned char* view;
+  unsigned long left = input->size - input->offset;
+
+  if(input->map != NULL && (want < left ? want : left) + pad <= left)
+  {
+    view = input->map + input->offset;
+    *got = want < left ? want : left;
+    input->offset += *got;
+    STATS_ADD(input->stats, bytesMapped, *got);
+    prefetchInput(input);
+    return view;
+  }
+  *got = readBytes(input, buffer, want);
+  memset(buffer + *got, 0, pad);
+  return buffer;
+}
+
+/********************************************************/
+/* Gives access to the rest of an input in one piece.   */
+/* A mapped input hands out its own memory; otherwise   */
+/* the input is read into a buffer that grows as it     */
+/* fills.                                               */
+/* in -- input, pointer that receives the buffer to     */
+/*       free (NULL when none was needed), where to     */
+/*       store the number of bytes                      */
+/* out -- pointer to the bytes, NULL if memory ran out  */
+/********************************************************/
+const unsigned char* viewAll(struct Input* input, unsigned char** buffer,
+                             unsigned long* size)
+{
+  unsigned long capacity = OUTPUT_BUFFER_SIZE, got;
+  unsigned char* grown;
+
+  *buffer = NULL;
+  *size = 0;
+  if(input->map != NULL)
+  {
+    *size = input->size - input->offset;
+    input->offset = input->size;
+    STATS_ADD(input->stats, bytesMapped, *size);
+    return input->map + input->size - *size;
+  }
+
+  *buffer = malloc(capacity);
+  while(*buffer != NULL)
+  {
+    got = readBytes(input, *buffer + *size, capacity - *size);
+    *size += got;
+    if(*size < capacity)
+    {
+      return *buffer;
+    }
+    capacity *= 2;
+    grown = realloc(*buffer, capacity);
+    if(grown == NULL)
+    {
+      free(*buffer);
+      *buffer = NULL;
+    }
+    else
+    {
+      *buffer = grown;
+    }
+  }
+  return NULL;
+}
+
+/********************************************************/
+/* Skips the next bytes of an input: a mapped input     */
+/* only moves its offset, any other is read and the     */
+/* bytes dropped.                                       */
+/* in -- input, number of bytes to skip                 */
+/* out -- number of bytes skipped                       */
+/********************************************************/
+unsigned long skipBytes(struct Input* input, unsigned long n)
+{
+  unsigned char buffer[4096];
+  unsigned long skipped = 0, want, got;
+
+  if(input->map != NULL)
+  {
+    skipped = input->size - input->offset < n ? input->size - input->offset
+                                              : n;
+    input->offset += skipped;
+    return skipped;
+  }
+  while(skipped < n)
+  {
+    want = n - skipped < sizeof(buffer) ? n - skipped : sizeof(buffer);
+    got = readBytes(input, buffer, want);
+    skipped += got;
+    if(got < want)
+    {
+      break;
+    }
+  }
+  return skipped;
+}
+
+/********************************************************/
+/* Releases the mapping of an input, or stops and frees */
+/* its reader, cancelling a read still waiting for      */
+/* input. The file itself is left open.                 */
+/* in -- the input                                      */
+/* out -- void                                          */
+/********************************************************/
+void closeInput(struct Input* input)
+{
+  struct Reader* reader = input->reader;
+
+  if(input->base != NULL)
+  {
+    munmap(input->base, (size_t)input->mapSize);
+    input->base = NULL;
+  }
+  input->map = NULL;
+  if(reader != NULL)
+  {
+    pthread_mutex_lock(&reader->lock);
+    reader->stop = TRUE;
+    pthread_cond_signal(&reader->emptied);
+    pthread_mutex_unlock(&reader->lock);
+    pthread_cancel(reader->thread);
+    pthread_join(reader->thread, NULL);
+    freeReader(reader);
+    input->reader = NULL;
+  }
+}
+
+/********************************************************/
+/* Writes bytes to a file descriptor, as many times as  */
+/* it takes.                                            */
+/* in -- file descriptor, bytes and their number        */
+/* out -- number of write calls, or -1 if one failed    */
+/********************************************************/
+static long writeFully(int fd, const unsigned char* data, unsigned long size)
+{
+  ssize_t n;
+  long writes = 0;
+
+  while(size > 0)
+  {
+    n = write(fd, data, size);
+    writes++;
+    if(n < 0 && errno == EINTR)
+    {
+      continue;
+    }
+    if(n <= 0)
+    {
+      return -1;
+    }
+    data += n;
+    size -= (unsigned long)n;
+  }
+  return writes;
+}
+
+/********************************************************/
+/* Body of a writer thread: writes each buffer it is    */
+/* handed until it is stopped.                          */
+/* in -- struct Writer                                  */
+/* out -- NULL                                          */
+/********************************************************/
+static void* writerMain(void* context)
+{
+  struct Writer* writer = context;
+  long status;
+
+  pthread_mutex_lock(&writer->lock);
+  for(;;)
+  {
+    while(!writer->busy && !writer->stop)
+    {
+      pthread_cond_wait(&writer->ready, &writer->lock);
+    }
+    if(!writer->busy)
+    {
+      break;
+    }
+    pthread_mutex_unlock(&writer->lock);
+    status = writer->failed ? -1
+             : writeFully(writer->fd, writer->spare, writer->size);
+    pthread_mutex_lock(&writer->lock);
+    if(status < 0)
+    {
+      writer->failed = TRUE;
+    }
+    writer->busy = FALSE;
+    pthread_cond_signal(&writer->done);
+  }
+  pthread_mutex_unlock(&writer->lock);
+  return NULL;
+}
+
+/********************************************************/
+/* Frees a writer whose thread has stopped, or was      */
+/* never started.                                       */
+/* in -- the writer                                     */
+/* out -- void                                          */
+/********************************************************/
+static void freeWriter(struct Writer* writer)
+{
+  free(writer->spare);
+  pthread_mutex_destroy(&writer->lock);
+  pthread_cond_destroy(&writer->ready);
+  pthread_cond_destroy(&writer->done);
+  free(writer);
+}
+
+/********************************************************/
+/* Starts a thread writing the buffers of an output.    */
+/* Without memory or threads for it the output is       */
+/* written by its owner instead.                        */
+/* in -- the output                                     */
+/* out -- void                                          */
+/********************************************************/
+static void startWriter(struct Output* output)
+{
+  struct Writer* writer = calloc(1, sizeof(struct Writer));
+
+  if(writer == NULL)
+  {
+    return;
+  }
+  pthread_mutex_init(&writer->lock, NULL);
+  pthread_cond_init(&writer->ready, NULL);
+  pthread_cond_init(&writer->done, NULL);
+  writer->spare = allocateBuffer(OUTPUT_BUFFER_SIZE);
+  if(writer->spare == NULL
+     || pthread_create(&writer->thread, NULL, writerMain, writer) != 0)
+  {
+    freeWriter(writer);
+    return;
+  }
+  output->writer = writer;
+}
+
+/********************************************************/
+/* Waits until the writer of an output has written the  */
+/* buffer it was handed, taking over its failure.       */
+/* Must be called with the lock of the writer held.     */
+/* in -- output with a writer                           */
+/* out -- void                                          */
+/********************************************************/
+static void waitWriter(struct Output* output)
+{
+  struct Writer* writer = output->writer;
+
+  while(writer->busy)
+  {
+    pthread_cond_wait(&writer->done, &writer->lock);
+  }
+  if(writer->failed)
+  {
+    output->failed = TRUE;
+  }
+}
+
+/********************************************************/
+/* Sets up writing to an open file. Anything the file   */
+/* has buffered is written first. A writer thread is    */
+/* started with a second buffer; without one the        */
+/* output is written by its owner.                      */
+/* in -- output to set up, open file, or NULL to give   */
+/*       it one later with switchOutput                 */
+/* out -- 0, or -1 if memory ran out                    */
+/********************************************************/
+int openOutput(struct Output* output, FILE* file)
+{
+  if(file != NULL)
+  {
+    fflush(file);
+  }
+  output->fd = file != NULL ? fileno(file) : -1;
+  output->used = 0;
+  output->failed = FALSE;
+  output->writer = NULL;
+  output->stats = NULL;
+  output->buffer = allocateBuffer(OUTPUT_BUFFER_SIZE);
+  if(output->buffer == NULL)
+  {
+    return -1;
+  }
+  startWriter(output);
+  return 0;
+}
+
+/********************************************************/
+/* Writes bytes to the file of an output. With a writer */
+/* they must be the buffer, which is handed to the      */
+/* writer in exchange for the one it last wrote, once   */
+/* that is done; the time spent waiting for it is what  */
+/* the stats count. Otherwise the bytes are written     */
+/* here, timing and counting the writes when the output */
+/* has stats.                                           */
+/* in -- output, bytes and their number                 */
+/* out -- void; a failed write marks the output failed  */
+/********************************************************/
+static void writeAll(struct Output* output, const unsigned char* data,
+                     unsigned long size)
+{
+  struct Writer* writer = output->writer;
+  long calls = 0;
+  double start;
+
+  STATS_START(output->stats, start);
+  if(writer != NULL)
+  {
+    pthread_mutex_lock(&writer->lock);
+    waitWriter(output);
+    output->buffer = writer->spare;
+    writer->spare = (unsigned char*)data;
+    writer->size = size;
+    writer->fd = output->fd;
+    writer->busy = TRUE;
+    pthread_cond_signal(&writer->ready);
+    pthread_mutex_unlock(&writer->lock);
+    calls = 1;
+  }
+  else if(!output->failed)
+  {
+    calls = writeFully(output->fd, data, size);
+    output->failed = calls < 0;
+  }
+  if(calls > 0)
+  {
+    STATS_ADD(output->stats, writes, calls);
+    STATS_ADD(output->stats, bytesWritten, size);
+  }
+  STATS_TIME(output->stats, writeSeconds, start);
+}
+
+/********************************************************/
+/* Appends bytes to an output. Small writes are         */
+/* gathered in the buffer; writes at least as big as    */
+/* the buffer go straight to the file, unless it has a  */
+/* writer, which only ever takes whole buffers.         */
+/* in -- output, bytes and their number                 */
+/* out -- void                                          */
+/********************************************************/
+void writeBytes(struct Output* output, const unsigned char* data,
+                unsigned long size)
+{
+  unsigned long n;
+
+  while(output->writer != NULL && size > 0)
+  {
+    n = OUTPUT_BUFFER_SIZE - output->used < size
+        ? OUTPUT_BUFFER_SIZE - output->used : size;
+    memcpy(output->buffer + output->used, data, n);
+    output->used += n;
+    data += n;
+    size -= n;
+    if(output->used == OUTPUT_BUFFER_SIZE)
+    {
+      writeAll(output, output->buffer, output->used);
+      output->used = 0;
+    }
+  }
+  if(output->used + size > OUTPUT_BUFFER_SIZE)
+  {
+    writeAll(output, output->buffer, output->used);
+    output->used = 0;
+  }
+  if(size >= OUTPUT_BUFFER_SIZE)
+  {
+    writeAll(output, data, size);
+    return;
+  }
+  memcpy(output->buffer + output->used, data, size);
+  output->used += size;
+}
+
+/********************************************************/
+/* Points an output at another open file, keeping its   */
+/* buffer, which must have been flushed, so that many   */
+/* files are written with one buffer.                   */
+/* in -- output, open file                              */
+/* out -- void                                          */
+/********************************************************/
+void switchOutput(struct Output* output, FILE* file)
+{
+  fflush(file);
+  output->fd = fileno(file);
+  output->used = 0;
+  output->failed = FALSE;
+  if(output->writer != NULL)
+  {
+    pthread_mutex_lock(&output->writer->lock);
+    output->writer->failed = FALSE;
+    pthread_mutex_unlock(&output->writer->lock);
+  }
+}
+
+/********************************************************/
+/* Writes what is left in the buffer of an output, and  */
+/* waits for its writer to finish.                      */
+/* in -- the output                                     */
+/* out -- 0, or -1 if any write to the file failed      */
+/********************************************************/
+int flushOutput(struct Output* output)
+{
+  if(output->used > 0 || output->writer == NULL)
+  {
+    writeAll(output, output->buffer, output->used);
+    output->used = 0;
+  }
+  if(output->writer != NULL)
+  {
+    pthread_mutex_lock(&output->writer->lock);
+    waitWriter(output);
+    pthread_mutex_unlock(&output->writer->lock);
+  }
+  return output->failed ? -1 : 0;
+}
+
+/********************************************************/
+/* Writes what is left in the buffer of an output,      */
+/* stops its writer and frees the buffers. The file     */
+/* itself is left open.                                 */
+/* in -- the output                                     */
+/* out -- 0, or -1 if any write failed                  */
+/********************************************************/
+int closeOutput(struct Output* output)
+{
+  struct Writer* writer = output->writer;
+  int status = flushOutput(output);
+
+  if(writer != NULL)
+  {
+    pthread_mutex_lock(&writer->lock);
+    writer->stop = TRUE;
+    pthread_cond_signal(&writer->ready);
+    pthread_mutex_unlock(&writer->lock);
+    pthread_join(writer->thread, NULL);
+    freeWriter(writer);
+    output->writer = NULL;
+  }
+  free(output->buffer);
+  output->buffer = NULL;
+  return status;
+}
@@ -0,0 +1,451 @@
+/*************************************/
+/* This program measures the decode  */
+/* kernels against the generic table */
+/* decoder, on inputs coded with     */
+/* codes of every length limit, so   */
+/* each kernel is timed on the code  */
+/* lengths it is made for.           */
+/*************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "huffman.h"
+
+#define TRUE 1
+#define FALSE 0
+
+/* what decodeAll decodes with besides a kernel by number */
+#define USE_GENERIC -1
+#define USE_CHOSEN -2
+
+/* minimum CPU time spent timing each kernel, in seconds */
+#define MIN_SECONDS 0.3
+
+/* size of the sample input used when no file is named */
+#define SAMPLE_SIZE (8ul << 20)
+
+/* number of different bytes in the sample input, how many of */
+/* them are common, and how often each of the rest comes next  */
+/* to the commonest                                            */
+#define SAMPLE_SYMBOLS 240
+#define COMMON_SYMBOLS 192
+#define RARE_WEIGHT 0.0002
+
+/* code length limits every input is coded with */
+#define LIMITS 5
+static const int limitList[LIMITS] = {8, 10, 11, 12, MAX_CODE_LENGTH};
+
+/*******************************************************/
+/* Reads everything left in a file into memory,        */
+/* followed by DECODE_PAD zero bytes.                  */
+/* in -- file to read, pointer where the number of     */
+/*       bytes read is stored                          */
+/* out -- buffer holding the bytes, NULL on failure    */
+/*******************************************************/
+static unsigned char* readRest(FILE* in, unsigned long* length)
+{
+  unsigned long capacity = 65536;
+  unsigned char* buffer = malloc(capacity + DECODE_PAD);
+  unsigned char* grown;
+  size_t got;
+
+  *length = 0;
+  while(buffer != NULL)
+  {
+    got = fread(buffer + *length, sizeof(unsigned char),
+                capacity - *length, in);
+    *length += got;
+    if(*length < capacity)
+    {
+      memset(buffer + *length, 0, DECODE_PAD);
+      return buffer;
+    }
+    capacity *= 2;
+    grown = realloc(buffer, capacity + DECODE_PAD);
+    if(grown == NULL)
+    {
+      free(buffer);
+    }
+    buffer = grown;
+  }
+  return NULL;
+}
+
+/*******************************************************/
+/* Makes the sample input: COMMON_SYMBOLS bytes, the   */
+/* nth about 1/n as often as the first, as in text,    */
+/* and a few rare ones, from a fixed seed so every run */
+/* times the same bytes. Its codes average 6 bits and  */
+/* run to 15 bits unless they are limited.             */
+/* in -- pointer where the number of bytes is stored   */
+/* out -- buffer holding the bytes, NULL on failure    */
+/*******************************************************/
+static unsigned char* makeSample(unsigned long* length)
+{
+  unsigned char* buffer = malloc(SAMPLE_SIZE + DECODE_PAD);
+  double total = 0.0, bound[SAMPLE_SYMBOLS], point;
+  unsigned long seed = 12345, i;
+  int symbol, low, high;
+
+  if(buffer == NULL)
+  {
+    return NULL;
+  }
+  for(symbol = 0; symbol < SAMPLE_SYMBOLS; symbol++)
+  {
+    total += symbol < COMMON_SYMBOLS ? 1.0 / (symbol + 1) : RARE_WEIGHT;
+    bound[symbol] = total;
+  }
+  for(i = 0; i < SAMPLE_SIZE; i++)
+  {
+    seed = (seed * 1103515245ul + 12345ul) & 0xffffffful;
+    point = (double)seed / 0x10000000ul * total;
+    for(low = 0, high = SAMPLE_SYMBOLS - 1; low < high;)
+    {
+      symbol = (low + high) / 2;
+      if(bound[symbol] <= point)
+      {
+        low = symbol + 1;
+      }
+      else
+      {
+        high = symbol;
+      }
+    }
+    buffer[i] = (unsigned char)low;
+  }
+  memset(buffer + SAMPLE_SIZE, 0, DECODE_PAD);
+  *length = SAMPLE_SIZE;
+  return buffer;
+}
+
+/* one encoded Huffman block and what the kernels need for it */
+struct KernelBlock
+{
+  int type;
+  const unsigned char* body;
+  unsigned long compSize;
+  unsigned long rawSize;
+  unsigned long start;
+  int used;
+  struct DecodeTable table;
+  const struct Kernel* kernel;
+  struct KernelTable kernelTable;
+};
+
+/*******************************************************/
+/* Encodes the input block after block into one buffer */
+/* and keeps the Huffman blocks, with their decode     */
+/* tables; raw blocks and runs have no codes to time.  */
+/* in -- options, input and its length, buffer with    */
+/*       room for every block, array that receives the */
+/*       blocks, tree nodes to encode with             */
+/* out -- number of Huffman blocks                     */
+/*******************************************************/
+static unsigned long encodeAll(const struct EncodeOptions* options,
+                               const unsigned char* input,
+                               unsigned long length, unsigned char* encoded,
+                               struct KernelBlock block[],
+                               struct Tree* scratch)
+{
+  unsigned long frequency[NUM_CHAR];
+  unsigned char codeLength[NUM_CHAR];
+  struct CodeTable codes;
+  unsigned long offset, size, blocks = 0, encodedSize = 0;
+  struct KernelBlock* b;
+
+  for(offset = 0; offset < length; offset += size)
+  {
+    size = length - offset < options->blockSize
+           ? length - offset : options->blockSize;
+    b = &block[blocks];
+    b->body = encoded + encodedSize + BLOCK_HEADER_SIZE;
+    encodedSize += encodeBlock(options, input + offset, size,
+                               encoded + encodedSize, scratch,
+                               frequency, &codes, NULL);
+    readBlockHeader(b->body - BLOCK_HEADER_SIZE, &b->type, &b->rawSize,
+                    &b->compSize);
+    if(b->type != BLOCK_HUFFMAN && b->type != BLOCK_HUFFMAN_STREAMS)
+    {
+      continue;
+    }
+    b->start = offset;
+    b->used = readLengths(b->body, b->compSize, codeLength);
+    buildCanonicalTable(codeLength, &b->table);
+    blocks++;
+  }
+  memset(encoded + encodedSize, 0, DECODE_PAD);
+  return blocks;
+}
+
+/*******************************************************/
+/* Sets every block up to decode with one kernel, or   */
+/* with the kernel chooseKernel picks for it, and      */
+/* fills the kernel tables. A block with another       */
+/* number of streams than the kernel, such as a short  */
+/* last block, is left to the generic decoder.         */
+/* in -- blocks and their number, number of a kernel,  */
+/*       USE_CHOSEN or USE_GENERIC                     */
+/* out -- FALSE if the kernel can't decode some block, */
+/*        or has no block to decode                    */
+/*******************************************************/
+static int setKernel(struct KernelBlock block[], unsigned long blocks,
+                     int use)
+{
+  unsigned long i, kernelBlocks = 0;
+  int streams;
+
+  for(i = 0; i < blocks; i++)
+  {
+    streams = block[i].type == BLOCK_HUFFMAN ? 1 : STREAMS;
+    if(use == USE_GENERIC)
+    {
+      block[i].kernel = NULL;
+      continue;
+    }
+    block[i].kernel = use == USE_CHOSEN ? chooseKernel(&block[i].table,
+                                                       streams)
+                                        : getKernel(use);
+    if(block[i].kernel->streams != streams)
+    {
+      block[i].kernel = NULL;
+      continue;
+    }
+    if(!kernelFits(block[i].kernel, &block[i].table))
+    {
+      return FALSE;
+    }
+    buildKernelTable(&block[i].table, block[i].kernel->bits,
+                     &block[i].kernelTable);
+    kernelBlocks++;
+  }
+  return use == USE_GENERIC || kernelBlocks > 0;
+}
+
+/*******************************************************/
+/* Decodes every block once with its kernel, or with   */
+/* decodeTable or decodeStreams when it has none.      */
+/* in -- blocks and their number, output buffer        */
+/* out -- number of bytes decoded                      */
+/*******************************************************/
+static unsigned long decodeAll(const struct KernelBlock block[],
+                               unsigned long blocks, unsigned char* output)
+{
+  unsigned long bitPos[STREAMS], limit[STREAMS], count[STREAMS];
+  unsigned char* out[STREAMS];
+  unsigned long i, total = 0;
+  int streams;
+
+  for(i = 0; i < blocks; i++)
+  {
+    streams = findStreams(block[i].type, block[i].body, block[i].compSize,
+                          block[i].used, output + block[i].start,
+                          block[i].rawSize, bitPos, limit, out, count);
+    if(streams < 0)
+    {
+      continue;
+    }
+    if(block[i].kernel != NULL)
+    {
+      total += block[i].kernel->decode(&block[i].table,
+                                       &block[i].kernelTable, block[i].body,
+                                       limit, bitPos, out, count);
+    }
+    else if(streams == 1)
+    {
+      total += decodeTable(&block[i].table, block[i].body, limit[0], bitPos,
+                           out[0], count[0]);
+    }
+    else
+    {
+      total += decodeStreams(&block[i].table, block[i].body, limit, bitPos,
+                             out, count);
+    }
+  }
+  return total;
+}
+
+/*******************************************************/
+/* Decodes every block repeatedly until MIN_SECONDS of */
+/* CPU time have passed, then once more to check the   */
+/* output against the input.                           */
+/* in -- blocks and their number, output buffer,       */
+/*       input, number of bytes in the blocks, pointer */
+/*       that receives FALSE if the output is wrong    */
+/* out -- decoded megabytes per second                 */
+/*******************************************************/
+static double timeDecode(const struct KernelBlock block[],
+                         unsigned long blocks, unsigned char* output,
+                         const unsigned char* input, unsigned long bytes,
+                         int* correct)
+{
+  clock_t start = clock();
+  double seconds;
+  unsigned long runs = 0, i;
+
+  do
+  {
+    decodeAll(block, blocks, output);
+    runs++;
+    seconds = (double)(clock() - start) / CLOCKS_PER_SEC;
+  } while(seconds < MIN_SECONDS);
+
+  memset(output, 0, block[blocks - 1].start + block[blocks - 1].rawSize);
+  *correct = decodeAll(block, blocks, output) == bytes;
+  for(i = 0; *correct && i < blocks; i++)
+  {
+    *correct = memcmp(output + block[i].start, input + block[i].start,
+                      block[i].rawSize) == 0;
+  }
+  return (double)bytes * runs / seconds / 1e6;
+}
+
+/*******************************************************/
+/* Times the generic decoder, every kernel that can    */
+/* decode all the blocks and the kernels chooseKernel  */
+/* picks, in that order, and prints a line for each    */
+/* with its gain over the generic decoder.             */
+/* in -- name of the input, length limit of the codes, */
+/*       blocks and their number, output buffer, input */
+/* out -- 0, or 4 if some output was wrong             */
+/*******************************************************/
+static int timeKernels(const char* name, int limit, struct KernelBlock block[],
+                       unsigned long blocks, unsigned char* output,
+                       const unsigned char* input)
+{
+  unsigned long bytes = 0, bits = 0, i;
+  int streams = block[0].type == BLOCK_HUFFMAN ? 1 : STREAMS;
+  int longest = 0, length, run, use, correct, status = 0;
+  double generic = 0.0, speed;
+  const struct Kernel* kernel;
+
+  for(i = 0; i < blocks; i++)
+  {
+    bytes += block[i].rawSize;
+    bits += (block[i].compSize - block[i].used) * 8;
+    for(length = longest + 1; length <= MAX_CODE_LENGTH; length++)
+    {
+      if(block[i].table.count[length] > 0)
+      {
+        longest = length;
+      }
+    }
+  }
+
+  for(run = -1; run <= NUM_KERNELS; run++)
+  {
+    use = run < 0 ? USE_GENERIC : run < NUM_KERNELS ? run : USE_CHOSEN;
+    if(!setKernel(block, blocks, use))
+    {
+      continue;
+    }
+    kernel = use >= 0 ? getKernel(use) : NULL;
+    speed = timeDecode(block, blocks, output, input, bytes, &correct);
+    if(use == USE_GENERIC)
+    {
+      generic = speed;
+    }
+    printf("%-24s %6d %8d %8d %9.2f %-10s %10.1f %9.2fx%s\n", name, limit,
+           streams, longest, (double)bits / bytes,
+           use == USE_GENERIC ? "generic"
+                              : use == USE_CHOSEN ? "chosen" : kernel->name,
+           speed, generic > 0 ? speed / generic : 0.0,
+           correct ? "" : "  wrong output");
+    if(!correct)
+    {
+      status = 4;
+    }
+  }
+  return status;
+}
+
+/*******************************************************/
+/* Main function. Codes every file named on the        */
+/* command line, or the sample input, with each code   */
+/* length limit in turn, as single stream blocks and   */
+/* as blocks of STREAMS streams, and times the generic */
+/* table decoder, every kernel that fits the codes and */
+/* the kernels chooseKernel picks for the blocks.      */
+/* in -- int argc, number of arguments                 */
+/*       char ** argv, names of files to code          */
+/* out -- 0 if every kernel decoded every input        */
+/*******************************************************/
+int main(int argc, char** argv)
+{
+  struct EncodeOptions options;
+  struct KernelBlock* block;
+  struct Tree* scratch;
+  unsigned char* input;
+  unsigned char* encoded;
+  unsigned char* output;
+  unsigned long length, blocks;
+  const char* name;
+  FILE* in;
+  int i, limit, streams, status = 0;
+
+  defaultEncodeOptions(&options);
+  options.storeFallback = FALSE;
+  printf("%-24s %6s %8s %8s %9s %-10s %10s %10s\n", "input", "limit",
+         "streams", "longest", "bits/byte", "kernel", "MB/s", "gain");
+  for(i = 1; i < argc || i == 1; i++)
+  {
+    if(argc > 1)
+    {
+      name = argv[i];
+      in = fopen(name, "rb");
+      if(in == NULL)
+      {
+        printf("couldn't open %s for reading\n", name);
+        return 2;
+      }
+      input = readRest(in, &length);
+      fclose(in);
+    }
+    else
+    {
+      name = "sample";
+      input = makeSample(&length);
+    }
+
+    blocks = (length + options.blockSize - 1) / options.blockSize;
+    block = malloc((blocks + 1) * sizeof(struct KernelBlock));
+    encoded = malloc(blocks * blockBound(options.blockSize) + DECODE_PAD);
+    output = malloc(length + 1);
+    scratch = allocateTree();
+    if(input == NULL || block == NULL || encoded == NULL || output == NULL
+       || scratch == NULL)
+    {
+      printf("out of memory for %s\n", name);
+      return 3;
+    }
+
+    for(limit = 0; limit < LIMITS; limit++)
+    {
+      for(streams = FALSE; streams <= TRUE; streams++)
+      {
+        options.maxCodeLength = limitList[limit];
+        options.streams = streams;
+        blocks = encodeAll(&options, input, length, encoded, block, scratch);
+        if(blocks == 0)
+        {
+          printf("%-24s %6d: no Huffman blocks\n", name, limitList[limit]);
+          continue;
+        }
+        if(timeKernels(name, limitList[limit], block, blocks, output,
+                       input) != 0)
+        {
+          status = 4;
+        }
+      }
+    }
+
+    freeTree(scratch);
+    free(block);
+    free(encoded);
+    free(output);
+    free(input);
+  }
+  return status;
+}
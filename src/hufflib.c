@@ -0,0 +1,440 @@
+/*************************************/
+/* This file defines the library     */
+/* interface: whole buffers encoded  */
+/* and decoded in memory, one block  */
+/* after another, with the tables of */
+/* a context that is kept between    */
+/* calls.                            */
+/*************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "huffman.h"
+#include "hufflib.h"
+
+#define TRUE 1
+#define FALSE 0
+
+/* bytes of magic and version in front of the blocks */
+#define MAGIC_SIZE 4
+
+#if HUFF_TABLE_MAX_SIZE != TABLE_MAX_SIZE
+#error HUFF_TABLE_MAX_SIZE must match TABLE_MAX_SIZE
+#endif
+
+struct HuffContext
+{
+  struct EncodeOptions options;
+  struct Tree* tree;
+  unsigned long frequency[NUM_CHAR];
+  struct CodeTable codes;
+
+  /* a block is encoded here when it might not fit in */
+  /* what is left of the caller's buffer              */
+  unsigned char* scratch;
+
+  /* the part of a block huffDecompressRange wants is */
+  /* decoded here; grown to the largest such block    */
+  unsigned char* rangeScratch;
+  unsigned long rangeScratchSize;
+};
+
+struct HuffTable
+{
+  struct StaticTable table;
+};
+
+/********************************************************/
+/* Creates a context, with room for the largest block   */
+/* it encodes.                                          */
+/* in -- void                                           */
+/* out -- the context, NULL if memory ran out           */
+/********************************************************/
+struct HuffContext* huffCreateContext(void)
+{
+  struct HuffContext* context = malloc(sizeof(struct HuffContext));
+
+  if(context == NULL)
+  {
+    return NULL;
+  }
+  defaultEncodeOptions(&context->options);
+  context->rangeScratch = NULL;
+  context->rangeScratchSize = 0;
+  context->tree = allocateTree();
+  context->scratch = malloc(blockBound(context->options.blockSize));
+  if(context->tree == NULL || context->scratch == NULL)
+  {
+    huffFreeContext(context);
+    return NULL;
+  }
+  return context;
+}
+
+/********************************************************/
+/* Frees a context.                                     */
+/* in -- the context, may be NULL                       */
+/* out -- void                                          */
+/********************************************************/
+void huffFreeContext(struct HuffContext* context)
+{
+  if(context == NULL)
+  {
+    return;
+  }
+  freeTree(context->tree);
+  free(context->scratch);
+  free(context->rangeScratch);
+  free(context);
+}
+
+/********************************************************/
+/* Most bytes huffCompress can produce: the magic, the  */
+/* bound of every block, and the end block.             */
+/* in -- number of bytes to encode                      */
+/* out -- size of a buffer that always holds them       */
+/********************************************************/
+unsigned long huffCompressBound(unsigned long srcLen)
+{
+  unsigned long bound = MAGIC_SIZE + END_BLOCK_SIZE;
+
+  bound += srcLen / DEFAULT_BLOCK_SIZE * blockBound(DEFAULT_BLOCK_SIZE);
+  if(srcLen % DEFAULT_BLOCK_SIZE != 0)
+  {
+    bound += blockBound(srcLen % DEFAULT_BLOCK_SIZE);
+  }
+  return bound;
+}
+
+/********************************************************/
+/* Encodes a buffer block by block. A block is encoded  */
+/* straight into the caller's buffer when its bound     */
+/* fits in what is left, and into the scratch buffer of */
+/* the context, then copied, when it might not.         */
+/* in -- context, where to write and how many bytes     */
+/*       fit there, the bytes to encode and their       */
+/*       number                                         */
+/* out -- number of bytes written, HUFF_ERROR if they   */
+/*        do not fit                                    */
+/********************************************************/
+unsigned long huffCompress(struct HuffContext* context,
+                           void* dst, unsigned long dstCap,
+                           const void* src, unsigned long srcLen)
+{
+  unsigned char* out = dst;
+  const unsigned char* in = src;
+  unsigned long pos, offset, rawSize, size;
+
+  if(dstCap < MAGIC_SIZE)
+  {
+    return HUFF_ERROR;
+  }
+  out[0] = MAGIC_0;
+  out[1] = MAGIC_1;
+  out[2] = MAGIC_2;
+  out[3] = FORMAT_VERSION;
+  pos = MAGIC_SIZE;
+
+  for(offset = 0; offset < srcLen; offset += rawSize)
+  {
+    rawSize = srcLen - offset;
+    if(rawSize > context->options.blockSize)
+    {
+      rawSize = context->options.blockSize;
+    }
+    if(dstCap - pos >= blockBound(rawSize))
+    {
+      size = encodeBlock(&context->options, in + offset, rawSize, out + pos,
+                         context->tree, context->frequency, &context->codes,
+                         NULL);
+    }
+    else
+    {
+      size = encodeBlock(&context->options, in + offset, rawSize,
+                         context->scratch, context->tree,
+                         context->frequency, &context->codes, NULL);
+      if(size > dstCap - pos)
+      {
+        return HUFF_ERROR;
+      }
+      memcpy(out + pos, context->scratch, size);
+    }
+    pos += size;
+  }
+
+  if(dstCap - pos < END_BLOCK_SIZE)
+  {
+    return HUFF_ERROR;
+  }
+  writeEndBlock(out + pos, srcLen, 0);
+  return pos + END_BLOCK_SIZE;
+}
+
+/********************************************************/
+/* Reads the decoded size from the end block, which in  */
+/* the current format closes every encoded buffer.      */
+/* in -- the encoded bytes and their number             */
+/* out -- the decoded size, HUFF_ERROR if the buffer    */
+/*        does not end like an encoded buffer           */
+/********************************************************/
+unsigned long huffDecompressedSize(const void* src, unsigned long srcLen)
+{
+  const unsigned char* in = src;
+  const unsigned char* end;
+  unsigned long rawSize, compSize;
+  uint64_t totalSize;
+  int type;
+
+  if(srcLen < MAGIC_SIZE + END_BLOCK_SIZE || in[0] != MAGIC_0
+     || in[1] != MAGIC_1 || in[2] != MAGIC_2 || in[3] != FORMAT_VERSION)
+  {
+    return HUFF_ERROR;
+  }
+  end = in + srcLen - END_BLOCK_SIZE;
+  readBlockHeader(end, &type, &rawSize, &compSize);
+  if(type != BLOCK_END || compSize != END_BODY_SIZE)
+  {
+    return HUFF_ERROR;
+  }
+  totalSize = readEndBody(end + BLOCK_HEADER_SIZE);
+  if(totalSize >= HUFF_ERROR)
+  {
+    return HUFF_ERROR;
+  }
+  return (unsigned long)totalSize;
+}
+
+/********************************************************/
+/* Decodes a buffer block by block, straight into the   */
+/* caller's buffer. The end block that follows every    */
+/* block body leaves the DECODE_PAD readable bytes the  */
+/* decoder needs, so nothing is copied.                 */
+/* in -- context, where to write and how many bytes     */
+/*       fit there, the encoded bytes and their number  */
+/* out -- number of bytes written, HUFF_ERROR if the    */
+/*        input is damaged or does not fit              */
+/********************************************************/
+unsigned long huffDecompress(struct HuffContext* context,
+                             void* dst, unsigned long dstCap,
+                             const void* src, unsigned long srcLen)
+{
+  unsigned char* out = dst;
+  const unsigned char* in = src;
+  unsigned long pos, written = 0, rawSize, compSize;
+  int type;
+
+  (void)context;
+  if(srcLen < MAGIC_SIZE || in[0] != MAGIC_0
+     || in[1] != MAGIC_1 || in[2] != MAGIC_2 || in[3] != FORMAT_VERSION)
+  {
+    return HUFF_ERROR;
+  }
+  pos = MAGIC_SIZE;
+
+  for(;;)
+  {
+    if(srcLen - pos < BLOCK_HEADER_SIZE)
+    {
+      return HUFF_ERROR;
+    }
+    readBlockHeader(in + pos, &type, &rawSize, &compSize);
+    pos += BLOCK_HEADER_SIZE;
+    if(type == BLOCK_END)
+    {
+      break;
+    }
+    if(rawSize > MAX_BLOCK_SIZE || rawSize > dstCap - written
+       || compSize > srcLen - pos || srcLen - pos - compSize < DECODE_PAD)
+    {
+      return HUFF_ERROR;
+    }
+    if(decodeBlock(type, in + pos, compSize, out + written, rawSize,
+                   NULL) != 0)
+    {
+      return HUFF_ERROR;
+    }
+    pos += compSize;
+    written += rawSize;
+  }
+
+  if(compSize != END_BODY_SIZE || srcLen - pos != END_BODY_SIZE
+     || readEndBody(in + pos) != written)
+  {
+    return HUFF_ERROR;
+  }
+  return written;
+}
+
+/********************************************************/
+/* Decodes the bytes of a buffer from start on, as many */
+/* as fit, decoding only the blocks that hold them.     */
+/* in -- context, where to write and how many bytes     */
+/*       fit there, the encoded bytes and their number, */
+/*       first decoded byte wanted                      */
+/* out -- number of bytes written, fewer than dstCap    */
+/*        only at the end of the data, HUFF_ERROR if    */
+/*        the input is damaged                          */
+/********************************************************/
+unsigned long huffDecompressRange(struct HuffContext* context,
+                                  void* dst, unsigned long dstCap,
+                                  const void* src, unsigned long srcLen,
+                                  unsigned long start)
+{
+  unsigned long written;
+
+  if(decodeRange(src, srcLen, start, dstCap, dst, &written,
+                 &context->rangeScratch, &context->rangeScratchSize) != 0)
+  {
+    return HUFF_ERROR;
+  }
+  return written;
+}
+
+/********************************************************/
+/* Trains a table from the counts of sample messages.   */
+/* in -- the samples and their total size               */
+/* out -- the table, NULL if memory ran out             */
+/********************************************************/
+struct HuffTable* huffTrainTable(const void* samples, unsigned long size)
+{
+  struct HuffTable* table = malloc(sizeof(struct HuffTable));
+  struct Tree* tree = allocateTree();
+  unsigned long frequency[NUM_CHAR];
+
+  if(table == NULL || tree == NULL)
+  {
+    free(table);
+    freeTree(tree);
+    return NULL;
+  }
+  countSymbols(samples, size, frequency);
+  trainStaticTable(tree, frequency, &table->table);
+  freeTree(tree);
+  return table;
+}
+
+/********************************************************/
+/* Writes a table in the table file format.             */
+/* in -- the table, where to write and how many bytes   */
+/*       fit there                                      */
+/* out -- number of bytes written, HUFF_ERROR if they   */
+/*        do not fit                                    */
+/********************************************************/
+unsigned long huffSaveTable(const struct HuffTable* table,
+                            void* dst, unsigned long dstCap)
+{
+  unsigned char buffer[TABLE_MAX_SIZE];
+  unsigned long size = writeStaticTable(buffer, &table->table);
+
+  if(size > dstCap)
+  {
+    return HUFF_ERROR;
+  }
+  memcpy(dst, buffer, size);
+  return size;
+}
+
+/********************************************************/
+/* Loads a table and builds its code and decode tables  */
+/* once, for all the messages that use it.              */
+/* in -- the bytes and their number                     */
+/* out -- the table, NULL if the bytes are not a table  */
+/*        or memory ran out                             */
+/********************************************************/
+struct HuffTable* huffLoadTable(const void* src, unsigned long srcLen)
+{
+  struct HuffTable* table = malloc(sizeof(struct HuffTable));
+
+  if(table != NULL && readStaticTable(src, srcLen, &table->table) != 0)
+  {
+    free(table);
+    table = NULL;
+  }
+  return table;
+}
+
+/********************************************************/
+/* Id of a table.                                       */
+/* in -- the table                                      */
+/* out -- the 32-bit id                                 */
+/********************************************************/
+unsigned long huffTableId(const struct HuffTable* table)
+{
+  return table->table.id;
+}
+
+/********************************************************/
+/* Frees a table.                                       */
+/* in -- the table, may be NULL                         */
+/* out -- void                                          */
+/********************************************************/
+void huffFreeTable(struct HuffTable* table)
+{
+  free(table);
+}
+
+/********************************************************/
+/* Most bytes huffCompressMessage can produce.          */
+/* in -- number of bytes to encode                      */
+/* out -- size of a buffer that always holds them       */
+/********************************************************/
+unsigned long huffMessageBound(unsigned long srcLen)
+{
+  return messageBound(srcLen);
+}
+
+/********************************************************/
+/* Encodes a message with a trained table, straight     */
+/* into the caller's buffer when its bound fits, and    */
+/* through the scratch buffer of the context otherwise. */
+/* in -- context, table, where to write and how many    */
+/*       bytes fit there, the bytes to encode and their */
+/*       number                                         */
+/* out -- number of bytes written, HUFF_ERROR if they   */
+/*        do not fit                                    */
+/********************************************************/
+unsigned long huffCompressMessage(struct HuffContext* context,
+                                  const struct HuffTable* table,
+                                  void* dst, unsigned long dstCap,
+                                  const void* src, unsigned long srcLen)
+{
+  unsigned long size;
+
+  if(dstCap >= messageBound(srcLen))
+  {
+    return encodeMessage(&table->table, src, srcLen, dst);
+  }
+  if(messageBound(srcLen) > blockBound(context->options.blockSize))
+  {
+    return HUFF_ERROR;
+  }
+  size = encodeMessage(&table->table, src, srcLen, context->scratch);
+  if(size > dstCap)
+  {
+    return HUFF_ERROR;
+  }
+  memcpy(dst, context->scratch, size);
+  return size;
+}
+
+/********************************************************/
+/* Decodes a message encoded with the same table.       */
+/* in -- table, where to write and how many bytes fit   */
+/*       there, the encoded bytes and their number      */
+/* out -- number of bytes written, HUFF_ERROR if the    */
+/*        message was coded with another table, is      */
+/*        damaged or does not fit                       */
+/********************************************************/
+unsigned long huffDecompressMessage(const struct HuffTable* table,
+                                    void* dst, unsigned long dstCap,
+                                    const void* src, unsigned long srcLen)
+{
+  unsigned long rawSize;
+
+  if(decodeMessage(&table->table, src, srcLen, dst, dstCap, &rawSize) != 0)
+  {
+    return HUFF_ERROR;
+  }
+  return rawSize;
+}
@@ -0,0 +1,189 @@
+/*************************************/
+/* Library interface: encodes and    */
+/* decodes buffers in memory, in the */
+/* same format as huffencode writes. */
+/* Link with libhuffman.a or         */
+/* libhuffman.so and -pthread.       */
+/*************************************/
+
+#ifndef HUFFLIB_H
+#define HUFFLIB_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* returned by the functions below that give a */
+/* size, when they fail                          */
+#define HUFF_ERROR ((unsigned long)-1)
+
+/********************************************************/
+/* Tables and scratch memory kept between calls, so     */
+/* that encoding and decoding do no allocation. A       */
+/* context may be used by one thread at a time.         */
+/********************************************************/
+struct HuffContext;
+
+/********************************************************/
+/* Creates a context.                                   */
+/* in -- void                                           */
+/* out -- the context, NULL if memory ran out           */
+/********************************************************/
+struct HuffContext* huffCreateContext(void);
+
+/********************************************************/
+/* Frees a context.                                     */
+/* in -- the context, may be NULL                       */
+/* out -- void                                          */
+/********************************************************/
+void huffFreeContext(struct HuffContext* context);
+
+/********************************************************/
+/* Most bytes huffCompress can produce.                 */
+/* in -- number of bytes to encode                      */
+/* out -- size of a buffer that always holds them       */
+/********************************************************/
+unsigned long huffCompressBound(unsigned long srcLen);
+
+/********************************************************/
+/* Encodes a buffer.                                    */
+/* in -- context, where to write and how many bytes     */
+/*       fit there, the bytes to encode and their       */
+/*       number                                         */
+/* out -- number of bytes written, HUFF_ERROR if they   */
+/*        do not fit; a buffer of huffCompressBound     */
+/*        bytes always fits                             */
+/********************************************************/
+unsigned long huffCompress(struct HuffContext* context,
+                           void* dst, unsigned long dstCap,
+                           const void* src, unsigned long srcLen);
+
+/********************************************************/
+/* Number of bytes an encoded buffer decodes to, read   */
+/* from its end without decoding it.                    */
+/* in -- the encoded bytes and their number             */
+/* out -- the decoded size, HUFF_ERROR if the buffer    */
+/*        does not end like an encoded buffer           */
+/********************************************************/
+unsigned long huffDecompressedSize(const void* src, unsigned long srcLen);
+
+/********************************************************/
+/* Decodes a buffer.                                    */
+/* in -- context, where to write and how many bytes     */
+/*       fit there, the encoded bytes and their number  */
+/* out -- number of bytes written, HUFF_ERROR if the    */
+/*        input is damaged or does not fit              */
+/********************************************************/
+unsigned long huffDecompress(struct HuffContext* context,
+                             void* dst, unsigned long dstCap,
+                             const void* src, unsigned long srcLen);
+
+/********************************************************/
+/* Decodes part of a buffer: the bytes from start on,   */
+/* as many as fit, without decoding the blocks before   */
+/* them. Files that huffencode --index wrote find the   */
+/* first block from their index; other buffers read     */
+/* the block headers up to it.                          */
+/* in -- context, where to write and how many bytes     */
+/*       fit there, the encoded bytes and their number, */
+/*       first decoded byte wanted                      */
+/* out -- number of bytes written, fewer than dstCap    */
+/*        only at the end of the data, HUFF_ERROR if    */
+/*        the input is damaged                          */
+/********************************************************/
+unsigned long huffDecompressRange(struct HuffContext* context,
+                                  void* dst, unsigned long dstCap,
+                                  const void* src, unsigned long srcLen,
+                                  unsigned long start);
+
+/* most bytes huffSaveTable writes */
+#define HUFF_TABLE_MAX_SIZE 522
+
+/********************************************************/
+/* A code table trained from sample data, shared by any */
+/* number of messages. A table may be used by several   */
+/* threads at once.                                     */
+/********************************************************/
+struct HuffTable;
+
+/********************************************************/
+/* Trains a table from sample messages. Symbols that    */
+/* never occur in the samples still get a code.         */
+/* in -- the samples, one after another, and their      */
+/*       total size                                     */
+/* out -- the table, NULL if memory ran out             */
+/********************************************************/
+struct HuffTable* huffTrainTable(const void* samples, unsigned long size);
+
+/********************************************************/
+/* Writes a table so that it can be loaded later.       */
+/* in -- the table, where to write and how many bytes   */
+/*       fit there                                      */
+/* out -- number of bytes written, HUFF_ERROR if they   */
+/*        do not fit; HUFF_TABLE_MAX_SIZE always fits   */
+/********************************************************/
+unsigned long huffSaveTable(const struct HuffTable* table,
+                            void* dst, unsigned long dstCap);
+
+/********************************************************/
+/* Loads a table written by huffSaveTable.              */
+/* in -- the bytes and their number                     */
+/* out -- the table, NULL if the bytes are not a table  */
+/*        or memory ran out                             */
+/********************************************************/
+struct HuffTable* huffLoadTable(const void* src, unsigned long srcLen);
+
+/********************************************************/
+/* Id of a table, which every message coded with it     */
+/* starts with.                                         */
+/* in -- the table                                      */
+/* out -- the 32-bit id                                 */
+/********************************************************/
+unsigned long huffTableId(const struct HuffTable* table);
+
+/********************************************************/
+/* Frees a table.                                       */
+/* in -- the table, may be NULL                         */
+/* out -- void                                          */
+/********************************************************/
+void huffFreeTable(struct HuffTable* table);
+
+/********************************************************/
+/* Most bytes huffCompressMessage can produce.          */
+/* in -- number of bytes to encode                      */
+/* out -- size of a buffer that always holds them       */
+/********************************************************/
+unsigned long huffMessageBound(unsigned long srcLen);
+
+/********************************************************/
+/* Encodes a message with a trained table. The result   */
+/* holds the table id, the size and the codes; nothing  */
+/* is worked out per message.                           */
+/* in -- context, table, where to write and how many    */
+/*       bytes fit there, the bytes to encode and their */
+/*       number                                         */
+/* out -- number of bytes written, HUFF_ERROR if they   */
+/*        do not fit                                    */
+/********************************************************/
+unsigned long huffCompressMessage(struct HuffContext* context,
+                                  const struct HuffTable* table,
+                                  void* dst, unsigned long dstCap,
+                                  const void* src, unsigned long srcLen);
+
+/********************************************************/
+/* Decodes a message encoded with the same table.       */
+/* in -- table, where to write and how many bytes fit   */
+/*       there, the encoded bytes and their number      */
+/* out -- number of bytes written, HUFF_ERROR if the    */
+/*        message was coded with another table, is      */
+/*        damaged or does not fit                       */
+/********************************************************/
+unsigned long huffDecompressMessage(const struct HuffTable* table,
+                                    void* dst, unsigned long dstCap,
+                                    const void* src, unsigned long srcLen);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -11,40 +11,51 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <limits.h>
+#include <string.h>
 #include "huffman.h"
 
-#define NUM_CHAR 256
 #define TRUE 1
 #define FALSE 0
 
-struct Node
+/* header flags: code lengths are packed two per byte, */
+/* or listed as symbol/length pairs                     */
+#define PACKED_LENGTHS 1
+#define SPARSE_LENGTHS 2
+
+/***************************************************************/
+/* Allocates room for every node of one tree in a single block */
+/* of memory, so building and freeing a tree is one malloc and */
+/* one free.                                                   */
+/* in -- void                                                  */
+/* out -- pointer to the empty tree                            */
+/***************************************************************/
+struct Tree* allocateTree(void)
 {
-  unsigned char symbol;
-  unsigned long frequency;
-  struct Node* left;
-  struct Node* right;
-  struct Node* next;
-  int codeArray[NUM_CHAR];
-  int codeLength;
-};
+  struct Tree* tree = malloc(sizeof(struct Tree));
+  if(tree != NULL)
+  {
+    tree->used = 0;
+  }
+  return tree;
+}
 
 /***************************************************************/
-/* Allocate a new node with given data.                        */
-/* in -- a character representing the symbol, an unsigned long */
-/*       representing the frequency at which the character     */
-/*       occurs in the input file                              */
-/* out -- a struct Node                                        */
+/* Hands out the next node of a tree, with given data and no   */
+/* children.                                                   */
+/* in -- pointer to the tree, a character representing the     */
+/*       symbol, an unsigned long representing the frequency   */
+/*       at which the character occurs in the input file       */
+/* out -- index of the new node                                */
 /***************************************************************/
-struct Node* createNode(unsigned char symbol, unsigned long frequency)
+int addNode(struct Tree* tree, unsigned char symbol, unsigned long frequency)
 {
-  struct Node* node = malloc(sizeof(struct Node));
+  struct Node* node = &tree->nodes[tree->used];
   node->symbol = symbol;
   node->frequency = frequency;
-  node->left = NULL;
-  node->right = NULL;
-  node->next = NULL;
+  node->left = 0;
+  node->right = 0;
 
-  return node;
+  return tree->used++;
 }
 
 /**********************************************************/
@@ -52,9 +63,9 @@ struct Node* createNode(unsigned char symbol, unsigned long frequency)
 /* in -- pointer to a Node                                */
 /* out -- integer value representing either true or false */
 /**********************************************************/
-int isLeaf(struct Node* node)
+int isLeaf(const struct Node* node)
 {
-  if(node->left == NULL && node->right == NULL)
+  if(node->left == 0 && node->right == 0)
   {
     return TRUE;
   }
@@ -64,87 +75,831 @@ int isLeaf(struct Node* node)
   }
 }
 
-/**********************************************************/
-/* Insert data at appropriate place in a sorted list,     */
-/* return new list head.                                  */
-/* in -- a pointer to the head of the list, and a pointer */
-/*       to the newNode that will be added the the list   */
-/* out -- the head of the list, with the new node added   */
-/*        in the appropriate place                        */
-/**********************************************************/
-struct Node* insertSorted(struct Node* head, struct Node* newNode)
+/************************************************************/
+/* Orders nodes the way the sorted list of the original     */
+/* builder did: by frequency, then by symbol (a merged node */
+/* takes the symbol of its left child), then by creation,   */
+/* which is the node's index in the tree.                   */
+/* in -- tree, indices of two of its nodes                  */
+/* out -- TRUE if a comes out of the queue before b         */
+/************************************************************/
+static int comesFirst(const struct Tree* tree, int a, int b)
 {
-  unsigned long frequency = newNode->frequency;
-  unsigned char symbol = newNode->symbol;
-  struct Node* current;
+  const struct Node* x = &tree->nodes[a];
+  const struct Node* y = &tree->nodes[b];
 
-  if(head == NULL || head->frequency > frequency
-     || (head->frequency == frequency && head->symbol > symbol))
+  if(x->frequency != y->frequency)
   {
-    newNode->next = head;
-    return newNode;
+    return x->frequency < y->frequency;
   }
+  if(x->symbol != y->symbol)
+  {
+    return x->symbol < y->symbol;
+  }
+  return a < b;
+}
+
+/************************************************************/
+/* Adds a node to a binary min-heap ordered by comesFirst.  */
+/* in -- tree, heap array, number of nodes in it, index of  */
+/*       the node to add                                    */
+/* out -- new number of nodes in the heap                   */
+/************************************************************/
+static int pushNode(const struct Tree* tree, unsigned short heap[],
+                    int size, int node)
+{
+  int child = size, parent;
 
-  current = head;
-  while(current->next != NULL
-	&& (current->next->frequency < frequency ||
-	    (current->next->frequency == frequency 
-	    && current->next->symbol <= symbol)))
+  while(child > 0)
   {
-    current = current->next;
+    parent = (child - 1) / 2;
+    if(!comesFirst(tree, node, heap[parent]))
+    {
+      break;
+    }
+    heap[child] = heap[parent];
+    child = parent;
   }
+  heap[child] = (unsigned short)node;
+  return size + 1;
+}
 
-  newNode->next = current->next;
-  current->next = newNode;
+/************************************************************/
+/* Removes the first node from a binary min-heap.           */
+/* in -- tree, heap array, pointer to the number of nodes   */
+/*       in it                                              */
+/* out -- index of the node that came out                   */
+/************************************************************/
+static int popNode(const struct Tree* tree, unsigned short heap[], int* size)
+{
+  int top = heap[0];
+  int last = heap[--*size];
+  int parent = 0, child;
 
-  return head;
+  while((child = 2 * parent + 1) < *size)
+  {
+    if(child + 1 < *size && comesFirst(tree, heap[child + 1], heap[child]))
+    {
+      child++;
+    }
+    if(!comesFirst(tree, heap[child], last))
+    {
+      break;
+    }
+    heap[parent] = heap[child];
+    parent = child;
+  }
+  heap[parent] = (unsigned short)last;
+  return top;
 }
 
 /************************************************************/
-/* Builds a Huffman tree.                                   */
-/* in -- a pointer to a node that is the head of a priority */
-/*       queue                                              */
-/* out -- top node of the Huffman tree                      */
+/* Builds a Huffman tree in the given block of nodes.       */
+/* Leaves and merged nodes wait in a binary heap instead of */
+/* a sorted list, which gives the same tree as the list     */
+/* with O(log n) work per merge, and no allocation at all.  */
+/* in -- tree to build in, frequency of each symbol, 0 for  */
+/*       unused symbols                                     */
+/* out -- TRUE if the tree has a root, FALSE if no symbol   */
+/*        is used                                           */
 /************************************************************/
-struct Node* buildTree(struct Node* head)
+int buildTree(struct Tree* tree, const unsigned long frequency[NUM_CHAR])
 {
-  
-  while(head && head->next)
+  unsigned short heap[NUM_CHAR];
+  int size = 0, left, right, top, i;
+
+  /* slot 0 is kept for the root */
+  tree->used = 1;
+  for(i = 0; i < NUM_CHAR; i++)
+  {
+    if(frequency[i] > 0)
+    {
+      size = pushNode(tree, heap, size,
+                      addNode(tree, (unsigned char)i, frequency[i]));
+    }
+  }
+  if(size == 0)
+  {
+    tree->used = 0;
+    return FALSE;
+  }
+
+  while(size > 1)
   {
-    struct Node* left;
-    struct Node* right;
-    struct Node* top;
-    
-    left = head;
-    head = head->next;
-    left->next = NULL;
-    right = head;
-    head = head->next;
-    right->next = NULL;
+    left = popNode(tree, heap, &size);
+    right = popNode(tree, heap, &size);
 
-    top = createNode(left->symbol, left->frequency + right->frequency);
-    top->left = left;
-    top->right = right;
-    head = insertSorted(head, top);
+    top = addNode(tree, tree->nodes[left].symbol,
+                  tree->nodes[left].frequency + tree->nodes[right].frequency);
+    tree->nodes[top].left = (unsigned short)left;
+    tree->nodes[top].right = (unsigned short)right;
+    size = pushNode(tree, heap, size, top);
   }
-  return head;
+
+  /* move the root to the front */
+  tree->nodes[ROOT] = tree->nodes[heap[0]];
+  return TRUE;
 }
 
 /***********************************/
 /* Frees memory used by a tree.    */
-/* in -- pointer to a struct node. */
+/* in -- pointer to the tree       */
 /* out -- void                     */
 /***********************************/
-void freeTree(struct Node* root)
+void freeTree(struct Tree* tree)
+{
+  free(tree);
+}
+
+/*************************************************************/
+/* Extracts code lengths from Huffman tree. The function is  */
+/* called recursively until it reaches a leaf; the length of */
+/* the leaf's code is its depth, and is stored in a table    */
+/* indexed by the leaf's character.                          */
+/* in -- tree, index of the node to start from, depth of     */
+/*       that node, array that receives the code length of   */
+/*       each leaf's symbol                                  */
+/* out -- void                                               */
+/*************************************************************/
+void extractCodes(const struct Tree* tree, int node, int treeLevel,
+                  unsigned char codeLength[NUM_CHAR])
+{
+  const struct Node* current = &tree->nodes[node];
+
+  /* adapted from geeksforgeeks.org/huffman-coding-greedy-algo-3 */
+  if(isLeaf(current))
+  {
+    codeLength[current->symbol] = (unsigned char)treeLevel;
+    return;
+  }
+  extractCodes(tree, current->left, treeLevel + 1, codeLength);
+  extractCodes(tree, current->right, treeLevel + 1, codeLength);
+}
+
+/* a symbol and its frequency, for sorting by frequency */
+struct Weight
+{
+  unsigned long frequency;
+  int symbol;
+};
+
+/***********************************************************/
+/* qsort comparison: by frequency, then by symbol.         */
+/* in -- pointers to two struct Weight                     */
+/* out -- negative, zero or positive as for qsort          */
+/***********************************************************/
+static int compareWeights(const void* a, const void* b)
+{
+  const struct Weight* x = a;
+  const struct Weight* y = b;
+
+  if(x->frequency != y->frequency)
+  {
+    return x->frequency < y->frequency ? -1 : 1;
+  }
+  return x->symbol - y->symbol;
+}
+
+/***************************************************************/
+/* Finds optimal code lengths of at most maxLength bits with   */
+/* the package-merge algorithm. Every level, from the deepest  */
+/* up, is the sorted symbols merged with pairs ("packages") of */
+/* the first items of the level below; the cheapest 2n - 2     */
+/* items of the top level are kept. Walking back down, each    */
+/* level contributes one bit to the symbols it kept as leaves, */
+/* which are always the lightest ones, and hands twice the     */
+/* number of packages it kept to the level below.              */
+/* in -- frequency of each symbol, longest length allowed, at  */
+/*       least enough for 2^maxLength to cover the symbols     */
+/*       used, array that receives the code lengths            */
+/* out -- void                                                 */
+/***************************************************************/
+void limitCodeLengths(const unsigned long frequency[NUM_CHAR], int maxLength,
+                      unsigned char codeLength[NUM_CHAR])
 {
-  if(root == NULL)
+  struct Weight leaf[NUM_CHAR];
+  unsigned long weight[2][2 * NUM_CHAR];
+  unsigned char isPackage[MAX_CODE_LENGTH][2 * NUM_CHAR];
+  int size[MAX_CODE_LENGTH];
+  unsigned long package;
+  int n = 0, level, i, j, k, keep, leaves;
+
+  for(i = 0; i < NUM_CHAR; i++)
   {
+    codeLength[i] = 0;
+    if(frequency[i] > 0)
+    {
+      leaf[n].frequency = frequency[i];
+      leaf[n].symbol = i;
+      n++;
+    }
+  }
+  if(n < 2)
+  {
+    if(n == 1)
+    {
+      codeLength[leaf[0].symbol] = 1;
+    }
     return;
   }
-  freeTree(root->left);
-  freeTree(root->right);
-  free(root);
+  qsort(leaf, n, sizeof(struct Weight), compareWeights);
+
+  /* level maxLength - 1 is the deepest, level 0 the top */
+  for(i = 0; i < n; i++)
+  {
+    weight[(maxLength - 1) & 1][i] = leaf[i].frequency;
+    isPackage[maxLength - 1][i] = FALSE;
+  }
+  size[maxLength - 1] = n;
+  for(level = maxLength - 2; level >= 0; level--)
+  {
+    const unsigned long* below = weight[(level + 1) & 1];
+    unsigned long* here = weight[level & 1];
+    i = j = k = 0;
+    while(i < n || j + 1 < size[level + 1])
+    {
+      package = j + 1 < size[level + 1] ? below[j] + below[j + 1] : 0;
+      if(j + 1 >= size[level + 1] || (i < n && leaf[i].frequency <= package))
+      {
+        here[k] = leaf[i++].frequency;
+        isPackage[level][k++] = FALSE;
+      }
+      else
+      {
+        here[k] = package;
+        isPackage[level][k++] = TRUE;
+        j += 2;
+      }
+    }
+    size[level] = k;
+  }
+
+  keep = 2 * n - 2;
+  for(level = 0; level < maxLength && keep > 0; level++)
+  {
+    leaves = 0;
+    for(i = 0; i < keep; i++)
+    {
+      leaves += !isPackage[level][i];
+    }
+    for(i = 0; i < leaves; i++)
+    {
+      codeLength[leaf[i].symbol]++;
+    }
+    keep = 2 * (keep - leaves);
+  }
 }
 
+/***************************************************************/
+/* Works out the code length of every symbol from a Huffman    */
+/* tree, then, if a code came out longer than maxLength, uses  */
+/* limitCodeLengths instead. A lone symbol gets a 1-bit code.  */
+/* in -- block of nodes to build the tree in, frequency of     */
+/*       each symbol, longest code allowed (raised if too      */
+/*       short for the number of symbols used, and at most     */
+/*       MAX_CODE_LENGTH), array that receives the lengths     */
+/* out -- void                                                 */
+/***************************************************************/
+void buildCodeLengths(struct Tree* tree, const unsigned long frequency[NUM_CHAR],
+                      int maxLength, unsigned char codeLength[NUM_CHAR])
+{
+  int used = 0, longest = 0, i;
 
+  memset(codeLength, 0, NUM_CHAR);
+  if(!buildTree(tree, frequency))
+  {
+    return;
+  }
+  extractCodes(tree, ROOT, 0, codeLength);
+  if(isLeaf(&tree->nodes[ROOT]))
+  {
+    codeLength[tree->nodes[ROOT].symbol] = 1;
+    return;
+  }
 
+  for(i = 0; i < NUM_CHAR; i++)
+  {
+    used += frequency[i] > 0;
+    if(codeLength[i] > longest)
+    {
+      longest = codeLength[i];
+    }
+  }
+  if(maxLength > MAX_CODE_LENGTH)
+  {
+    maxLength = MAX_CODE_LENGTH;
+  }
+  while(maxLength < 8 && (1 << maxLength) < used)
+  {
+    maxLength++;
+  }
+  if(longest > maxLength)
+  {
+    limitCodeLengths(frequency, maxLength, codeLength);
+  }
+}
+
+/*******************************************************/
+/* Reads the symbol/frequency pairs of a legacy header */
+/* and rebuilds the Huffman tree from them. A header   */
+/* cut short, or one that counts more encoded symbols  */
+/* than its frequencies add up to, is damaged; so is   */
+/* any file that is not an encoded file at all but     */
+/* does not start with MAGIC_0, as it is read as one.  */
+/* in -- input positioned after the number of symbols, */
+/*       number of symbols, pointers where the number  */
+/*       of encoded symbols and the tree are stored,   */
+/*       the tree NULL if there are no symbols         */
+/* out -- 0, or -1 if the header is damaged or memory  */
+/*        ran out                                      */
+/*******************************************************/
+static int readTree(struct Input* in, unsigned char uniqueChar,
+                    unsigned long* totalChar, struct Tree** tree)
+{
+  unsigned long frequencyAll[NUM_CHAR] = {0};
+  unsigned char symbol;
+  unsigned long frequency, sum = 0;
+  int i;
+
+  *tree = NULL;
+  for(i = 0; i < uniqueChar; i++)
+  {
+    if(readBytes(in, &symbol, sizeof(unsigned char))
+       != sizeof(unsigned char)
+       || readBytes(in, (unsigned char*)&frequency, sizeof(unsigned long))
+          != sizeof(unsigned long))
+    {
+      return -1;
+    }
+    sum -= frequencyAll[symbol];
+    frequencyAll[symbol] = frequency;
+    sum += frequency;
+    if(sum < frequency)
+    {
+      /* the frequencies overflow, which no encoder wrote */
+      return -1;
+    }
+  }
+  if(readBytes(in, (unsigned char*)totalChar, sizeof(unsigned long))
+     != sizeof(unsigned long)
+     || *totalChar > sum)
+  {
+    return -1;
+  }
+
+  *tree = allocateTree();
+  if(*tree == NULL)
+  {
+    return -1;
+  }
+  if(!buildTree(*tree, frequencyAll))
+  {
+    freeTree(*tree);
+    *tree = NULL;
+  }
+  return 0;
+}
+
+/***************************************************************/
+/* Assigns canonical codes: symbols are ordered by code length */
+/* then by symbol value, and each code is the previous one     */
+/* plus one, shifted left whenever the length grows.           */
+/* in -- code length of each symbol (0 if the symbol is        */
+/*       unused), array that receives the code of each symbol  */
+/*       in its low codeLength bits                            */
+/* out -- void                                                 */
+/***************************************************************/
+void canonicalCodes(const unsigned char codeLength[NUM_CHAR],
+                    uint64_t code[NUM_CHAR])
+{
+  unsigned int count[MAX_CODE_LENGTH + 1] = {0};
+  uint64_t next[MAX_CODE_LENGTH + 1];
+  uint64_t value = 0;
+  int i, length;
+
+  for(i = 0; i < NUM_CHAR; i++)
+  {
+    count[codeLength[i]]++;
+  }
+  count[0] = 0;
+  for(length = 1; length <= MAX_CODE_LENGTH; length++)
+  {
+    value = (value + count[length - 1]) << 1;
+    next[length] = value;
+  }
+  for(i = 0; i < NUM_CHAR; i++)
+  {
+    if(codeLength[i] > 0)
+    {
+      code[i] = next[codeLength[i]]++;
+    }
+    else
+    {
+      code[i] = 0;
+    }
+  }
+}
+
+/********************************************************/
+/* Fills a code table with the canonical codes of the   */
+/* given lengths.                                       */
+/* in -- code length of each symbol, table to fill      */
+/* out -- void                                          */
+/********************************************************/
+void buildCodeTable(const unsigned char codeLength[NUM_CHAR],
+                    struct CodeTable* table)
+{
+  canonicalCodes(codeLength, table->code);
+  memcpy(table->length, codeLength, sizeof(table->length));
+}
+
+/*****************************************************/
+/* Stores a 64-bit word big endian, so that the most */
+/* significant bit is the next bit of the stream.    */
+/* in -- where to store eight bytes, word to store   */
+/* out -- void                                       */
+/*****************************************************/
+static void storeBits(unsigned char* dst, uint64_t bits)
+{
+  dst[0] = (unsigned char)(bits >> 56);
+  dst[1] = (unsigned char)(bits >> 48);
+  dst[2] = (unsigned char)(bits >> 40);
+  dst[3] = (unsigned char)(bits >> 32);
+  dst[4] = (unsigned char)(bits >> 24);
+  dst[5] = (unsigned char)(bits >> 16);
+  dst[6] = (unsigned char)(bits >> 8);
+  dst[7] = (unsigned char)bits;
+}
+
+/**********************************************************/
+/* Appends the codes of a run of symbols to a bit writer. */
+/* Each code is ORed into the accumulator below the bits  */
+/* already pending, then the whole accumulator is stored  */
+/* and the pointer advanced past the complete bytes, so   */
+/* at most 7 bits are left pending and any code of up to  */
+/* 57 bits fits. Longer codes go in two halves.           */
+/* in -- code table, symbols and their number, writer     */
+/*       whose output has room for the encoded bytes plus */
+/*       ENCODE_PAD                                       */
+/* out -- void                                            */
+/**********************************************************/
+void encodeSymbols(const struct CodeTable* table, const unsigned char* src,
+                   unsigned long n, struct BitWriter* writer)
+{
+  unsigned char* next = writer->next;
+  uint64_t bits = writer->bits;
+  int count = writer->count;
+  uint64_t code;
+  int length, part;
+  unsigned long i;
+
+  for(i = 0; i < n; i++)
+  {
+    code = table->code[src[i]];
+    length = table->length[src[i]];
+    if(length > 32)
+    {
+      part = length - 32;
+      bits |= (code >> 32) << (64 - count - part);
+      count += part;
+      storeBits(next, bits);
+      next += count >> 3;
+      bits <<= count & ~7;
+      count &= 7;
+      code &= 0xffffffffu;
+      length = 32;
+    }
+    bits |= code << (64 - count - length);
+    count += length;
+    storeBits(next, bits);
+    next += count >> 3;
+    bits <<= count & ~7;
+    count &= 7;
+  }
+
+  writer->next = next;
+  writer->bits = bits;
+  writer->count = count;
+}
+
+/**********************************************************/
+/* Appends the codes of symbols to a bit writer, each     */
+/* from the table its previous symbol selects; the first  */
+/* symbol of a block follows context 0. Works like        */
+/* encodeSymbols otherwise.                               */
+/* in -- context model, symbols and their number, writer  */
+/*       whose output has room for the encoded bytes plus */
+/*       ENCODE_PAD                                       */
+/* out -- void                                            */
+/**********************************************************/
+void encodeContextSymbols(const struct ContextModel* model,
+                          const unsigned char* src, unsigned long n,
+                          struct BitWriter* writer)
+{
+  const struct CodeTable* table[NUM_CHAR];
+  const struct CodeTable* codes;
+  unsigned char* next = writer->next;
+  uint64_t bits = writer->bits;
+  int count = writer->count;
+  uint64_t code;
+  int length, part, prev = 0;
+  unsigned long i;
+
+  for(i = 0; i < NUM_CHAR; i++)
+  {
+    table[i] = &model->codes[model->map[i]];
+  }
+  for(i = 0; i < n; i++)
+  {
+    codes = table[prev];
+    prev = src[i];
+    code = codes->code[prev];
+    length = codes->length[prev];
+    if(length > 32)
+    {
+      part = length - 32;
+      bits |= (code >> 32) << (64 - count - part);
+      count += part;
+      storeBits(next, bits);
+      next += count >> 3;
+      bits <<= count & ~7;
+      count &= 7;
+      code &= 0xffffffffu;
+      length = 32;
+    }
+    bits |= code << (64 - count - length);
+    count += length;
+    storeBits(next, bits);
+    next += count >> 3;
+    bits <<= count & ~7;
+    count &= 7;
+  }
+
+  writer->next = next;
+  writer->bits = bits;
+  writer->count = count;
+}
+
+/**********************************************************/
+/* Stores the bits left in a writer, padding the last     */
+/* byte with zeros.                                       */
+/* in -- writer                                           */
+/* out -- void                                            */
+/**********************************************************/
+void flushBits(struct BitWriter* writer)
+{
+  if(writer->count > 0)
+  {
+    *writer->next++ = (unsigned char)(writer->bits >> 56);
+    writer->bits = 0;
+    writer->count = 0;
+  }
+}
+
+/*********************************************************/
+/* Writes a code length table. The lengths are stored    */
+/* either as a list of symbol/length pairs, or for the   */
+/* range of symbols from the first to the last one used, */
+/* packed two per byte when they all fit in four bits;   */
+/* whichever is smaller.                                 */
+/* in -- where to write, at most LENGTHS_MAX_SIZE bytes, */
+/*       code length of each symbol                      */
+/* out -- number of bytes written                        */
+/*********************************************************/
+int writeLengths(unsigned char* dst, const unsigned char codeLength[NUM_CHAR])
+{
+  unsigned char flags = PACKED_LENGTHS;
+  int first = -1, last = 0, used = 0, rangeSize, i, n;
+
+  for(i = 0; i < NUM_CHAR; i++)
+  {
+    if(codeLength[i] > 0)
+    {
+      if(first < 0)
+      {
+        first = i;
+      }
+      last = i;
+      used++;
+      if(codeLength[i] > 15)
+      {
+        flags = 0;
+      }
+    }
+  }
+  if(first < 0)
+  {
+    first = 0;
+  }
+  rangeSize = last - first + 1;
+  if(flags & PACKED_LENGTHS)
+  {
+    rangeSize = (rangeSize + 1) / 2;
+  }
+
+  n = 0;
+  if(used > 0 && 1 + 2 * used < 2 + rangeSize)
+  {
+    dst[n++] = SPARSE_LENGTHS;
+    dst[n++] = (unsigned char)(used - 1);
+    for(i = first; i <= last; i++)
+    {
+      if(codeLength[i] > 0)
+      {
+        dst[n++] = (unsigned char)i;
+        dst[n++] = codeLength[i];
+      }
+    }
+  }
+  else
+  {
+    dst[n++] = flags;
+    dst[n++] = (unsigned char)first;
+    dst[n++] = (unsigned char)last;
+    for(i = first; i <= last; i++)
+    {
+      if(!(flags & PACKED_LENGTHS))
+      {
+        dst[n++] = codeLength[i];
+      }
+      else if((i - first) & 1)
+      {
+        dst[n - 1] |= codeLength[i];
+      }
+      else
+      {
+        dst[n++] = (unsigned char)(codeLength[i] << 4);
+      }
+    }
+  }
+  return n;
+}
+
+/*********************************************************/
+/* Checks that code lengths describe a prefix code: no   */
+/* length is too long and the lengths do not claim more  */
+/* codes than there is room for.                         */
+/* in -- code length of each symbol                      */
+/* out -- TRUE if a decode table can be built from them  */
+/*********************************************************/
+static int validLengths(const unsigned char codeLength[NUM_CHAR])
+{
+  unsigned int count[NUM_CHAR] = {0};
+  long left = 1;
+  int i, length;
+
+  for(i = 0; i < NUM_CHAR; i++)
+  {
+    count[codeLength[i]]++;
+  }
+  for(length = 1; length < NUM_CHAR; length++)
+  {
+    if(length > MAX_CODE_LENGTH && count[length] > 0)
+    {
+      return FALSE;
+    }
+    /* once there is room for more codes than symbols the */
+    /* code can no longer overflow, so stop doubling      */
+    if(left <= NUM_CHAR)
+    {
+      left <<= 1;
+    }
+    left -= count[length];
+    if(left < 0)
+    {
+      return FALSE;
+    }
+  }
+  return TRUE;
+}
+
+/*********************************************************/
+/* Works out how many bytes of lengths follow the start  */
+/* of a code length table.                               */
+/* in -- flags, first symbol or number of pairs minus    */
+/*       one, last symbol                                */
+/* out -- number of bytes                                */
+/*********************************************************/
+static int lengthsBodySize(int flags, int first, int last)
+{
+  if(flags & SPARSE_LENGTHS)
+  {
+    return 2 * (first + 1);
+  }
+  if(flags & PACKED_LENGTHS)
+  {
+    return (last - first + 2) / 2;
+  }
+  return last - first + 1;
+}
+
+/*********************************************************/
+/* Reads a code length table written by writeLengths and */
+/* checks that the lengths form a prefix code.           */
+/* in -- the table, number of bytes available, array     */
+/*       that receives the code length of each symbol    */
+/* out -- number of bytes the table took, -1 if it is    */
+/*        damaged or runs past the bytes available       */
+/*********************************************************/
+int readLengths(const unsigned char* src, unsigned long available,
+                unsigned char codeLength[NUM_CHAR])
+{
+  int flags, first, last, start, n, i;
+
+  memset(codeLength, 0, NUM_CHAR);
+  if(available < 2)
+  {
+    return -1;
+  }
+  flags = src[0];
+  first = src[1];
+  last = first;
+  start = 2;
+  if(!(flags & SPARSE_LENGTHS))
+  {
+    if(available < 3)
+    {
+      return -1;
+    }
+    last = src[2];
+    start = 3;
+  }
+  if(first > last)
+  {
+    return -1;
+  }
+  n = lengthsBodySize(flags, first, last);
+  if((unsigned long)(start + n) > available)
+  {
+    return -1;
+  }
+  src += start;
+
+  for(i = 0; i < n; i++)
+  {
+    if(flags & SPARSE_LENGTHS)
+    {
+      codeLength[src[i]] = src[i + 1];
+      i++;
+    }
+    else if(flags & PACKED_LENGTHS)
+    {
+      codeLength[first + 2 * i] = src[i] >> 4;
+      if(first + 2 * i + 1 <= last)
+      {
+        codeLength[first + 2 * i + 1] = src[i] & 15;
+      }
+    }
+    else
+    {
+      codeLength[first + i] = src[i];
+    }
+  }
+
+  return validLengths(codeLength) ? start + n : -1;
+}
+
+/*********************************************************/
+/* Reads the header of an encoded file. For the block    */
+/* and adaptive formats that is only the magic and       */
+/* version; legacy headers are turned into a tree, which */
+/* the caller must free.                                 */
+/* in -- input positioned at the start of the header,    */
+/*       header to fill                                  */
+/* out -- 0 on success, -1 for an unknown version or a   */
+/*        damaged header                                 */
+/*********************************************************/
+int readHeader(struct Input* in, struct Header* header)
+{
+  unsigned char bytes[LENGTHS_MAX_SIZE];
+  unsigned long got;
+
+  header->version = LEGACY_VERSION;
+  header->totalChar = 0;
+  header->tree = NULL;
+
+  if(readBytes(in, bytes, 1) != 1)
+  {
+    return 0;
+  }
+  if(bytes[0] != MAGIC_0)
+  {
+    return readTree(in, bytes[0], &header->totalChar, &header->tree);
+  }
+  got = readBytes(in, bytes + 1, 3);
+  if(got != 3 || bytes[1] != MAGIC_1 || bytes[2] != MAGIC_2)
+  {
+    /* a legacy file whose symbol count is 0, and the bytes */
+    /* read so far are the start of totalChar. The count    */
+    /* wraps to 0 both for an empty file and for one that   */
+    /* uses all 256 symbols; the latter was written without */
+    /* its frequencies and cannot be decoded                */
+    got += readBytes(in, bytes + 1 + got, sizeof(unsigned long) - got);
+    memcpy(&header->totalChar, bytes + 1, sizeof(unsigned long));
+    return got == sizeof(unsigned long) && header->totalChar == 0 ? 0 : -1;
+  }
+
+  header->version = bytes[3];
+  return header->version == FORMAT_VERSION
+         || header->version == ADAPTIVE_VERSION ? 0 : -1;
+}
@@ -11,64 +11,1539 @@
 #ifndef HUFFMAN_H
 #define HUFFMAN_H
 #include <stdio.h>
+#include <stdint.h>
+
+#define NUM_CHAR 256
+
+/* first bytes of an encoded file in the newer formats,   */
+/* followed by a version byte. Files written before the   */
+/* version byte existed start with the number of symbols, */
+/* which is never zero followed by 'H'.                   */
+#define MAGIC_0 0
+#define MAGIC_1 'H'
+#define MAGIC_2 'F'
+
+/* versions 2 and 3 were development formats, no longer */
+/* read                                                  */
+#define LEGACY_VERSION 1
+#define FORMAT_VERSION 4
+
+/* an adaptive file, written by encodeAdaptiveFile, is a  */
+/* single stream of codes from a tree that encoder and    */
+/* decoder update after every symbol, so it needs no code */
+/* lengths and no second pass. A symbol not yet seen is   */
+/* the code of the escape leaf followed by its byte in    */
+/* ADAPTIVE_ESCAPE_BITS bits; the escape is also followed */
+/* by ADAPTIVE_FLUSH, after which the stream goes on at   */
+/* the next whole byte, or by ADAPTIVE_END, after which   */
+/* the next whole bytes are the number of bytes the       */
+/* stream decodes to as a 64-bit little endian number.    */
+#define ADAPTIVE_VERSION 5
+#define ADAPTIVE_ESCAPE_BITS 9
+#define ADAPTIVE_END NUM_CHAR
+#define ADAPTIVE_FLUSH (NUM_CHAR + 1)
+
+/* a file in the current format is a sequence of blocks, each */
+/* with a BLOCK_HEADER_SIZE byte header: the block type, then */
+/* the number of bytes the block decodes to and the number of */
+/* bytes of block body that follow, as 32-bit little endian   */
+/* numbers. A BLOCK_RAW block holds its bytes as they are,   */
+/* and a BLOCK_RUN block is a single byte repeated rawSize    */
+/* times, with that byte as its body.                         */
+/* A BLOCK_END block closes the file; from                    */
+/* FORMAT_VERSION on, its body is the number of bytes the     */
+/* whole file decodes to as a 64-bit little endian number,    */
+/* so that a file of any size is checked end to end.          */
+/* A BLOCK_INDEX block, if the file has one, comes just       */
+/* before the end block. Its rawSize is 0 and its body holds  */
+/* an INDEX_ENTRY_SIZE byte entry for every block: the number */
+/* of decoded bytes before the block and the offset of its    */
+/* header from the start of the file, as 64-bit little endian */
+/* numbers. The rawSize of the end block is then the size of  */
+/* the whole index block, header included, so a reader finds  */
+/* the index from the end of the file without reading the     */
+/* blocks; it is 0 when there is no index.                    */
+#define BLOCK_HEADER_SIZE 9
+#define END_BODY_SIZE 8
+#define END_BLOCK_SIZE (BLOCK_HEADER_SIZE + END_BODY_SIZE)
+#define BLOCK_END 0
+#define BLOCK_HUFFMAN 1
+#define BLOCK_HUFFMAN_STREAMS 2
+#define BLOCK_RAW 3
+#define BLOCK_RUN 4
+#define BLOCK_HUFFMAN_CONTEXT 5
+#define BLOCK_INDEX 6
+#define INDEX_ENTRY_SIZE 16
+
+/* a BLOCK_HUFFMAN_CONTEXT block codes each byte with one of */
+/* up to CONTEXT_TABLES code tables, chosen by the byte      */
+/* before it (0 before the first byte of the block). Its     */
+/* body is the number of tables, a context map of one nibble */
+/* per previous byte, low nibble first, the length table of  */
+/* every table, then a single bitstream.                     */
+#define CONTEXT_TABLES 8
+#define CONTEXT_MAP_SIZE (NUM_CHAR / 2)
+
+/* smallest block worth modelling with contexts */
+#define MIN_CONTEXT_SIZE 4096
+
+/* a BLOCK_HUFFMAN_STREAMS block cuts its input into STREAMS */
+/* equal parts, the last one shorter, coded as separate      */
+/* bitstreams with the same codes. After the length table,   */
+/* a jump table gives the size of every stream but the last  */
+/* as 24-bit little endian numbers, so the decoder can read  */
+/* all of them at once.                                      */
+#define STREAMS 4
+#define JUMP_TABLE_SIZE (3 * (STREAMS - 1))
+
+/* smallest block worth splitting into streams */
+#define MIN_STREAMS_SIZE 1024
+
+#define DEFAULT_BLOCK_SIZE (256 * 1024)
+#define MAX_BLOCK_SIZE (16 * 1024 * 1024)
+
+/* most threads the programs accept for -T */
+#define MAX_THREADS 256
+
+/* longest code length table writeLengths can produce */
+#define LENGTHS_MAX_SIZE (2 + 2 * NUM_CHAR)
+
+/* a trained table file starts with MAGIC_0, MAGIC_1,    */
+/* TABLE_MAGIC and TABLE_VERSION, then the table id as a */
+/* 32-bit little endian number and the length table.     */
+/* A message coded with it holds the table id, the       */
+/* number of bytes it decodes to as a little endian      */
+/* base-128 varint, and the codes, without any header.   */
+#define TABLE_MAGIC 'T'
+#define TABLE_VERSION 1
+#define TABLE_MAX_SIZE (8 + LENGTHS_MAX_SIZE)
+#define MESSAGE_HEADER_MAX_SIZE (4 + 10)
+
+/* longest code a canonical code table can describe */
+#define MAX_CODE_LENGTH 64
+
+/* width of the primary decode table; codes up to this */
+/* many bits are decoded with a single table probe      */
+#define DECODE_BITS 11
+
+/* zero bytes that must be readable past the end of a  */
+/* buffer handed to decodeTree or decodeTable           */
+#define DECODE_PAD 8
+
+/********************************************************/
+/* A node of a Huffman tree. Children are indices into  */
+/* the nodes of the tree; the root is never a child, so */
+/* index 0 means no child.                              */
+/********************************************************/
+struct Node
+{
+  unsigned long frequency;
+  unsigned short left;
+  unsigned short right;
+  unsigned char symbol;
+};
+
+/* index of the root in the nodes of a tree */
+#define ROOT 0
+
+/********************************************************/
+/* All nodes of one Huffman tree in a single block, the */
+/* root first. used counts the slots handed out.        */
+/********************************************************/
+struct Tree
+{
+  struct Node nodes[2 * NUM_CHAR];
+  int used;
+};
+
+/*******************************************************/
+/* Lookup table for decoding. Each entry is indexed by */
+/* the next DECODE_BITS bits of the stream and holds   */
+/* the symbol in the low byte and the code length in   */
+/* the high byte. A length of zero means the code is   */
+/* longer than DECODE_BITS. Such codes are found by    */
+/* walking the tree, or, when there is no              */
+/* tree, from the number of codes of each length and   */
+/* the symbols sorted by code.                         */
+/*******************************************************/
+struct DecodeTable
+{
+  unsigned short entry[1 << DECODE_BITS];
+  const struct Tree* tree;
+  unsigned short count[MAX_CODE_LENGTH + 1];
+  unsigned char sorted[NUM_CHAR];
+};
+
+/* most symbols one probe of a multi-symbol table gives */
+#define MULTI_SYMBOLS 4
+
+/* smallest block worth building a multi-symbol table for */
+#define MIN_MULTI_SIZE 4096
+
+/********************************************************/
+/* Entry of a multi-symbol decode table: the symbols    */
+/* whose codes all fit in the DECODE_BITS bits that     */
+/* index it, up to MULTI_SYMBOLS of them, and the bits  */
+/* of their codes. A count of zero means the first code */
+/* is longer than DECODE_BITS.                          */
+/********************************************************/
+struct MultiEntry
+{
+  unsigned char symbol[MULTI_SYMBOLS];
+  unsigned char count;
+  unsigned char length;
+};
+
+/********************************************************/
+/* Lookup table for decoding several short codes with   */
+/* one probe, made from a DecodeTable.                  */
+/********************************************************/
+struct MultiTable
+{
+  struct MultiEntry entry[1 << DECODE_BITS];
+};
+
+/* widest table of a decode kernel, and the number of kernels */
+#define KERNEL_MAX_BITS 12
+#define NUM_KERNELS 16
+
+/* table width of the kernels for codes that may not fit */
+#define LONG_KERNEL_BITS 11
+
+/* smallest block worth picking a decode kernel for */
+#define MIN_KERNEL_SIZE 4096
+
+/********************************************************/
+/* Lookup table of a decode kernel, as many bits wide   */
+/* as the kernel, with entries like those of a          */
+/* DecodeTable, and the longest code.                   */
+/********************************************************/
+struct KernelTable
+{
+  unsigned short entry[1 << KERNEL_MAX_BITS];
+  int maxLength;
+};
+
+/********************************************************/
+/* A decode kernel: a copy of the table decoder made    */
+/* for one table width and stream count, either for     */
+/* complete codes that all fit the table (short) or for */
+/* any codes (long). decode takes the same arguments as */
+/* decodeStreams, plus the kernel table, and reads only */
+/* as many streams as the kernel has.                   */
+/********************************************************/
+struct Kernel
+{
+  const char* name;
+  int bits;
+  int streams;
+  int shortCodes;
+  unsigned long (*decode)(const struct DecodeTable* table,
+                          const struct KernelTable* kernel,
+                          const unsigned char* src,
+                          const unsigned long limit[STREAMS],
+                          unsigned long bitPos[STREAMS],
+                          unsigned char* const dst[STREAMS],
+                          const unsigned long count[STREAMS]);
+};
+
+/********************************************************/
+/* Canonical code of every symbol, indexed by symbol,   */
+/* with the code in the low length bits of code.        */
+/********************************************************/
+struct CodeTable
+{
+  uint64_t code[NUM_CHAR];
+  unsigned char length[NUM_CHAR];
+};
+
+/********************************************************/
+/* Order-1 model of a block: the code table each        */
+/* previous byte selects, and the tables themselves.    */
+/********************************************************/
+struct ContextModel
+{
+  int tables;
+  unsigned char map[NUM_CHAR];
+  unsigned char codeLength[CONTEXT_TABLES][NUM_CHAR];
+  struct CodeTable codes[CONTEXT_TABLES];
+};
+
+/********************************************************/
+/* A code trained once from sample data and shared by   */
+/* any number of messages. Every symbol has a code of   */
+/* at most DECODE_BITS bits, so any message can be      */
+/* coded and every code is decoded with one probe. id   */
+/* is a hash of the code lengths.                       */
+/********************************************************/
+struct StaticTable
+{
+  unsigned long id;
+  unsigned char codeLength[NUM_CHAR];
+  struct CodeTable codes;
+  struct DecodeTable decode;
+};
+
+/* leaves of an adaptive tree: the bytes and the escape, */
+/* and the nodes of a tree that has all of them          */
+#define ADAPTIVE_SYMBOLS (NUM_CHAR + 1)
+#define ADAPTIVE_NODES (2 * ADAPTIVE_SYMBOLS - 1)
+
+/* most bits encodeAdaptive writes for one symbol: the  */
+/* escape at the bottom of a tree of ADAPTIVE_SYMBOLS   */
+/* leaves, then the byte                                */
+#define ADAPTIVE_MAX_BITS (ADAPTIVE_SYMBOLS - 1 + ADAPTIVE_ESCAPE_BITS)
+
+/********************************************************/
+/* A Huffman tree updated one symbol at a time by the   */
+/* FGK algorithm. Nodes are numbered so that weight     */
+/* never decreases with the number, the root last;      */
+/* every array is indexed by that number.               */
+/* weight -- times the symbols below the node were seen */
+/* parent -- number of the parent                       */
+/* child -- number of the right child, the left being   */
+/*          the one below it, or -1 - symbol for a leaf */
+/* position -- number of the leaf of each symbol, the   */
+/*             escape last, -1 for symbols not yet seen */
+/********************************************************/
+struct AdaptiveTree
+{
+  uint64_t weight[ADAPTIVE_NODES];
+  short parent[ADAPTIVE_NODES];
+  short child[ADAPTIVE_NODES];
+  short position[ADAPTIVE_SYMBOLS];
+};
+
+/********************************************************/
+/* Where decodeAdaptive is in a stream, so that the     */
+/* stream can be decoded in pieces of any size.         */
+/* node -- node of the tree the bits so far lead to     */
+/* state -- reading a code, the bits after an escape,   */
+/*          the bytes of the size, or done              */
+/* count, value -- bits or bytes read after an escape   */
+/*                 and their value                      */
+/* decoded -- bytes decoded so far                      */
+/********************************************************/
+struct AdaptiveDecoder
+{
+  struct AdaptiveTree tree;
+  int node;
+  int state;
+  int count;
+  uint64_t value;
+  uint64_t decoded;
+};
+
+/* states of an adaptive decoder */
+#define ADAPTIVE_CODE 0
+#define ADAPTIVE_ESCAPE 1
+#define ADAPTIVE_SIZE 2
+#define ADAPTIVE_DONE 3
+
+/* bytes that encodeSymbols may write past the last */
+/* whole byte of output                             */
+#define ENCODE_PAD 8
+
+/********************************************************/
+/* Output side of an encoder: a 64-bit accumulator      */
+/* holding count pending bits at its top, and where the */
+/* next whole bytes go.                                 */
+/********************************************************/
+struct BitWriter
+{
+  unsigned char* next;
+  uint64_t bits;
+  int count;
+};
+
+/* bytes gathered before an output is written to its file */
+#define OUTPUT_BUFFER_SIZE (1024 * 1024)
+
+/*********************************************************/
+/* Where the time of encoding or decoding a file goes,   */
+/* gathered only when the code is built with HUFF_STATS. */
+/* Times are in seconds; the block phases are summed     */
+/* over every thread, so they can add up to more than    */
+/* blockSeconds.                                         */
+/* readSeconds, writeSeconds -- waiting for the input    */
+/*                             and output                */
+/* blockSeconds -- waiting for batches of blocks         */
+/* countSeconds -- counting symbols                      */
+/* treeSeconds -- building trees and code lengths        */
+/* tableSeconds -- filling code or decode tables         */
+/* bitsSeconds -- writing or reading codes               */
+/* bytesRead, bytesMapped -- input read or used where it */
+/*                           is mapped                   */
+/* bytesWritten -- output written                        */
+/* reads, writes -- reads of the input and buffers       */
+/*                  written                              */
+/* blocks -- blocks, storedBlocks of them raw or runs    */
+/* nodes -- tree nodes handed out                        */
+/* symbols, bits -- symbols in Huffman coded blocks and  */
+/*                  the bits of their codes              */
+/* fallbacks -- symbols with codes longer than           */
+/*              DECODE_BITS, which take a second probe   */
+/*********************************************************/
+struct Stats
+{
+  double readSeconds;
+  double writeSeconds;
+  double blockSeconds;
+  double countSeconds;
+  double treeSeconds;
+  double tableSeconds;
+  double bitsSeconds;
+  uint64_t bytesRead;
+  uint64_t bytesMapped;
+  uint64_t bytesWritten;
+  unsigned long reads;
+  unsigned long writes;
+  unsigned long blocks;
+  unsigned long storedBlocks;
+  unsigned long nodes;
+  uint64_t symbols;
+  uint64_t bits;
+  uint64_t fallbacks;
+};
+
+/* timers and counters that cost nothing, not even a */
+/* test for NULL, when HUFF_STATS is not defined     */
+#ifdef HUFF_STATS
+#define STATS_START(stats, start) \
+  ((start) = (stats) != NULL ? statsSeconds() : 0.0)
+#define STATS_TIME(stats, field, start) \
+  ((stats) != NULL ? (void)((stats)->field += statsSeconds() - (start)) \
+                   : (void)0)
+#define STATS_ADD(stats, field, n) \
+  ((stats) != NULL ? (void)((stats)->field += (n)) : (void)0)
+#else
+#define STATS_START(stats, start) ((start) = 0.0)
+#define STATS_TIME(stats, field, start) ((void)(start))
+#define STATS_ADD(stats, field, n) ((void)sizeof(n))
+#endif
+
+/*********************************************************/
+/* Seconds on a clock that keeps running while threads   */
+/* work or the process waits for I/O.                    */
+/* in -- void                                            */
+/* out -- seconds since some fixed time                  */
+/*********************************************************/
+double statsSeconds(void);
+
+/*********************************************************/
+/* Adds the times and counts of one set of stats to      */
+/* another.                                              */
+/* in -- stats to add to, stats to add                   */
+/* out -- void                                           */
+/*********************************************************/
+void addStats(struct Stats* total, const struct Stats* part);
+
+/*********************************************************/
+/* Counts the symbols of a decoded block whose codes are */
+/* longer than DECODE_BITS.                              */
+/* in -- code length of each symbol, the decoded bytes   */
+/*       and their number                                */
+/* out -- the number of such symbols                     */
+/*********************************************************/
+uint64_t countFallbacks(const unsigned char codeLength[NUM_CHAR],
+                        const unsigned char* src, unsigned long n);
+
+/*********************************************************/
+/* Prints stats as one line of JSON.                     */
+/* in -- file to print to, what was done ("encode" or    */
+/*       "decode"), the stats, seconds it all took       */
+/* out -- void                                           */
+/*********************************************************/
+void printStats(FILE* file, const char* mode, const struct Stats* stats,
+                double seconds);
+
+/* the threads that read ahead of an input and write */
+/* behind an output, see huffio.c                    */
+struct Reader;
+struct Writer;
+
+/*********************************************************/
+/* Where the encoder or decoder reads from, see huffio.c */
+/* fd -- file descriptor                                 */
+/* base, mapSize -- the whole mapping, NULL if the file  */
+/*                  is read instead                      */
+/* map, size -- the bytes from where reading started     */
+/* offset -- next byte of map to hand out                */
+/* prefetched -- how far into map the kernel has been    */
+/*               asked to read ahead                     */
+/* reader -- thread reading ahead when the file is read, */
+/*           NULL if it could not be started             */
+/* stats -- where reading, and encodeFile or decodeFile  */
+/*          run on this input, add their times and       */
+/*          counts; NULL after openInput                 */
+/*********************************************************/
+struct Input
+{
+  int fd;
+  void* base;
+  unsigned long mapSize;
+  const unsigned char* map;
+  unsigned long size;
+  unsigned long offset;
+  unsigned long prefetched;
+  struct Reader* reader;
+  struct Stats* stats;
+};
+
+/*********************************************************/
+/* Where the encoder or decoder writes to.               */
+/* fd -- file descriptor                                 */
+/* buffer, used -- bytes not yet written                 */
+/* failed -- TRUE once a write has failed                */
+/* writer -- thread writing full buffers while the next  */
+/*           one fills, NULL if it could not be started  */
+/* stats -- where writing adds its time and counts;      */
+/*          NULL after openOutput                        */
+/*********************************************************/
+struct Output
+{
+  int fd;
+  unsigned char* buffer;
+  unsigned long used;
+  int failed;
+  struct Writer* writer;
+  struct Stats* stats;
+};
+
+/********************************************************/
+/* Allocates a buffer aligned to a page.                */
+/* in -- number of bytes                                */
+/* out -- the buffer, freed with free, NULL on failure  */
+/********************************************************/
+unsigned char* allocateBuffer(unsigned long size);
+
+/********************************************************/
+/* Sets up reading from an open file, mapping it into   */
+/* memory when it is a regular file and otherwise       */
+/* starting a thread that reads ahead of the caller, so */
+/* that the file may be read past what is used.         */
+/* in -- input to set up, open file                     */
+/* out -- void                                          */
+/********************************************************/
+void openInput(struct Input* input, FILE* file);
+
+/********************************************************/
+/* Copies the next bytes of an input into a buffer.     */
+/* in -- input, buffer, number of bytes wanted          */
+/* out -- number of bytes copied, fewer only at the end */
+/*        of the input or on a read error               */
+/********************************************************/
+unsigned long readBytes(struct Input* input, unsigned char* buffer,
+                        unsigned long want);
+
+/********************************************************/
+/* Copies the bytes of an input that have arrived into  */
+/* a buffer, waiting only when none have.               */
+/* in -- input, buffer, most bytes wanted               */
+/* out -- number of bytes copied, 0 only at the end of  */
+/*        the input or on a read error                  */
+/********************************************************/
+unsigned long readSome(struct Input* input, unsigned char* buffer,
+                       unsigned long want);
+
+/********************************************************/
+/* Gives access to the next bytes of an input, followed */
+/* by pad readable bytes, without copying them when the */
+/* input is mapped.                                     */
+/* in -- input, buffer of want + pad bytes used when    */
+/*       the bytes have to be copied, number of bytes   */
+/*       wanted, pad, where to store the number of      */
+/*       bytes available                                */
+/* out -- pointer to the bytes, valid until the input   */
+/*        is closed or the buffer reused                */
+/********************************************************/
+const unsigned char* viewBytes(struct Input* input, unsigned char* buffer,
+                               unsigned long want, unsigned long pad,
+                               unsigned long* got);
+
+/********************************************************/
+/* Gives access to the rest of an input in one piece,   */
+/* mapped or read into a buffer.                        */
+/* in -- input, pointer that receives the buffer to     */
+/*       free (NULL when none was needed), where to     */
+/*       store the number of bytes                      */
+/* out -- pointer to the bytes, NULL if memory ran out  */
+/********************************************************/
+const unsigned char* viewAll(struct Input* input, unsigned char** buffer,
+                             unsigned long* size);
+
+/********************************************************/
+/* Skips the next bytes of an input.                    */
+/* in -- input, number of bytes to skip                 */
+/* out -- number of bytes skipped, fewer only at the    */
+/*        end of the input or on a read error           */
+/********************************************************/
+unsigned long skipBytes(struct Input* input, unsigned long n);
+
+/********************************************************/
+/* Releases the mapping of an input, or stops the       */
+/* thread reading it.                                   */
+/* in -- the input                                      */
+/* out -- void                                          */
+/********************************************************/
+void closeInput(struct Input* input);
+
+/********************************************************/
+/* Sets up writing to an open file, with a thread that  */
+/* writes each full buffer while the next one fills.    */
+/* in -- output to set up, open file, or NULL to give   */
+/*       it one later with switchOutput                 */
+/* out -- 0, or -1 if memory ran out                    */
+/********************************************************/
+int openOutput(struct Output* output, FILE* file);
+
+/********************************************************/
+/* Appends bytes to an output.                          */
+/* in -- output, bytes and their number                 */
+/* out -- void                                          */
+/********************************************************/
+void writeBytes(struct Output* output, const unsigned char* data,
+                unsigned long size);
+
+/********************************************************/
+/* Points an output at another open file, keeping its   */
+/* buffer, which must have been flushed.                */
+/* in -- output, open file                              */
+/* out -- void                                          */
+/********************************************************/
+void switchOutput(struct Output* output, FILE* file);
+
+/********************************************************/
+/* Writes what is left in an output, keeping its        */
+/* buffer.                                              */
+/* in -- the output                                     */
+/* out -- 0, or -1 if any write to the file failed      */
+/********************************************************/
+int flushOutput(struct Output* output);
+
+/********************************************************/
+/* Writes what is left in an output and frees its       */
+/* buffer.                                              */
+/* in -- the output                                     */
+/* out -- 0, or -1 if any write failed                  */
+/********************************************************/
+int closeOutput(struct Output* output);
+
+/********************************************************/
+/* What the header of an encoded file describes. Block  */
+/* files keep their code lengths in each block and      */
+/* adaptive files need none; legacy files carry         */
+/* frequencies, from which the tree is rebuilt.         */
+/********************************************************/
+struct Header
+{
+  int version;
+  unsigned long totalChar;
+  struct Tree* tree;
+};
+
+/*********************************************************/
+/* Counts how often each symbol occurs, spreading the    */
+/* counts over several tables so that runs of the same   */
+/* byte do not stall, with an AVX2 kernel chosen at run  */
+/* time where the CPU has it.                            */
+/* in -- bytes and their number, array that receives     */
+/*       the count of each symbol                        */
+/* out -- void                                           */
+/*********************************************************/
+void countSymbols(const unsigned char* src, unsigned long n,
+                  unsigned long frequency[NUM_CHAR]);
 
 /***************************************************************/
-/* Allocate a new node with given data.                        */
-/* in -- a character representing the symbol, an unsigned long */
-/*       representing the frequency at which the character     */
-/*       occurs in the input file                              */
-/* out -- a struct Node                                        */
+/* Allocates room for every node of one tree in a single block */
+/* of memory, so building and freeing a tree is one malloc and */
+/* one free.                                                   */
+/* in -- void                                                  */
+/* out -- pointer to the empty tree                            */
 /***************************************************************/
-struct Node* createNode(unsigned char symbol, unsigned long frequency);
+struct Tree* allocateTree(void);
 
-/**********************************************************/
-/* Insert data at appropriate place in a sorted list,     */
-/* return new list head.                                  */
-/* in -- a pointer to the head of the list, and a pointer */
-/*       to the newNode that will be added the the list   */
-/* out -- the head of the list, with the new node added   */
-/*        in the appropriate place                        */
-/**********************************************************/
-struct Node* insertSorted(struct Node* head, struct Node* newNode);
-
-/**************************************************************/
-/* Builds a Huffman tree.                                     */
-/* in -- a pointet to a node that is the head of a priority   */
-/*       queue                                                */
-/* out -- top node of the Huffman tree                        */
 /***************************************************************/
-struct Node* buildTree(struct Node* head);
+/* Hands out the next node of a tree, with given data and no   */
+/* children.                                                   */
+/* in -- pointer to the tree, a character representing the     */
+/*       symbol, an unsigned long representing the frequency   */
+/*       at which the character occurs in the input file       */
+/* out -- index of the new node                                */
+/***************************************************************/
+int addNode(struct Tree* tree, unsigned char symbol, unsigned long frequency);
 
+/************************************************************/
+/* Builds a Huffman tree in the given block of nodes.       */
+/* in -- tree to build in, frequency of each symbol, 0 for  */
+/*       unused symbols                                     */
+/* out -- TRUE if the tree has a root, FALSE if no symbol   */
+/*        is used                                           */
+/************************************************************/
+int buildTree(struct Tree* tree, const unsigned long frequency[NUM_CHAR]);
 
 /**********************************************************/
 /* Checks if a Node is a Leaf.                            */
 /* in -- pointer to a Node                                */
 /* out -- integer value representing either true or false */
 /**********************************************************/
-int isLeaf(struct Node* node);
-
+int isLeaf(const struct Node* node);
 
 /***********************************/
 /* Frees memory used by a tree.    */
-/* in -- pointer to a struct node. */ 
+/* in -- pointer to the tree       */
 /* out -- void                     */
 /***********************************/
-void freeTree(struct Node* root);
+void freeTree(struct Tree* tree);
+
+/*********************************************************/
+/* Sets up an adaptive tree holding only the escape.     */
+/* in -- the tree                                        */
+/* out -- void                                           */
+/*********************************************************/
+void initAdaptiveTree(struct AdaptiveTree* tree);
+
+/*********************************************************/
+/* Counts one more of a symbol in an adaptive tree,      */
+/* giving it a leaf first if it has none.                */
+/* in -- the tree, the symbol                            */
+/* out -- void                                           */
+/*********************************************************/
+void updateAdaptiveTree(struct AdaptiveTree* tree, int symbol);
+
+/*********************************************************/
+/* Most bytes encodeAdaptive and endAdaptive write for   */
+/* a number of symbols and one escape.                   */
+/* in -- number of symbols                               */
+/* out -- bound on the bytes written                     */
+/*********************************************************/
+unsigned long adaptiveBound(unsigned long rawSize);
+
+/*********************************************************/
+/* Appends the codes of symbols to a bit writer,         */
+/* updating the tree after each one.                     */
+/* in -- tree, symbols and their number, writer whose    */
+/*       output has room for adaptiveBound(n) bytes      */
+/* out -- void                                           */
+/*********************************************************/
+void encodeAdaptive(struct AdaptiveTree* tree, const unsigned char* src,
+                    unsigned long n, struct BitWriter* writer);
+
+/*********************************************************/
+/* Appends an escape to a bit writer, and the zero bits  */
+/* that take it to a whole byte.                         */
+/* in -- tree, ADAPTIVE_FLUSH or ADAPTIVE_END, writer    */
+/* out -- void                                           */
+/*********************************************************/
+void endAdaptive(const struct AdaptiveTree* tree, int escape,
+                 struct BitWriter* writer);
+
+/*********************************************************/
+/* Sets up an adaptive decoder at the start of a stream. */
+/* in -- the decoder                                     */
+/* out -- void                                           */
+/*********************************************************/
+void initAdaptiveDecoder(struct AdaptiveDecoder* decoder);
+
+/*********************************************************/
+/* Decodes the next piece of an adaptive stream, which   */
+/* may end anywhere, even inside a code.                 */
+/* in -- decoder, the bytes and their number, where to   */
+/*       write, room for 8 bytes per byte read, pointer  */
+/*       that receives the number of bytes written       */
+/* out -- 0, or -1 if the stream is damaged or goes on   */
+/*        past its end                                   */
+/*********************************************************/
+int decodeAdaptive(struct AdaptiveDecoder* decoder, const unsigned char* src,
+                   unsigned long size, unsigned char* dst,
+                   unsigned long* written);
+
+/*************************************************************/
+/* Extracts code lengths from Huffman tree: the length of a  */
+/* leaf's code is its depth.                                 */
+/* in -- tree, index of the node to start from, depth of     */
+/*       that node, array that receives the code length of   */
+/*       each leaf's symbol                                  */
+/* out -- void                                               */
+/*************************************************************/
+void extractCodes(const struct Tree* tree, int node, int treeLevel,
+                  unsigned char codeLength[NUM_CHAR]);
+
+/***************************************************************/
+/* Finds optimal code lengths of at most maxLength bits with   */
+/* the package-merge algorithm.                                */
+/* in -- frequency of each symbol, longest length allowed, at  */
+/*       least enough for 2^maxLength to cover the symbols     */
+/*       used, array that receives the code lengths            */
+/* out -- void                                                 */
+/***************************************************************/
+void limitCodeLengths(const unsigned long frequency[NUM_CHAR], int maxLength,
+                      unsigned char codeLength[NUM_CHAR]);
+
+/***************************************************************/
+/* Works out the code length of every symbol from a Huffman    */
+/* tree, falling back to limitCodeLengths if a code came out   */
+/* longer than maxLength. A lone symbol gets a 1-bit code.     */
+/* in -- block of nodes to build the tree in, frequency of     */
+/*       each symbol, longest code allowed (raised if too      */
+/*       short for the number of symbols used, and at most     */
+/*       MAX_CODE_LENGTH), array that receives the lengths     */
+/* out -- void                                                 */
+/***************************************************************/
+void buildCodeLengths(struct Tree* tree, const unsigned long frequency[NUM_CHAR],
+                      int maxLength, unsigned char codeLength[NUM_CHAR]);
+
+/***************************************************************/
+/* Assigns canonical codes: symbols are ordered by code length */
+/* then by symbol value, and each code is the previous one     */
+/* plus one, shifted left whenever the length grows.           */
+/* in -- code length of each symbol (0 if the symbol is        */
+/*       unused), array that receives the code of each symbol  */
+/*       in its low codeLength bits                            */
+/* out -- void                                                 */
+/***************************************************************/
+void canonicalCodes(const unsigned char codeLength[NUM_CHAR],
+                    uint64_t code[NUM_CHAR]);
+
+/********************************************************/
+/* Fills a code table with the canonical codes of the   */
+/* given lengths.                                       */
+/* in -- code length of each symbol, table to fill      */
+/* out -- void                                          */
+/********************************************************/
+void buildCodeTable(const unsigned char codeLength[NUM_CHAR],
+                    struct CodeTable* table);
+
+/**********************************************************/
+/* Appends the codes of a run of symbols to a bit writer. */
+/* Whole bytes are stored as soon as they are complete.   */
+/* in -- code table, symbols and their number, writer     */
+/*       whose output has room for the encoded bytes plus */
+/*       ENCODE_PAD                                       */
+/* out -- void                                            */
+/**********************************************************/
+void encodeSymbols(const struct CodeTable* table, const unsigned char* src,
+                   unsigned long n, struct BitWriter* writer);
+
+/**********************************************************/
+/* Stores the bits left in a writer, padding the last     */
+/* byte with zeros.                                       */
+/* in -- writer                                           */
+/* out -- void                                            */
+/**********************************************************/
+void flushBits(struct BitWriter* writer);
+
+/**********************************************************/
+/* Appends the codes of symbols to a bit writer like      */
+/* encodeSymbols, coding each symbol with the table its   */
+/* previous symbol selects.                               */
+/* in -- context model, symbols and their number, writer  */
+/*       whose output has room for the encoded bytes plus */
+/*       ENCODE_PAD                                       */
+/* out -- void                                            */
+/**********************************************************/
+void encodeContextSymbols(const struct ContextModel* model,
+                          const unsigned char* src, unsigned long n,
+                          struct BitWriter* writer);
+
+/*********************************************************/
+/* Writes a code length table, either as symbol/length   */
+/* pairs or for the range of symbols used, whichever is  */
+/* smaller.                                              */
+/* in -- where to write, at most LENGTHS_MAX_SIZE bytes, */
+/*       code length of each symbol                      */
+/* out -- number of bytes written                        */
+/*********************************************************/
+int writeLengths(unsigned char* dst, const unsigned char codeLength[NUM_CHAR]);
+
+/*********************************************************/
+/* Reads a code length table written by writeLengths and */
+/* checks that the lengths form a prefix code.           */
+/* in -- the table, number of bytes available, array     */
+/*       that receives the code length of each symbol    */
+/* out -- number of bytes the table took, -1 if it is    */
+/*        damaged or runs past the bytes available       */
+/*********************************************************/
+int readLengths(const unsigned char* src, unsigned long available,
+                unsigned char codeLength[NUM_CHAR]);
+
+/*********************************************************/
+/* Reads the header of an encoded file in any format.    */
+/* For block and adaptive files that is only the magic   */
+/* and version. Legacy headers are turned into a tree,   */
+/* which the caller must free.                           */
+/* in -- input positioned at the start of the header,    */
+/*       header to fill                                  */
+/* out -- 0 on success, -1 for an unknown version or a   */
+/*        damaged header                                 */
+/*********************************************************/
+int readHeader(struct Input* in, struct Header* header);
+
+/********************************************************/
+/* Fills a decode table from a Huffman tree.            */
+/* in -- the tree, table to fill                        */
+/* out -- void                                          */
+/********************************************************/
+void buildDecodeTable(const struct Tree* tree, struct DecodeTable* table);
+
+/********************************************************/
+/* Fills a decode table straight from canonical code    */
+/* lengths, without building a tree.                    */
+/* in -- code length of each symbol, table to fill      */
+/* out -- void                                          */
+/********************************************************/
+void buildCanonicalTable(const unsigned char codeLength[NUM_CHAR],
+                         struct DecodeTable* table);
+
+/********************************************************/
+/* Builds the Huffman tree that canonical code lengths  */
+/* describe, for decoding with decodeTree.              */
+/* in -- code length of each symbol                     */
+/* out -- the tree, freed with freeTree                 */
+/********************************************************/
+struct Tree* buildCanonicalTree(const unsigned char codeLength[NUM_CHAR]);
+
+/**********************************************************/
+/* Decodes symbols by walking the tree one bit at a time. */
+/* in -- the tree, encoded bytes (followed by             */
+/*       DECODE_PAD readable bytes), number of bytes in   */
+/*       which a code may start, bit position to start    */
+/*       at (updated on return), output buffer, maximum   */
+/*       number of symbols to decode                      */
+/* out -- number of symbols written to the output buffer  */
+/**********************************************************/
+unsigned long decodeTree(const struct Tree* tree, const unsigned char* src,
+                         unsigned long limit, unsigned long* bitPos,
+                         unsigned char* dst, unsigned long count);
+
+/**********************************************************/
+/* Decodes symbols with one table probe per symbol from a */
+/* 64-bit bit buffer. Takes the same arguments and stops  */
+/* under the same conditions as decodeTree.               */
+/* in -- decode table, see decodeTree for the rest        */
+/* out -- number of symbols written to the output buffer  */
+/**********************************************************/
+unsigned long decodeTable(const struct DecodeTable* table,
+                          const unsigned char* src,
+                          unsigned long limit, unsigned long* bitPos,
+                          unsigned char* dst, unsigned long count);
+
+/*********************************************************/
+/* Tells whether a multi-symbol table pays for itself:   */
+/* whether the codes, weighted as a Huffman code weights */
+/* them, average at most half the table width, so that   */
+/* a probe gives two symbols or more on average.         */
+/* in -- decode table made from canonical code lengths   */
+/* out -- TRUE or FALSE                                  */
+/*********************************************************/
+int multiTablePays(const struct DecodeTable* table);
+
+/*********************************************************/
+/* Fills a multi-symbol table from a decode table.       */
+/* in -- decode table, multi-symbol table to fill        */
+/* out -- void                                           */
+/*********************************************************/
+void buildMultiTable(const struct DecodeTable* table,
+                     struct MultiTable* multi);
+
+/**********************************************************/
+/* Decodes symbols like decodeTable, up to MULTI_SYMBOLS  */
+/* of them with each probe of a multi-symbol table.       */
+/* in -- decode table, multi-symbol table made from it,   */
+/*       see decodeTree for the rest                      */
+/* out -- number of symbols written to the output buffer  */
+/**********************************************************/
+unsigned long decodeMulti(const struct DecodeTable* table,
+                          const struct MultiTable* multi,
+                          const unsigned char* src,
+                          unsigned long limit, unsigned long* bitPos,
+                          unsigned char* dst, unsigned long count);
+
+/**********************************************************/
+/* Decodes the symbols of a context block like            */
+/* decodeTable, probing for each symbol the table that    */
+/* the symbol before it selects, starting from context 0. */
+/* in -- decode table of every context, see decodeTree    */
+/*       for the rest                                     */
+/* out -- number of symbols written to the output buffer  */
+/**********************************************************/
+unsigned long decodeContexts(const struct DecodeTable* const table[NUM_CHAR],
+                             const unsigned char* src,
+                             unsigned long limit, unsigned long* bitPos,
+                             unsigned char* dst, unsigned long count);
+
+/**********************************************************/
+/* Decodes STREAMS bitstreams that share one decode table */
+/* in lock step, so the table probes of different streams */
+/* do not wait on each other. Every stream stops under    */
+/* the same conditions as with decodeTable.               */
+/* in -- decode table, encoded bytes (followed by         */
+/*       DECODE_PAD readable bytes), and for each stream: */
+/*       number of bytes in which its codes may start,    */
+/*       bit position (updated on return), output buffer  */
+/*       and number of symbols                            */
+/* out -- number of symbols written, over all streams     */
+/**********************************************************/
+unsigned long decodeStreams(const struct DecodeTable* table,
+                            const unsigned char* src,
+                            const unsigned long limit[STREAMS],
+                            unsigned long bitPos[STREAMS],
+                            unsigned char* const dst[STREAMS],
+                            const unsigned long count[STREAMS]);
+
+/**********************************************************/
+/* Decodes STREAMS bitstreams like decodeStreams, up to   */
+/* MULTI_SYMBOLS symbols with each probe of a             */
+/* multi-symbol table.                                    */
+/* in -- decode table, multi-symbol table made from it,   */
+/*       see decodeStreams for the rest                   */
+/* out -- number of symbols written, over all streams     */
+/**********************************************************/
+unsigned long decodeStreamsMulti(const struct DecodeTable* table,
+                                 const struct MultiTable* multi,
+                                 const unsigned char* src,
+                                 const unsigned long limit[STREAMS],
+                                 unsigned long bitPos[STREAMS],
+                                 unsigned char* const dst[STREAMS],
+                                 const unsigned long count[STREAMS]);
+
+/********************************************************/
+/* Looks up a decode kernel by number.                  */
+/* in -- number of the kernel, from 0                   */
+/* out -- the kernel, or NULL past the last one         */
+/********************************************************/
+const struct Kernel* getKernel(int index);
+
+/********************************************************/
+/* Tells whether a kernel can decode a table's codes.   */
+/* in -- the kernel, decode table made from canonical   */
+/*       code lengths                                   */
+/* out -- TRUE or FALSE                                 */
+/********************************************************/
+int kernelFits(const struct Kernel* kernel, const struct DecodeTable* table);
+
+/********************************************************/
+/* Picks the decode kernel for a table's code lengths.  */
+/* in -- decode table made from canonical code lengths, */
+/*       number of streams, 1 or STREAMS                */
+/* out -- the kernel                                    */
+/********************************************************/
+const struct Kernel* chooseKernel(const struct DecodeTable* table,
+                                  int streams);
+
+/********************************************************/
+/* Fills the table of a decode kernel.                  */
+/* in -- decode table made from canonical code lengths, */
+/*       width of the kernel, kernel table to fill      */
+/* out -- void                                          */
+/********************************************************/
+void buildKernelTable(const struct DecodeTable* table, int bits,
+                      struct KernelTable* kernel);
+
+/*********************************************************/
+/* Choices that change how a file is encoded.            */
+/* maxCodeLength -- longest code the encoder may use,    */
+/*                  MAX_CODE_LENGTH for no extra limit   */
+/* blockSize -- bytes of input coded with one table      */
+/* threads -- number of blocks encoded at the same time  */
+/* streams -- TRUE to split blocks into STREAMS streams  */
+/* contexts -- TRUE to also try coding each byte with a  */
+/*             table chosen by the byte before it        */
+/* storeFallback -- TRUE to store a block raw, or as a   */
+/*                  run, when Huffman codes would not    */
+/*                  make it smaller                      */
+/* index -- TRUE to end the file with a block index, so  */
+/*          that decodeRange finds any byte at once      */
+/* report -- called with the frequencies and codes of    */
+/*           every block, in order, or NULL              */
+/* reportContext -- passed to report                     */
+/*********************************************************/
+struct EncodeOptions
+{
+  int maxCodeLength;
+  unsigned long blockSize;
+  int threads;
+  int streams;
+  int contexts;
+  int storeFallback;
+  int index;
+  void (*report)(void* context, const unsigned long frequency[NUM_CHAR],
+                 const struct CodeTable* codes, unsigned long rawSize);
+  void* reportContext;
+};
+
+/*********************************************************/
+/* Sets encode options to their defaults.                */
+/* in -- options to fill                                 */
+/* out -- void                                           */
+/*********************************************************/
+void defaultEncodeOptions(struct EncodeOptions* options);
+
+/********************************************************/
+/* Most bytes encodeBlock can produce for a block.      */
+/* in -- number of bytes in the block                   */
+/* out -- size of the block header, body and the bytes  */
+/*        the encoder may write past them               */
+/********************************************************/
+unsigned long blockBound(unsigned long rawSize);
+
+/********************************************************/
+/* Encodes one block in memory: counts the symbols,     */
+/* works out the code lengths and writes the block      */
+/* header, the length table and the codes, or, when the */
+/* options allow it and that is smaller, the raw bytes  */
+/* or a run.                                            */
+/* in -- options, the bytes to encode and their number, */
+/*       where to write (blockBound bytes), block of    */
+/*       nodes to build the tree in, arrays that        */
+/*       receive the frequency and code of each symbol, */
+/*       stats to add to or NULL                        */
+/* out -- number of bytes of the encoded block          */
+/********************************************************/
+unsigned long encodeBlock(const struct EncodeOptions* options,
+                          const unsigned char* src, unsigned long rawSize,
+                          unsigned char* dst, struct Tree* tree,
+                          unsigned long frequency[NUM_CHAR],
+                          struct CodeTable* codes, struct Stats* stats);
+
+/********************************************************/
+/* Reads a block header.                                */
+/* in -- BLOCK_HEADER_SIZE bytes, pointers that receive */
+/*       the type, decoded size and body size           */
+/* out -- void                                          */
+/********************************************************/
+void readBlockHeader(const unsigned char* src, int* type,
+                     unsigned long* rawSize, unsigned long* compSize);
+
+/********************************************************/
+/* Stores a number as four little endian bytes.         */
+/* in -- where to store, the number                     */
+/* out -- void                                          */
+/********************************************************/
+void storeLE32(unsigned char* dst, unsigned long value);
+
+/********************************************************/
+/* Loads a number stored as four little endian bytes.   */
+/* in -- pointer to the bytes                           */
+/* out -- the number                                    */
+/********************************************************/
+unsigned long loadLE32(const unsigned char* src);
+
+/********************************************************/
+/* Stores a number as eight little endian bytes.        */
+/* in -- where to store, the number                     */
+/* out -- void                                          */
+/********************************************************/
+void storeLE64(unsigned char* dst, uint64_t value);
+
+/********************************************************/
+/* Loads a number stored as eight little endian bytes.  */
+/* in -- pointer to the bytes                           */
+/* out -- the number                                    */
+/********************************************************/
+uint64_t loadLE64(const unsigned char* src);
+
+/********************************************************/
+/* Writes the end block that closes a file.             */
+/* in -- where to write (END_BLOCK_SIZE bytes), number  */
+/*       of bytes the whole file decodes to, size of    */
+/*       the index block before it (0 for none)         */
+/* out -- void                                          */
+/********************************************************/
+void writeEndBlock(unsigned char* dst, uint64_t totalSize,
+                   unsigned long indexSize);
+
+/********************************************************/
+/* Writes the header of an index block.                 */
+/* in -- where to write (BLOCK_HEADER_SIZE bytes),      */
+/*       number of entries                              */
+/* out -- void                                          */
+/********************************************************/
+void writeIndexHeader(unsigned char* dst, unsigned long entries);
+
+/********************************************************/
+/* Reads the body of an end block.                      */
+/* in -- END_BODY_SIZE bytes                            */
+/* out -- number of bytes the whole file decodes to     */
+/********************************************************/
+uint64_t readEndBody(const unsigned char* src);
+
+/********************************************************/
+/* Finds the bitstreams of a Huffman block body.        */
+/* in -- block type, body, its size, bytes of its       */
+/*       length table, where to write, the number of    */
+/*       bytes the block decodes to, and arrays that    */
+/*       receive the bit position, byte limit, output   */
+/*       and symbol count of each stream                */
+/* out -- number of streams, -1 if the block is damaged */
+/********************************************************/
+int findStreams(int type, const unsigned char* src, unsigned long compSize,
+                int used, unsigned char* dst, unsigned long rawSize,
+                unsigned long bitPos[STREAMS], unsigned long limit[STREAMS],
+                unsigned char* out[STREAMS], unsigned long count[STREAMS]);
+
+/********************************************************/
+/* Decodes the body of one block in memory.             */
+/* in -- block type, the body followed by DECODE_PAD    */
+/*       readable bytes, its size, where to write, the  */
+/*       number of bytes the block decodes to, stats to */
+/*       add to or NULL                                 */
+/* out -- 0 on success, -1 if the block is damaged      */
+/********************************************************/
+int decodeBlock(int type, const unsigned char* src, unsigned long compSize,
+                unsigned char* dst, unsigned long rawSize,
+                struct Stats* stats);
+
+/********************************************************/
+/* Builds an order-1 model of a block: counts each byte */
+/* by the byte before it, clusters the contexts into at */
+/* most CONTEXT_TABLES tables, and works out the codes. */
+/* in -- block of nodes for the tree, the bytes and     */
+/*       their number, longest code allowed, model to   */
+/*       fill                                           */
+/* out -- exact size of the block body the model gives, */
+/*        or 0 if memory ran out                        */
+/********************************************************/
+unsigned long buildContextModel(struct Tree* tree, const unsigned char* src,
+                                unsigned long rawSize, int maxCodeLength,
+                                struct ContextModel* model);
+
+/********************************************************/
+/* Writes the body of a context block.                  */
+/* in -- the model, the bytes and their number, where   */
+/*       to write (the size buildContextModel gave plus */
+/*       ENCODE_PAD)                                    */
+/* out -- number of bytes of the body                   */
+/********************************************************/
+unsigned long writeContextBody(const struct ContextModel* model,
+                               const unsigned char* src,
+                               unsigned long rawSize, unsigned char* dst);
+
+/********************************************************/
+/* Decodes the body of a context block.                 */
+/* in -- the body followed by DECODE_PAD readable       */
+/*       bytes, its size, where to write and the number */
+/*       of bytes the block decodes to                  */
+/* out -- 0 on success, -1 if the block is damaged      */
+/********************************************************/
+int decodeContextBody(const unsigned char* src, unsigned long compSize,
+                      unsigned char* dst, unsigned long rawSize);
+
+/********************************************************/
+/* Decodes bytes start to start + length - 1 of an      */
+/* encoded file in memory, decoding only the blocks     */
+/* that hold them. The block is found with the index    */
+/* when the file has one, and by hopping from block     */
+/* header to block header when it does not.             */
+/* in -- the whole encoded file and its size, first     */
+/*       byte wanted, number of bytes wanted, where to  */
+/*       write them, where to store the number written  */
+/*       (fewer than wanted past the end of the file),  */
+/*       a buffer for blocks of which only a part is    */
+/*       wanted and its size, grown as needed and freed */
+/*       by the caller                                  */
+/* out -- 0, or -1 if the file is damaged, not in a     */
+/*        block format, or memory ran out               */
+/********************************************************/
+int decodeRange(const unsigned char* src, unsigned long size, uint64_t start,
+                unsigned long length, unsigned char* dst,
+                unsigned long* written, unsigned char** scratch,
+                unsigned long* scratchSize);
+
+/* a set of threads that run jobs, see huffpool.c */
+struct ThreadPool;
+
+/*********************************************************/
+/* Works out a trained table from the symbol counts of   */
+/* sample data. Every symbol is counted once more than   */
+/* it occurs, so that symbols missing from the samples   */
+/* still get a code.                                     */
+/* in -- block of nodes for the tree, counts of the      */
+/*       samples, table to fill                          */
+/* out -- void                                           */
+/*********************************************************/
+void trainStaticTable(struct Tree* tree, const unsigned long frequency[NUM_CHAR],
+                      struct StaticTable* table);
+
+/*********************************************************/
+/* Writes a trained table in the table file format.      */
+/* in -- where to write, TABLE_MAX_SIZE bytes, the table */
+/* out -- number of bytes written                        */
+/*********************************************************/
+unsigned long writeStaticTable(unsigned char* dst,
+                               const struct StaticTable* table);
+
+/*********************************************************/
+/* Reads a trained table and builds its code and decode  */
+/* tables.                                               */
+/* in -- the table file bytes and their number, table to */
+/*       fill                                            */
+/* out -- 0, or -1 if the bytes are not a valid table    */
+/*********************************************************/
+int readStaticTable(const unsigned char* src, unsigned long size,
+                    struct StaticTable* table);
+
+/*********************************************************/
+/* Most bytes encodeMessage can produce.                 */
+/* in -- number of bytes in the message                  */
+/* out -- bound on the encoded size, ENCODE_PAD included */
+/*********************************************************/
+unsigned long messageBound(unsigned long rawSize);
+
+/*********************************************************/
+/* Encodes a message with a trained table.               */
+/* in -- the table, the message and its size, where to   */
+/*       write (messageBound bytes)                      */
+/* out -- number of bytes of the encoded message         */
+/*********************************************************/
+unsigned long encodeMessage(const struct StaticTable* table,
+                            const unsigned char* src, unsigned long rawSize,
+                            unsigned char* dst);
+
+/*********************************************************/
+/* Decodes a message coded with a trained table. Needs   */
+/* no readable bytes past the message.                   */
+/* in -- the table, the message and its size, where to   */
+/*       write and how many bytes fit there, pointer     */
+/*       that receives the decoded size, set when the    */
+/*       size is plausible, even if it does not fit      */
+/* out -- 0, or -1 if the message was coded with another */
+/*        table, is damaged, or does not fit             */
+/*********************************************************/
+int decodeMessage(const struct StaticTable* table, const unsigned char* src,
+                  unsigned long size, unsigned char* dst,
+                  unsigned long dstCap, unsigned long* rawSize);
+
+/*********************************************************/
+/* Creates a pool. The calling thread counts as one of   */
+/* the threads, so threads - 1 threads are started.      */
+/* in -- number of threads, at least 1                   */
+/* out -- the pool, NULL if it could not be created      */
+/*********************************************************/
+struct ThreadPool* createPool(int threads);
+
+/*********************************************************/
+/* Number of threads that run the jobs of a pool.        */
+/* in -- the pool                                        */
+/* out -- number of threads, including the caller        */
+/*********************************************************/
+int poolThreads(const struct ThreadPool* pool);
+
+/*********************************************************/
+/* Runs jobs 0 to jobs - 1 on every thread of the pool,  */
+/* in any order, and returns once all of them finished.  */
+/* Threads that run out of jobs steal from the others.   */
+/* in -- pool, number of jobs, function that runs a job  */
+/*       given the context, the job and the index of the */
+/*       thread running it, context                      */
+/* out -- void                                           */
+/*********************************************************/
+void runJobs(struct ThreadPool* pool, unsigned long jobs,
+             void (*work)(void* context, unsigned long job, int worker),
+             void* context);
+
+/*********************************************************/
+/* Stops the threads of a pool and frees it.             */
+/* in -- the pool, may be NULL                           */
+/* out -- void                                           */
+/*********************************************************/
+void destroyPool(struct ThreadPool* pool);
+
+/* the threads and memory that encode or decode a file, */
+/* kept from one file to the next, see hufffile.c       */
+struct Encoder;
+struct Decoder;
+
+/*********************************************************/
+/* Creates an encoder, with the threads and memory that  */
+/* encodeWith needs.                                     */
+/* in -- how to encode, copied into the encoder          */
+/* out -- the encoder, NULL if memory ran out            */
+/*********************************************************/
+struct Encoder* createEncoder(const struct EncodeOptions* options);
+
+/*********************************************************/
+/* Frees an encoder.                                     */
+/* in -- the encoder, may be NULL                        */
+/* out -- void                                           */
+/*********************************************************/
+void destroyEncoder(struct Encoder* encoder);
+
+/*********************************************************/
+/* Encodes a file like encodeFile, with the threads and  */
+/* memory of an encoder, so that encoding many files     */
+/* allocates nothing per file.                           */
+/* in -- encoder, input, output                          */
+/* out -- 0, or -1 if memory ran out                     */
+/*********************************************************/
+int encodeWith(struct Encoder* encoder, struct Input* in, struct Output* out);
+
+/*********************************************************/
+/* Creates a decoder.                                    */
+/* in -- number of blocks decoded at the same time       */
+/* out -- the decoder, NULL if memory ran out            */
+/*********************************************************/
+struct Decoder* createDecoder(int threads);
+
+/*********************************************************/
+/* Frees a decoder.                                      */
+/* in -- the decoder, may be NULL                        */
+/* out -- void                                           */
+/*********************************************************/
+void destroyDecoder(struct Decoder* decoder);
+
+/*********************************************************/
+/* Decodes a file like decodeFile, with the threads and  */
+/* buffers of a decoder.                                 */
+/* in -- decoder, input, output                          */
+/* out -- 0, or -1 if the file is damaged                */
+/*********************************************************/
+int decodeWith(struct Decoder* decoder, struct Input* in, struct Output* out);
 
 /**************************************************************/
-/* Huffman encode a file.                                     */
-/*     Also writes freq/code table to standard output         */
-/* in -- File to encode.                                      */
+/* Huffman encode a file, one block at a time, with up to     */
+/*     options->threads blocks encoded in parallel.           */
+/*     Hands the freq/code table of each block to             */
+/*     options->report.                                       */
+/* in -- Input to encode.                                     */
 /*       May be binary, so don't assume printable characters. */
-/* out -- File where encoded data will be written.            */
+/* out -- Output where encoded data will be written.          */
+/* options -- how to encode, see struct EncodeOptions.        */
+/* return -- 0, or -1 if memory ran out                       */
 /**************************************************************/
-void encodeFile(FILE* in, FILE* out);
+int encodeFile(struct Input* in, struct Output* out,
+               const struct EncodeOptions* options);
 
 /***************************************************/
 /* Decode a Huffman encoded file.                  */
-/* in -- File to decode.                           */
-/* out -- File where decoded data will be written. */
+/* in -- Input to decode.                          */
+/* out -- Output where decoded data will be        */
+/*        written.                                 */
+/* threads -- number of blocks decoded at the same */
+/*            time                                 */
+/* return -- 0, or -1 if the file is damaged       */
 /***************************************************/
-void decodeFile(FILE* in, FILE* out);
+int decodeFile(struct Input* in, struct Output* out, int threads);
+
+/***************************************************/
+/* Decode part of a Huffman encoded file.          */
+/* in -- Input to decode.                          */
+/* out -- Output where decoded data will be        */
+/*        written.                                 */
+/* start -- first decoded byte wanted              */
+/* length -- number of bytes wanted; fewer are     */
+/*           written past the end of the file      */
+/* return -- 0, or -1 if the file is damaged, not  */
+/*           in a block format, or memory ran out  */
+/***************************************************/
+int decodeRangeFile(struct Input* in, struct Output* out, uint64_t start,
+                    uint64_t length);
+
+/***************************************************/
+/* Adds the symbol counts of the rest of an input  */
+/* to frequency, a block at a time.                */
+/* in -- Input to count.                           */
+/* frequency -- counts to add to                   */
+/* return -- 0, or -1 if memory ran out            */
+/***************************************************/
+int countFile(struct Input* in, unsigned long frequency[NUM_CHAR]);
+
+/***************************************************/
+/* Reads a trained table file.                     */
+/* in -- Input holding the table.                  */
+/* table -- table to fill                          */
+/* return -- 0, or -1 if it is not a valid table   */
+/***************************************************/
+int loadStaticTable(struct Input* in, struct StaticTable* table);
+
+/***************************************************/
+/* Encode a whole file as one message with a       */
+/* trained table.                                  */
+/* in -- Input to encode.                          */
+/* out -- Output where the message is written.     */
+/* table -- the trained table                      */
+/* return -- 0, or -1 if memory ran out            */
+/***************************************************/
+int encodeMessageFile(struct Input* in, struct Output* out,
+                      const struct StaticTable* table);
+
+/***************************************************/
+/* Decode a message encoded with a trained table.  */
+/* in -- Input holding the message.                */
+/* out -- Output where decoded data is written.    */
+/* table -- the trained table                      */
+/* return -- 0, or -1 if the message is damaged,   */
+/*           was coded with another table, or      */
+/*           memory ran out                        */
+/***************************************************/
+int decodeMessageFile(struct Input* in, struct Output* out,
+                      const struct StaticTable* table);
+
+/***************************************************/
+/* Encode a file in one pass with an adaptive      */
+/* tree. Codes go out as soon as the input they    */
+/* code has been read; input that is not mapped is */
+/* written and flushed after every read.           */
+/* in -- Input to encode.                          */
+/* out -- Output where encoded data is written.    */
+/* return -- 0, or -1 if memory ran out or a write */
+/*           failed                                */
+/***************************************************/
+int encodeAdaptiveFile(struct Input* in, struct Output* out);
+
+/* added to a name listed alone in a batch to name the */
+/* encoded file, and taken off to name the decoded one */
+#define BATCH_SUFFIX ".huf"
+
+/* how a file of a batch went; the values are the exit */
+/* codes the programs give for the same failures       */
+#define BATCH_OK 0
+#define BATCH_NO_INPUT 2
+#define BATCH_NO_OUTPUT 3
+#define BATCH_FAILED 4
+
+/*********************************************************/
+/* One file of a batch.                                  */
+/* input, output -- names of the files read and written  */
+/* status -- BATCH_OK or how it failed, set by runBatch  */
+/*********************************************************/
+struct BatchFile
+{
+  const char* input;
+  const char* output;
+  int status;
+};
+
+/*********************************************************/
+/* Reads a list of files, one per line: an input name    */
+/* and an output name separated by a tab, or an input    */
+/* name alone, whose output is named by adding or taking */
+/* off BATCH_SUFFIX. Empty lines are skipped.            */
+/* in -- the open list, TRUE to add the suffix or FALSE  */
+/*       to take it off, pointers that receive the files */
+/*       and their number, and the memory holding the    */
+/*       names; the caller frees both                    */
+/* out -- 0, or the line number of a name alone that     */
+/*        lacks the suffix, or -1 if memory ran out      */
+/*********************************************************/
+long readBatchList(FILE* list, int addSuffix, struct BatchFile** files,
+                   unsigned long* count, char** names);
+
+/*********************************************************/
+/* Encodes or decodes a batch of files, threads files at */
+/* a time. Every thread opens its files itself and       */
+/* writes them through one output buffer of its own.     */
+/* in -- the files, their number, number of threads,     */
+/*       function that codes one file given the context, */
+/*       the index of the thread and the opened input    */
+/*       and output, the context, stats to add to or     */
+/*       NULL                                            */
+/* out -- 0, or -1 if memory ran out; how each file went */
+/*        is in its status                               */
+/*********************************************************/
+int runBatch(struct BatchFile* files, unsigned long count, int threads,
+             int (*code)(void* context, int worker, struct Input* in,
+                         struct Output* out),
+             void* context, struct Stats* stats);
 
 #endif
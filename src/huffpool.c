@@ -0,0 +1,298 @@
+/*************************************/
+/* This file defines the thread pool */
+/* that encodes and decodes blocks   */
+/* in parallel. Each run of jobs is  */
+/* split into one range per thread;  */
+/* a thread that finishes its range  */
+/* steals half of what is left of    */
+/* another thread's range.           */
+/*************************************/
+
+#define _POSIX_C_SOURCE 200112L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <pthread.h>
+#include "huffman.h"
+
+#define TRUE 1
+#define FALSE 0
+
+/* the jobs a thread has yet to take, next up to end */
+struct WorkRange
+{
+  unsigned long next;
+  unsigned long end;
+  pthread_mutex_t lock;
+};
+
+struct ThreadPool
+{
+  int threads;
+  pthread_t* thread;
+  struct WorkRange* range;
+
+  /* guards everything below */
+  pthread_mutex_t lock;
+  pthread_cond_t start;
+  pthread_cond_t done;
+  unsigned long generation;
+  int running;
+  int quit;
+  void (*work)(void* context, unsigned long job, int worker);
+  void* context;
+};
+
+/* what a pool thread is told when it is started */
+struct WorkerStart
+{
+  struct ThreadPool* pool;
+  int worker;
+};
+
+/*********************************************************/
+/* Takes the next job of a thread, stealing the back     */
+/* half of another thread's range once its own is empty. */
+/* Only the owner adds to a range, so an empty range     */
+/* stays empty until its owner refills it.               */
+/* in -- pool, index of the thread, where to put the job */
+/* out -- TRUE if a job was taken, FALSE if none is left */
+/*********************************************************/
+static int takeJob(struct ThreadPool* pool, int worker, unsigned long* job)
+{
+  struct WorkRange* own = &pool->range[worker];
+  struct WorkRange* victim;
+  unsigned long first, last;
+  int i, found = FALSE;
+
+  pthread_mutex_lock(&own->lock);
+  if(own->next < own->end)
+  {
+    *job = own->next++;
+    found = TRUE;
+  }
+  pthread_mutex_unlock(&own->lock);
+
+  for(i = 1; i < pool->threads && !found; i++)
+  {
+    victim = &pool->range[(worker + i) % pool->threads];
+    pthread_mutex_lock(&victim->lock);
+    first = last = victim->end;
+    if(victim->next < victim->end)
+    {
+      first = victim->end - (victim->end - victim->next + 1) / 2;
+      victim->end = first;
+    }
+    pthread_mutex_unlock(&victim->lock);
+
+    if(first < last)
+    {
+      pthread_mutex_lock(&own->lock);
+      *job = first;
+      own->next = first + 1;
+      own->end = last;
+      pthread_mutex_unlock(&own->lock);
+      found = TRUE;
+    }
+  }
+  return found;
+}
+
+/*********************************************************/
+/* Runs jobs until none is left in any range.            */
+/* in -- pool, index of the thread                       */
+/* out -- void                                           */
+/*********************************************************/
+static void drainJobs(struct ThreadPool* pool, int worker)
+{
+  unsigned long job;
+
+  while(takeJob(pool, worker, &job))
+  {
+    pool->work(pool->context, job, worker);
+  }
+}
+
+/*********************************************************/
+/* Body of a pool thread: waits for a run of jobs, helps */
+/* with it, and reports when it has nothing left to do.  */
+/* in -- struct WorkerStart                              */
+/* out -- NULL                                           */
+/*********************************************************/
+static void* workerMain(void* argument)
+{
+  struct WorkerStart* start = argument;
+  struct ThreadPool* pool = start->pool;
+  int worker = start->worker;
+  unsigned long seen = 0;
+
+  free(start);
+  for(;;)
+  {
+    pthread_mutex_lock(&pool->lock);
+    while(pool->generation == seen && !pool->quit)
+    {
+      pthread_cond_wait(&pool->start, &pool->lock);
+    }
+    if(pool->quit)
+    {
+      pthread_mutex_unlock(&pool->lock);
+      return NULL;
+    }
+    seen = pool->generation;
+    pthread_mutex_unlock(&pool->lock);
+
+    drainJobs(pool, worker);
+
+    pthread_mutex_lock(&pool->lock);
+    if(--pool->running == 0)
+    {
+      pthread_cond_signal(&pool->done);
+    }
+    pthread_mutex_unlock(&pool->lock);
+  }
+}
+
+/*********************************************************/
+/* Creates a pool. The calling thread counts as one of   */
+/* the threads, so threads - 1 threads are started.      */
+/* in -- number of threads, at least 1                   */
+/* out -- the pool, NULL if it could not be created      */
+/*********************************************************/
+struct ThreadPool* createPool(int threads)
+{
+  struct ThreadPool* pool = malloc(sizeof(struct ThreadPool));
+  struct WorkerStart* start;
+  int i;
+
+  if(pool == NULL)
+  {
+    return NULL;
+  }
+  pool->threads = 0;
+  pool->thread = malloc(threads * sizeof(pthread_t));
+  pool->range = malloc(threads * sizeof(struct WorkRange));
+  pool->generation = 0;
+  pool->running = 0;
+  pool->quit = FALSE;
+  pthread_mutex_init(&pool->lock, NULL);
+  pthread_cond_init(&pool->start, NULL);
+  pthread_cond_init(&pool->done, NULL);
+  if(pool->thread == NULL || pool->range == NULL)
+  {
+    destroyPool(pool);
+    return NULL;
+  }
+
+  pool->range[0].next = pool->range[0].end = 0;
+  pthread_mutex_init(&pool->range[0].lock, NULL);
+  pool->threads = 1;
+  for(i = 1; i < threads; i++)
+  {
+    pool->range[i].next = pool->range[i].end = 0;
+    pthread_mutex_init(&pool->range[i].lock, NULL);
+    start = malloc(sizeof(struct WorkerStart));
+    if(start == NULL)
+    {
+      pthread_mutex_destroy(&pool->range[i].lock);
+      destroyPool(pool);
+      return NULL;
+    }
+    start->pool = pool;
+    start->worker = i;
+    if(pthread_create(&pool->thread[i], NULL, workerMain, start) != 0)
+    {
+      free(start);
+      pthread_mutex_destroy(&pool->range[i].lock);
+      destroyPool(pool);
+      return NULL;
+    }
+    pool->threads++;
+  }
+  return pool;
+}
+
+/*********************************************************/
+/* Number of threads that run the jobs of a pool.        */
+/* in -- the pool                                        */
+/* out -- number of threads, including the caller        */
+/*********************************************************/
+int poolThreads(const struct ThreadPool* pool)
+{
+  return pool->threads;
+}
+
+/*********************************************************/
+/* Runs jobs 0 to jobs - 1 on every thread of the pool   */
+/* and returns once all of them have finished. The jobs  */
+/* start split evenly, in order, between the threads.    */
+/* in -- pool, number of jobs, function that runs a job  */
+/*       given the context, the job and the index of the */
+/*       thread running it, context                      */
+/* out -- void                                           */
+/*********************************************************/
+void runJobs(struct ThreadPool* pool, unsigned long jobs,
+             void (*work)(void* context, unsigned long job, int worker),
+             void* context)
+{
+  int i;
+
+  for(i = 0; i < pool->threads; i++)
+  {
+    pthread_mutex_lock(&pool->range[i].lock);
+    pool->range[i].next = jobs * i / pool->threads;
+    pool->range[i].end = jobs * (i + 1) / pool->threads;
+    pthread_mutex_unlock(&pool->range[i].lock);
+  }
+
+  pthread_mutex_lock(&pool->lock);
+  pool->work = work;
+  pool->context = context;
+  pool->running = pool->threads - 1;
+  pool->generation++;
+  pthread_cond_broadcast(&pool->start);
+  pthread_mutex_unlock(&pool->lock);
+
+  drainJobs(pool, 0);
+
+  pthread_mutex_lock(&pool->lock);
+  while(pool->running > 0)
+  {
+    pthread_cond_wait(&pool->done, &pool->lock);
+  }
+  pthread_mutex_unlock(&pool->lock);
+}
+
+/*********************************************************/
+/* Stops the threads of a pool and frees it.             */
+/* in -- the pool, may be NULL                           */
+/* out -- void                                           */
+/*********************************************************/
+void destroyPool(struct ThreadPool* pool)
+{
+  int i;
+
+  if(pool == NULL)
+  {
+    return;
+  }
+  pthread_mutex_lock(&pool->lock);
+  pool->quit = TRUE;
+  pthread_cond_broadcast(&pool->start);
+  pthread_mutex_unlock(&pool->lock);
+
+  for(i = 1; i < pool->threads; i++)
+  {
+    pthread_join(pool->thread[i], NULL);
+  }
+  for(i = 0; i < pool->threads; i++)
+  {
+    pthread_mutex_destroy(&pool->range[i].lock);
+  }
+  pthread_mutex_destroy(&pool->lock);
+  pthread_cond_destroy(&pool->start);
+  pthread_cond_destroy(&pool->done);
+  free(pool->thread);
+  free(pool->range);
+  free(pool);
+}
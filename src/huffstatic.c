@@ -0,0 +1,226 @@
+/*************************************/
+/* This file defines trained tables: */
+/* codes worked out once from sample */
+/* data and shared by many small     */
+/* messages, which then carry only   */
+/* the id of the table and their     */
+/* size in front of the codes.       */
+/*************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "huffman.h"
+
+#define TRUE 1
+#define FALSE 0
+
+/* bits in the decoded size of a message */
+#define VALUE_BITS ((int)(8 * sizeof(unsigned long)))
+
+/*********************************************************/
+/* Hashes code lengths into a table id (32-bit FNV-1a).  */
+/* in -- code length of each symbol                      */
+/* out -- the id                                         */
+/*********************************************************/
+static unsigned long tableId(const unsigned char codeLength[NUM_CHAR])
+{
+  unsigned long hash = 2166136261UL;
+  int i;
+
+  for(i = 0; i < NUM_CHAR; i++)
+  {
+    hash = ((hash ^ codeLength[i]) * 16777619UL) & 0xffffffffUL;
+  }
+  return hash;
+}
+
+/*********************************************************/
+/* Builds the code table, decode table and id of a       */
+/* table from its code lengths.                          */
+/* in -- table with its code lengths filled in           */
+/* out -- void                                           */
+/*********************************************************/
+static void finishStaticTable(struct StaticTable* table)
+{
+  buildCodeTable(table->codeLength, &table->codes);
+  buildCanonicalTable(table->codeLength, &table->decode);
+  table->id = tableId(table->codeLength);
+}
+
+/*********************************************************/
+/* Works out a trained table from the symbol counts of   */
+/* sample data, with codes of at most DECODE_BITS bits.  */
+/* in -- block of nodes for the tree, counts of the      */
+/*       samples, table to fill                          */
+/* out -- void                                           */
+/*********************************************************/
+void trainStaticTable(struct Tree* tree, const unsigned long frequency[NUM_CHAR],
+                      struct StaticTable* table)
+{
+  unsigned long counted[NUM_CHAR];
+  int i;
+
+  for(i = 0; i < NUM_CHAR; i++)
+  {
+    counted[i] = frequency[i] + 1;
+  }
+  buildCodeLengths(tree, counted, DECODE_BITS, table->codeLength);
+  finishStaticTable(table);
+}
+
+/*********************************************************/
+/* Writes a trained table: magic, version, id and code   */
+/* lengths.                                              */
+/* in -- where to write, TABLE_MAX_SIZE bytes, the table */
+/* out -- number of bytes written                        */
+/*********************************************************/
+unsigned long writeStaticTable(unsigned char* dst,
+                               const struct StaticTable* table)
+{
+  dst[0] = MAGIC_0;
+  dst[1] = MAGIC_1;
+  dst[2] = TABLE_MAGIC;
+  dst[3] = TABLE_VERSION;
+  storeLE32(dst + 4, table->id);
+  return 8 + writeLengths(dst + 8, table->codeLength);
+}
+
+/*********************************************************/
+/* Reads a trained table. Every symbol must have a code  */
+/* no longer than DECODE_BITS, and the id must match the */
+/* lengths, so a damaged table file is never used.       */
+/* in -- the table file bytes and their number, table to */
+/*       fill                                            */
+/* out -- 0, or -1 if the bytes are not a valid table    */
+/*********************************************************/
+int readStaticTable(const unsigned char* src, unsigned long size,
+                    struct StaticTable* table)
+{
+  int i;
+
+  if(size < 8 || src[0] != MAGIC_0 || src[1] != MAGIC_1
+     || src[2] != TABLE_MAGIC || src[3] != TABLE_VERSION
+     || readLengths(src + 8, size - 8, table->codeLength) < 0)
+  {
+    return -1;
+  }
+  for(i = 0; i < NUM_CHAR; i++)
+  {
+    if(table->codeLength[i] == 0 || table->codeLength[i] > DECODE_BITS)
+    {
+      return -1;
+    }
+  }
+  finishStaticTable(table);
+  return table->id == loadLE32(src + 4) ? 0 : -1;
+}
+
+/*********************************************************/
+/* Most bytes encodeMessage can produce: the id, the     */
+/* longest size varint, DECODE_BITS bits a symbol and    */
+/* the bytes encodeSymbols may write past the end.       */
+/* in -- number of bytes in the message                  */
+/* out -- bound on the encoded size                      */
+/*********************************************************/
+unsigned long messageBound(unsigned long rawSize)
+{
+  return MESSAGE_HEADER_MAX_SIZE + rawSize / 8 * DECODE_BITS + DECODE_BITS
+         + ENCODE_PAD;
+}
+
+/*********************************************************/
+/* Encodes a message: table id, size, codes.             */
+/* in -- the table, the message and its size, where to   */
+/*       write (messageBound bytes)                      */
+/* out -- number of bytes of the encoded message         */
+/*********************************************************/
+unsigned long encodeMessage(const struct StaticTable* table,
+                            const unsigned char* src, unsigned long rawSize,
+                            unsigned char* dst)
+{
+  struct BitWriter writer;
+  unsigned long value = rawSize;
+  unsigned char* next = dst + 4;
+
+  storeLE32(dst, table->id);
+  while(value >= 0x80)
+  {
+    *next++ = (unsigned char)(value | 0x80);
+    value >>= 7;
+  }
+  *next++ = (unsigned char)value;
+
+  writer.next = next;
+  writer.bits = 0;
+  writer.count = 0;
+  encodeSymbols(&table->codes, src, rawSize, &writer);
+  flushBits(&writer);
+  return (unsigned long)(writer.next - dst);
+}
+
+/*********************************************************/
+/* Decodes a message. All but its last DECODE_PAD bytes  */
+/* are decoded where they lie; the codes that start in   */
+/* the rest are decoded from a padded copy, so the       */
+/* caller's buffer needs nothing past its end.           */
+/* in -- the table, the message and its size, where to   */
+/*       write and how many bytes fit there, pointer     */
+/*       that receives the decoded size, set once it is  */
+/*       found plausible, even if it does not fit        */
+/* out -- 0, or -1 if the message was coded with another */
+/*        table, is damaged, or does not fit             */
+/*********************************************************/
+int decodeMessage(const struct StaticTable* table, const unsigned char* src,
+                  unsigned long size, unsigned char* dst,
+                  unsigned long dstCap, unsigned long* rawSize)
+{
+  unsigned char tail[3 * DECODE_PAD];
+  unsigned long value = 0, used = 4, bitPos, n = 0, rest;
+  int shift = 0, more = TRUE;
+
+  if(size < 5 || loadLE32(src) != table->id)
+  {
+    return -1;
+  }
+  while(more)
+  {
+    /* the size must fit in an unsigned long */
+    if(used >= size || shift >= VALUE_BITS
+       || (shift > 0
+           && (unsigned long)(src[used] & 0x7f) >> (VALUE_BITS - shift) != 0))
+    {
+      return -1;
+    }
+    value |= (unsigned long)(src[used] & 0x7f) << shift;
+    more = (src[used++] & 0x80) != 0;
+    shift += 7;
+  }
+  /* every code takes at least one bit */
+  if(value / 8 > size - used)
+  {
+    return -1;
+  }
+  *rawSize = value;
+  if(value > dstCap)
+  {
+    return -1;
+  }
+
+  bitPos = used * 8;
+  if(size >= used + DECODE_PAD)
+  {
+    n = decodeTable(&table->decode, src, size - DECODE_PAD, &bitPos,
+                    dst, value);
+  }
+  rest = size - (bitPos >> 3);
+  if(n < value && rest <= DECODE_PAD)
+  {
+    memset(tail, 0, sizeof(tail));
+    memcpy(tail, src + (bitPos >> 3), rest);
+    bitPos &= 7;
+    n += decodeTable(&table->decode, tail, rest, &bitPos, dst + n,
+                     value - n);
+  }
+  return n == value ? 0 : -1;
+}
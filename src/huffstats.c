@@ -0,0 +1,133 @@
+/*************************************/
+/* This file defines the stats that  */
+/* show where the time of encoding   */
+/* or decoding a file goes. The      */
+/* timers and counters themselves    */
+/* are the STATS_ macros, which      */
+/* vanish unless HUFF_STATS is set.  */
+/*************************************/
+
+#define _POSIX_C_SOURCE 200112L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "huffman.h"
+
+#define TRUE 1
+#define FALSE 0
+
+/********************************************************/
+/* Seconds on a clock that keeps running while threads  */
+/* work or the process waits for I/O.                   */
+/* in -- void                                           */
+/* out -- seconds since some fixed time                 */
+/********************************************************/
+double statsSeconds(void)
+{
+  struct timespec now;
+
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return now.tv_sec + now.tv_nsec / 1e9;
+}
+
+/********************************************************/
+/* Adds the times and counts of one set of stats to     */
+/* another.                                             */
+/* in -- stats to add to, stats to add                  */
+/* out -- void                                          */
+/********************************************************/
+void addStats(struct Stats* total, const struct Stats* part)
+{
+  total->readSeconds += part->readSeconds;
+  total->writeSeconds += part->writeSeconds;
+  total->blockSeconds += part->blockSeconds;
+  total->countSeconds += part->countSeconds;
+  total->treeSeconds += part->treeSeconds;
+  total->tableSeconds += part->tableSeconds;
+  total->bitsSeconds += part->bitsSeconds;
+  total->bytesRead += part->bytesRead;
+  total->bytesMapped += part->bytesMapped;
+  total->bytesWritten += part->bytesWritten;
+  total->reads += part->reads;
+  total->writes += part->writes;
+  total->blocks += part->blocks;
+  total->storedBlocks += part->storedBlocks;
+  total->nodes += part->nodes;
+  total->symbols += part->symbols;
+  total->bits += part->bits;
+  total->fallbacks += part->fallbacks;
+}
+
+/********************************************************/
+/* Counts the symbols of a decoded block whose codes    */
+/* are longer than DECODE_BITS. Most blocks have none,  */
+/* and then the bytes are not looked at.                */
+/* in -- code length of each symbol, the decoded bytes  */
+/*       and their number                               */
+/* out -- the number of such symbols                    */
+/********************************************************/
+uint64_t countFallbacks(const unsigned char codeLength[NUM_CHAR],
+                        const unsigned char* src, unsigned long n)
+{
+  unsigned long frequency[NUM_CHAR];
+  uint64_t fallbacks = 0;
+  int i, longCodes = FALSE;
+
+  for(i = 0; i < NUM_CHAR; i++)
+  {
+    if(codeLength[i] > DECODE_BITS)
+    {
+      longCodes = TRUE;
+    }
+  }
+  if(!longCodes)
+  {
+    return 0;
+  }
+  countSymbols(src, n, frequency);
+  for(i = 0; i < NUM_CHAR; i++)
+  {
+    if(codeLength[i] > DECODE_BITS)
+    {
+      fallbacks += frequency[i];
+    }
+  }
+  return fallbacks;
+}
+
+/********************************************************/
+/* Prints stats as one line of JSON, so that a log of   */
+/* many runs can be read by a script. Builds without    */
+/* HUFF_STATS print an error object instead.            */
+/* in -- file to print to, what was done ("encode" or   */
+/*       "decode"), the stats, seconds it all took      */
+/* out -- void                                          */
+/********************************************************/
+void printStats(FILE* file, const char* mode, const struct Stats* stats,
+                double seconds)
+{
+#ifdef HUFF_STATS
+  fprintf(file, "{\"mode\": \"%s\", \"seconds\": %.6f, "
+          "\"read_seconds\": %.6f, \"write_seconds\": %.6f, "
+          "\"block_seconds\": %.6f, \"count_seconds\": %.6f, "
+          "\"tree_seconds\": %.6f, \"table_seconds\": %.6f, "
+          "\"bits_seconds\": %.6f, ", mode, seconds, stats->readSeconds,
+          stats->writeSeconds, stats->blockSeconds, stats->countSeconds,
+          stats->treeSeconds, stats->tableSeconds, stats->bitsSeconds);
+  fprintf(file, "\"bytes_read\": %.0f, \"bytes_mapped\": %.0f, "
+          "\"bytes_written\": %.0f, \"reads\": %lu, \"writes\": %lu, "
+          "\"blocks\": %lu, \"stored_blocks\": %lu, \"nodes\": %lu, "
+          "\"symbols\": %.0f, \"average_code_length\": %.4f, "
+          "\"fallbacks\": %.0f}\n", (double)stats->bytesRead,
+          (double)stats->bytesMapped, (double)stats->bytesWritten,
+          stats->reads, stats->writes, stats->blocks, stats->storedBlocks,
+          stats->nodes, (double)stats->symbols,
+          stats->symbols > 0 ? (double)stats->bits / stats->symbols : 0.0,
+          (double)stats->fallbacks);
+#else
+  fprintf(file, "{\"mode\": \"%s\", \"seconds\": %.6f, "
+          "\"error\": \"built without HUFF_STATS\"}\n", mode, seconds);
+#endif
+}
@@ -0,0 +1,1053 @@
+/*************************************/
+/* This file defines the decode      */
+/* engines: the bit at a time tree   */
+/* walk, the table driven decoder    */
+/* that resolves a whole code with   */
+/* one lookup, and the kernels made  */
+/* from it for each table width,     */
+/* stream count and code length.     */
+/*************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "huffman.h"
+
+#define TRUE 1
+#define FALSE 0
+
+/*****************************************************/
+/* Loads the eight bytes starting at src as a big    */
+/* endian word, so the next bit of the stream is the */
+/* most significant bit of the result.               */
+/* in -- pointer to at least eight readable bytes    */
+/* out -- 64-bit bit buffer                          */
+/*****************************************************/
+static uint64_t loadBits(const unsigned char* src)
+{
+  return ((uint64_t)src[0] << 56) | ((uint64_t)src[1] << 48)
+       | ((uint64_t)src[2] << 40) | ((uint64_t)src[3] << 32)
+       | ((uint64_t)src[4] << 24) | ((uint64_t)src[5] << 16)
+       | ((uint64_t)src[6] << 8)  | (uint64_t)src[7];
+}
+
+/*********************************************************/
+/* Recursively fills the table entries for every leaf    */
+/* that is at most DECODE_BITS deep. A leaf at depth d   */
+/* owns the 2^(DECODE_BITS-d) entries that start with    */
+/* its code.                                             */
+/* in -- tree, index of the current node, code bits so   */
+/*       far, current depth, table to fill               */
+/* out -- void                                           */
+/*********************************************************/
+static void fillEntries(const struct Tree* tree, int index,
+                        unsigned int code, int depth,
+                        struct DecodeTable* table)
+{
+  const struct Node* node = &tree->nodes[index];
+  unsigned int first, last;
+
+  if(depth > DECODE_BITS)
+  {
+    return;
+  }
+  if(!isLeaf(node))
+  {
+    fillEntries(tree, node->left, code << 1, depth + 1, table);
+    fillEntries(tree, node->right, (code << 1) | 1, depth + 1, table);
+    return;
+  }
+  if(depth == 0)
+  {
+    return;
+  }
+
+  first = code << (DECODE_BITS - depth);
+  last = first + (1u << (DECODE_BITS - depth));
+  for(; first < last; ++first)
+  {
+    table->entry[first] = (unsigned short)((depth << 8) | node->symbol);
+  }
+}
+
+/********************************************************/
+/* Fills a decode table from a Huffman tree.            */
+/* in -- the tree, table to fill                        */
+/* out -- void                                          */
+/********************************************************/
+void buildDecodeTable(const struct Tree* tree, struct DecodeTable* table)
+{
+  memset(table->entry, 0, sizeof(table->entry));
+  table->tree = tree;
+  if(tree != NULL)
+  {
+    fillEntries(tree, ROOT, 0, 0, table);
+  }
+}
+
+/********************************************************/
+/* Fills a decode table straight from canonical code    */
+/* lengths, without building a tree.                    */
+/* in -- code length of each symbol, table to fill      */
+/* out -- void                                          */
+/********************************************************/
+void buildCanonicalTable(const unsigned char codeLength[NUM_CHAR],
+                         struct DecodeTable* table)
+{
+  uint64_t code[NUM_CHAR];
+  unsigned int offset[MAX_CODE_LENGTH + 1];
+  unsigned int first, last;
+  int symbol, length;
+
+  memset(table->entry, 0, sizeof(table->entry));
+  memset(table->count, 0, sizeof(table->count));
+  table->tree = NULL;
+  canonicalCodes(codeLength, code);
+
+  for(symbol = 0; symbol < NUM_CHAR; symbol++)
+  {
+    length = codeLength[symbol];
+    table->count[length]++;
+    if(length == 0 || length > DECODE_BITS)
+    {
+      continue;
+    }
+    first = (unsigned int)code[symbol] << (DECODE_BITS - length);
+    last = first + (1u << (DECODE_BITS - length));
+    for(; first < last; ++first)
+    {
+      table->entry[first] = (unsigned short)((length << 8) | symbol);
+    }
+  }
+  table->count[0] = 0;
+
+  /* symbols in code order, for codes longer than the table */
+  offset[1] = 0;
+  for(length = 1; length < MAX_CODE_LENGTH; length++)
+  {
+    offset[length + 1] = offset[length] + table->count[length];
+  }
+  for(symbol = 0; symbol < NUM_CHAR; symbol++)
+  {
+    if(codeLength[symbol] > 0)
+    {
+      table->sorted[offset[codeLength[symbol]]++] = (unsigned char)symbol;
+    }
+  }
+}
+
+/********************************************************/
+/* Builds the Huffman tree that canonical code lengths  */
+/* describe, for decoding with decodeTree.              */
+/* in -- code length of each symbol                     */
+/* out -- the tree, freed with freeTree                 */
+/********************************************************/
+struct Tree* buildCanonicalTree(const unsigned char codeLength[NUM_CHAR])
+{
+  uint64_t code[NUM_CHAR];
+  struct Tree* tree = allocateTree();
+  unsigned short* link;
+  int symbol, bit, node;
+
+  addNode(tree, 0, 0);
+  canonicalCodes(codeLength, code);
+  for(symbol = 0; symbol < NUM_CHAR; symbol++)
+  {
+    node = ROOT;
+    for(bit = codeLength[symbol] - 1; bit >= 0; bit--)
+    {
+      if((code[symbol] >> bit) & 1)
+      {
+        link = &tree->nodes[node].right;
+      }
+      else
+      {
+        link = &tree->nodes[node].left;
+      }
+      if(*link == 0)
+      {
+        *link = (unsigned short)addNode(tree, (unsigned char)symbol, 0);
+      }
+      node = *link;
+    }
+  }
+  return tree;
+}
+
+/***********************************************************/
+/* Decodes one canonical code bit by bit, using the number */
+/* of codes of each length: the codes of one length are    */
+/* consecutive, so a code of that length is valid exactly  */
+/* when it falls in that range.                            */
+/* in -- decode table, encoded bytes, bit position of the  */
+/*       code (updated on return)                          */
+/* out -- the symbol, or -1 if the bits are not a code     */
+/***********************************************************/
+static int decodeCanonical(const struct DecodeTable* table,
+                           const unsigned char* src, unsigned long* bitPos)
+{
+  unsigned long pos = *bitPos;
+  uint64_t code = 0, first = 0;
+  unsigned int index = 0, count;
+  int length;
+
+  for(length = 1; length <= MAX_CODE_LENGTH; length++)
+  {
+    code |= (src[pos >> 3] >> (7 - (pos & 7))) & 1;
+    pos++;
+    count = table->count[length];
+    if(code - first < count)
+    {
+      *bitPos = pos;
+      return table->sorted[index + (code - first)];
+    }
+    index += count;
+    first = (first + count) << 1;
+    code <<= 1;
+  }
+  return -1;
+}
+
+/**********************************************************/
+/* Decodes symbols by walking the tree one bit at a time. */
+/* in -- the tree, encoded bytes (followed by             */
+/*       DECODE_PAD readable bytes), number of bytes in   */
+/*       which a code may start, bit position to start    */
+/*       at (updated on return), output buffer, maximum   */
+/*       number of symbols to decode                      */
+/* out -- number of symbols written to the output buffer  */
+/**********************************************************/
+unsigned long decodeTree(const struct Tree* tree, const unsigned char* src,
+                         unsigned long limit, unsigned long* bitPos,
+                         unsigned char* dst, unsigned long count)
+{
+  unsigned long pos = *bitPos;
+  unsigned long n = 0;
+  const struct Node* current;
+
+  while(n < count && (pos >> 3) < limit)
+  {
+    current = &tree->nodes[ROOT];
+    while(!isLeaf(current))
+    {
+      if(src[pos >> 3] & (128 >> (pos & 7)))
+      {
+        current = &tree->nodes[current->right];
+      }
+      else
+      {
+        current = &tree->nodes[current->left];
+      }
+      pos++;
+    }
+    dst[n++] = current->symbol;
+  }
+  *bitPos = pos;
+  return n;
+}
+
+/**********************************************************/
+/* Decodes symbols with one table probe per symbol from a */
+/* 64-bit bit buffer. Takes the same arguments and stops  */
+/* under the same conditions as decodeTree. The buffer is */
+/* reloaded from memory only once it has fewer than       */
+/* DECODE_BITS valid bits, so up to five short codes are  */
+/* decoded per load. Also stops early at bits that are    */
+/* not a code, which only happens in a damaged file.      */
+/* in -- decode table, see decodeTree for the rest        */
+/* out -- number of symbols written to the output buffer  */
+/**********************************************************/
+unsigned long decodeTable(const struct DecodeTable* table,
+                          const unsigned char* src,
+                          unsigned long limit, unsigned long* bitPos,
+                          unsigned char* dst, unsigned long count)
+{
+  unsigned long pos = *bitPos;
+  unsigned long n = 0;
+  uint64_t window;
+  unsigned int entry, length;
+  int avail, symbol;
+
+  while(n < count && (pos >> 3) < limit)
+  {
+    window = loadBits(src + (pos >> 3)) << (pos & 7);
+    avail = 64 - (int)(pos & 7);
+    do
+    {
+      entry = table->entry[window >> (64 - DECODE_BITS)];
+      length = entry >> 8;
+      if(length == 0)
+      {
+        /* code is longer than the table */
+        if(table->tree != NULL)
+        {
+          n += decodeTree(table->tree, src, limit, &pos, dst + n, 1);
+          break;
+        }
+        symbol = decodeCanonical(table, src, &pos);
+        if(symbol < 0)
+        {
+          *bitPos = pos;
+          return n;
+        }
+        dst[n++] = (unsigned char)symbol;
+        break;
+      }
+      dst[n++] = (unsigned char)entry;
+      window <<= length;
+      avail -= length;
+      pos += length;
+    } while(avail >= DECODE_BITS && n < count && (pos >> 3) < limit);
+  }
+  *bitPos = pos;
+  return n;
+}
+
+/**********************************************************/
+/* Decodes the symbols of a context block with one table  */
+/* probe per symbol, like decodeTable, except that each   */
+/* probe goes to the table the previous symbol selects.   */
+/* in -- decode table of every context, see decodeTree    */
+/*       for the rest                                     */
+/* out -- number of symbols written to the output buffer  */
+/**********************************************************/
+unsigned long decodeContexts(const struct DecodeTable* const table[NUM_CHAR],
+                             const unsigned char* src,
+                             unsigned long limit, unsigned long* bitPos,
+                             unsigned char* dst, unsigned long count)
+{
+  const struct DecodeTable* current = table[0];
+  unsigned long pos = *bitPos;
+  unsigned long n = 0;
+  uint64_t window;
+  unsigned int entry, length;
+  int avail;
+
+  while(n < count && (pos >> 3) < limit)
+  {
+    window = loadBits(src + (pos >> 3)) << (pos & 7);
+    avail = 64 - (int)(pos & 7);
+    do
+    {
+      entry = current->entry[window >> (64 - DECODE_BITS)];
+      length = entry >> 8;
+      if(length == 0)
+      {
+        /* code is longer than the table */
+        if(decodeTable(current, src, limit, &pos, dst + n, 1) == 0)
+        {
+          *bitPos = pos;
+          return n;
+        }
+        current = table[dst[n++]];
+        break;
+      }
+      dst[n++] = (unsigned char)entry;
+      current = table[entry & 0xff];
+      window <<= length;
+      avail -= length;
+      pos += length;
+    } while(avail >= DECODE_BITS && n < count && (pos >> 3) < limit);
+  }
+  *bitPos = pos;
+  return n;
+}
+
+/*********************************************************/
+/* Tells whether a multi-symbol table pays for itself.   */
+/* The code lengths give each symbol the probability     */
+/* 2^-length, and the codes average under it the bits of */
+/* sum count[length] * length * 2^-length, worked out in */
+/* fixed point with 32 fractional bits. Longer codes     */
+/* add too little to matter and are left out.            */
+/* in -- decode table made from canonical code lengths   */
+/* out -- TRUE if the average is at most half of         */
+/*        DECODE_BITS, FALSE otherwise                   */
+/*********************************************************/
+int multiTablePays(const struct DecodeTable* table)
+{
+  uint64_t weight = 0;
+  int length;
+
+  for(length = 1; length <= 32; length++)
+  {
+    weight += ((uint64_t)table->count[length] * length) << (32 - length);
+  }
+  return 2 * weight <= (uint64_t)DECODE_BITS << 32;
+}
+
+/*********************************************************/
+/* Fills a multi-symbol table. Every entry follows the   */
+/* codes its index starts with through the decode table, */
+/* for as long as each next code lies wholly within the  */
+/* index, up to MULTI_SYMBOLS codes.                     */
+/* in -- decode table, multi-symbol table to fill        */
+/* out -- void                                           */
+/*********************************************************/
+void buildMultiTable(const struct DecodeTable* table,
+                     struct MultiTable* multi)
+{
+  const unsigned int mask = (1 << DECODE_BITS) - 1;
+  struct MultiEntry* slot;
+  unsigned int index, entry, length, used;
+  int n;
+
+  for(index = 0; index <= mask; index++)
+  {
+    slot = &multi->entry[index];
+    memset(slot->symbol, 0, MULTI_SYMBOLS);
+    used = 0;
+    for(n = 0; n < MULTI_SYMBOLS; n++)
+    {
+      entry = table->entry[(index << used) & mask];
+      length = entry >> 8;
+      if(length == 0 || used + length > DECODE_BITS)
+      {
+        break;
+      }
+      slot->symbol[n] = (unsigned char)entry;
+      used += length;
+    }
+    slot->count = (unsigned char)n;
+    slot->length = (unsigned char)used;
+  }
+}
+
+/**********************************************************/
+/* Decodes symbols like decodeTable, with one probe of a  */
+/* multi-symbol table for up to MULTI_SYMBOLS of them.    */
+/* Every probe stores all MULTI_SYMBOLS symbols of its    */
+/* entry and keeps those it decoded, so it runs while at  */
+/* least that many are left to decode and every code the  */
+/* probe covers starts before the limit; decodeTable      */
+/* finishes the rest, and decodes the long codes.         */
+/* in -- decode table, multi-symbol table made from it,   */
+/*       see decodeTree for the rest                      */
+/* out -- number of symbols written to the output buffer  */
+/**********************************************************/
+unsigned long decodeMulti(const struct DecodeTable* table,
+                          const struct MultiTable* multi,
+                          const unsigned char* src,
+                          unsigned long limit, unsigned long* bitPos,
+                          unsigned char* dst, unsigned long count)
+{
+  const struct MultiEntry* entry;
+  unsigned long pos = *bitPos;
+  unsigned long n = 0;
+  uint64_t window;
+  int avail;
+
+  while(count - n >= MULTI_SYMBOLS && (pos >> 3) + 2 < limit)
+  {
+    window = loadBits(src + (pos >> 3)) << (pos & 7);
+    avail = 64 - (int)(pos & 7);
+    do
+    {
+      entry = &multi->entry[window >> (64 - DECODE_BITS)];
+      if(entry->count == 0)
+      {
+        /* code is longer than the table */
+        if(decodeTable(table, src, limit, &pos, dst + n, 1) == 0)
+        {
+          *bitPos = pos;
+          return n;
+        }
+        n++;
+        break;
+      }
+      memcpy(dst + n, entry->symbol, MULTI_SYMBOLS);
+      n += entry->count;
+      window <<= entry->length;
+      avail -= entry->length;
+      pos += entry->length;
+    } while(avail >= DECODE_BITS && count - n >= MULTI_SYMBOLS
+            && (pos >> 3) + 2 < limit);
+  }
+  *bitPos = pos;
+  return n + decodeTable(table, src, limit, bitPos, dst + n, count - n);
+}
+
+/* short codes decoded per stream from each load of the bit */
+/* buffer: after a shift of up to 7 bits, 57 bits are left  */
+#define ROUND_SYMBOLS 5
+
+/* bytes a stream must have left for a whole round: every */
+/* code of the round, even the longest, starts before the */
+/* limit                                                  */
+#define ROUND_MARGIN (ROUND_SYMBOLS * MAX_CODE_LENGTH / 8 + 1)
+
+#if STREAMS != 4
+#error decodeStreams is written out for four streams
+#endif
+
+/* decodes one symbol of stream s, held in its own variables so */
+/* that they stay in registers; a code longer than the table is */
+/* left to decodeTable, after which the bit buffer is reloaded  */
+#define STREAM_STEP(s, window, pos, out)                          \
+  entry = table->entry[window >> (64 - DECODE_BITS)];             \
+  length = entry >> 8;                                            \
+  if(length == 0)                                                 \
+  {                                                               \
+    longPos = pos;                                                \
+    if(decodeTable(table, src, limit[s], &longPos, out, 1) == 0)  \
+    {                                                             \
+      damaged = TRUE;                                             \
+    }                                                             \
+    pos = longPos;                                                \
+    window = loadBits(src + (pos >> 3)) << (pos & 7);             \
+  }                                                               \
+  else                                                            \
+  {                                                               \
+    *out = (unsigned char)entry;                                  \
+    window <<= length;                                            \
+    pos += length;                                                \
+  }                                                               \
+  out++
+
+/**********************************************************/
+/* Decodes STREAMS bitstreams in lock step. Each round    */
+/* loads a 64-bit bit buffer for every stream and decodes */
+/* ROUND_SYMBOLS symbols from each, one stream after the  */
+/* other, so the probes of one stream overlap those of    */
+/* the others. Near the end of any stream, the streams    */
+/* are finished one at a time with decodeTable.           */
+/* in -- decode table, encoded bytes, byte limit, bit     */
+/*       position, output and symbol count of each stream */
+/* out -- number of symbols written, over all streams,    */
+/*        0 if any of them holds bits that are not a code */
+/**********************************************************/
+unsigned long decodeStreams(const struct DecodeTable* table,
+                            const unsigned char* src,
+                            const unsigned long limit[STREAMS],
+                            unsigned long bitPos[STREAMS],
+                            unsigned char* const dst[STREAMS],
+                            const unsigned long count[STREAMS])
+{
+  uint64_t window0, window1, window2, window3;
+  unsigned long pos0 = bitPos[0], pos1 = bitPos[1];
+  unsigned long pos2 = bitPos[2], pos3 = bitPos[3];
+  unsigned char* out0 = dst[0];
+  unsigned char* out1 = dst[1];
+  unsigned char* out2 = dst[2];
+  unsigned char* out3 = dst[3];
+  unsigned char* end0 = dst[0] + count[0];
+  unsigned char* end1 = dst[1] + count[1];
+  unsigned char* end2 = dst[2] + count[2];
+  unsigned char* end3 = dst[3] + count[3];
+  unsigned char* done[STREAMS];
+  unsigned long total = 0, longPos, n;
+  unsigned int entry, length;
+  int s, round, damaged = FALSE;
+
+  while(!damaged
+        && end0 - out0 >= ROUND_SYMBOLS && end1 - out1 >= ROUND_SYMBOLS
+        && end2 - out2 >= ROUND_SYMBOLS && end3 - out3 >= ROUND_SYMBOLS
+        && (pos0 >> 3) + ROUND_MARGIN <= limit[0]
+        && (pos1 >> 3) + ROUND_MARGIN <= limit[1]
+        && (pos2 >> 3) + ROUND_MARGIN <= limit[2]
+        && (pos3 >> 3) + ROUND_MARGIN <= limit[3])
+  {
+    window0 = loadBits(src + (pos0 >> 3)) << (pos0 & 7);
+    window1 = loadBits(src + (pos1 >> 3)) << (pos1 & 7);
+    window2 = loadBits(src + (pos2 >> 3)) << (pos2 & 7);
+    window3 = loadBits(src + (pos3 >> 3)) << (pos3 & 7);
+    for(round = 0; round < ROUND_SYMBOLS; round++)
+    {
+      STREAM_STEP(0, window0, pos0, out0);
+      STREAM_STEP(1, window1, pos1, out1);
+      STREAM_STEP(2, window2, pos2, out2);
+      STREAM_STEP(3, window3, pos3, out3);
+    }
+  }
+  if(damaged)
+  {
+    return 0;
+  }
+
+  bitPos[0] = pos0;
+  bitPos[1] = pos1;
+  bitPos[2] = pos2;
+  bitPos[3] = pos3;
+  done[0] = out0;
+  done[1] = out1;
+  done[2] = out2;
+  done[3] = out3;
+  for(s = 0; s < STREAMS; s++)
+  {
+    n = (unsigned long)(done[s] - dst[s]);
+    total += n + decodeTable(table, src, limit[s], &bitPos[s],
+                             done[s], count[s] - n);
+  }
+  return total;
+}
+
+/* decodes up to MULTI_SYMBOLS symbols of stream s like        */
+/* STREAM_STEP, with one probe of the multi-symbol table       */
+#define MULTI_STEP(s, window, pos, out)                           \
+  multiEntry = &multi->entry[window >> (64 - DECODE_BITS)];       \
+  if(multiEntry->count == 0)                                      \
+  {                                                               \
+    longPos = pos;                                                \
+    if(decodeTable(table, src, limit[s], &longPos, out, 1) == 0)  \
+    {                                                             \
+      damaged = TRUE;                                             \
+    }                                                             \
+    pos = longPos;                                                \
+    window = loadBits(src + (pos >> 3)) << (pos & 7);             \
+    out++;                                                        \
+  }                                                               \
+  else                                                            \
+  {                                                               \
+    memcpy(out, multiEntry->symbol, MULTI_SYMBOLS);               \
+    out += multiEntry->count;                                     \
+    window <<= multiEntry->length;                                \
+    pos += multiEntry->length;                                    \
+  }
+
+/**********************************************************/
+/* Decodes STREAMS bitstreams in lock step like           */
+/* decodeStreams, with one probe of a multi-symbol table  */
+/* for up to MULTI_SYMBOLS symbols of a stream. A round   */
+/* needs room for ROUND_SYMBOLS whole entries in every    */
+/* stream, since each probe stores all the symbols of its */
+/* entry; probes take at most DECODE_BITS bits, so the    */
+/* bit buffer still lasts a round.                        */
+/* in -- decode table, multi-symbol table made from it,   */
+/*       encoded bytes, byte limit, bit position, output  */
+/*       and symbol count of each stream                  */
+/* out -- number of symbols written, over all streams,    */
+/*        0 if any of them holds bits that are not a code */
+/**********************************************************/
+unsigned long decodeStreamsMulti(const struct DecodeTable* table,
+                                 const struct MultiTable* multi,
+                                 const unsigned char* src,
+                                 const unsigned long limit[STREAMS],
+                                 unsigned long bitPos[STREAMS],
+                                 unsigned char* const dst[STREAMS],
+                                 const unsigned long count[STREAMS])
+{
+  const struct MultiEntry* multiEntry;
+  uint64_t window0, window1, window2, window3;
+  unsigned long pos0 = bitPos[0], pos1 = bitPos[1];
+  unsigned long pos2 = bitPos[2], pos3 = bitPos[3];
+  unsigned char* out0 = dst[0];
+  unsigned char* out1 = dst[1];
+  unsigned char* out2 = dst[2];
+  unsigned char* out3 = dst[3];
+  unsigned char* end0 = dst[0] + count[0];
+  unsigned char* end1 = dst[1] + count[1];
+  unsigned char* end2 = dst[2] + count[2];
+  unsigned char* end3 = dst[3] + count[3];
+  unsigned char* done[STREAMS];
+  unsigned long total = 0, longPos, n;
+  int s, round, damaged = FALSE;
+
+  while(!damaged
+        && end0 - out0 >= ROUND_SYMBOLS * MULTI_SYMBOLS
+        && end1 - out1 >= ROUND_SYMBOLS * MULTI_SYMBOLS
+        && end2 - out2 >= ROUND_SYMBOLS * MULTI_SYMBOLS
+        && end3 - out3 >= ROUND_SYMBOLS * MULTI_SYMBOLS
+        && (pos0 >> 3) + ROUND_MARGIN <= limit[0]
+        && (pos1 >> 3) + ROUND_MARGIN <= limit[1]
+        && (pos2 >> 3) + ROUND_MARGIN <= limit[2]
+        && (pos3 >> 3) + ROUND_MARGIN <= limit[3])
+  {
+    window0 = loadBits(src + (pos0 >> 3)) << (pos0 & 7);
+    window1 = loadBits(src + (pos1 >> 3)) << (pos1 & 7);
+    window2 = loadBits(src + (pos2 >> 3)) << (pos2 & 7);
+    window3 = loadBits(src + (pos3 >> 3)) << (pos3 & 7);
+    for(round = 0; round < ROUND_SYMBOLS; round++)
+    {
+      MULTI_STEP(0, window0, pos0, out0);
+      MULTI_STEP(1, window1, pos1, out1);
+      MULTI_STEP(2, window2, pos2, out2);
+      MULTI_STEP(3, window3, pos3, out3);
+    }
+  }
+  if(damaged)
+  {
+    return 0;
+  }
+
+  bitPos[0] = pos0;
+  bitPos[1] = pos1;
+  bitPos[2] = pos2;
+  bitPos[3] = pos3;
+  done[0] = out0;
+  done[1] = out1;
+  done[2] = out2;
+  done[3] = out3;
+  for(s = 0; s < STREAMS; s++)
+  {
+    n = (unsigned long)(done[s] - dst[s]);
+    total += n + decodeTable(table, src, limit[s], &bitPos[s],
+                             done[s], count[s] - n);
+  }
+  return total;
+}
+
+/* copies a step of a decode kernel for each symbol of a round */
+#define REPEAT_4(step) step step step step
+#define REPEAT_5(step) REPEAT_4(step) step
+#define REPEAT_7(step) REPEAT_5(step) step step
+#define REPEAT(symbols, step) REPEAT_##symbols(step)
+
+/* decodes one symbol of stream s whose code fits the kernel table */
+#define SHORT_STEP(bits, s, window, pos, out)                     \
+  entry = kernelEntry[window >> (64 - bits)];                     \
+  length = entry >> 8;                                            \
+  *out++ = (unsigned char)entry;                                  \
+  window <<= length;                                              \
+  pos += length;
+
+/* decodes one symbol of stream s like STREAM_STEP, probing the   */
+/* kernel table                                                   */
+#define LONG_STEP(bits, s, window, pos, out)                      \
+  entry = kernelEntry[window >> (64 - bits)];                     \
+  length = entry >> 8;                                            \
+  if(length == 0)                                                 \
+  {                                                               \
+    unsigned long longPos = pos;                                  \
+                                                                  \
+    if(decodeTable(table, src, limit[s], &longPos, out, 1) == 0)  \
+    {                                                             \
+      damaged = TRUE;                                             \
+    }                                                             \
+    pos = longPos;                                                \
+    window = loadBits(src + (pos >> 3)) << (pos & 7);             \
+  }                                                               \
+  else                                                            \
+  {                                                               \
+    *out = (unsigned char)entry;                                  \
+    window <<= length;                                            \
+    pos += length;                                                \
+  }                                                               \
+  out++;
+
+/**********************************************************/
+/* Number of rounds a kernel can run on a stream without  */
+/* checking it: every code of every round, at most        */
+/* stepBits bits long, ends within the stream, and no     */
+/* round decodes more symbols than are left.              */
+/* in -- bit position, byte limit and symbols left of the */
+/*       stream, symbols per round, longest code          */
+/* out -- number of rounds                                */
+/**********************************************************/
+static unsigned long safeRounds(unsigned long pos, unsigned long limit,
+                                unsigned long left, int symbols,
+                                int stepBits)
+{
+  unsigned long rounds;
+
+  if(pos >= limit * 8)
+  {
+    return 0;
+  }
+  rounds = (limit * 8 - pos) / ((unsigned long)symbols * stepBits);
+  left /= symbols;
+  return rounds < left ? rounds : left;
+}
+
+/* defines a kernel for one stream: it works out how many rounds   */
+/* are safe, runs them with no check but for damage, and repeats;  */
+/* decodeTable finishes the stream                                 */
+#define SINGLE_KERNEL(name, bits, symbols, step)                          \
+static unsigned long name(const struct DecodeTable* table,                \
+                          const struct KernelTable* kernel,               \
+                          const unsigned char* src,                       \
+                          const unsigned long limit[STREAMS],             \
+                          unsigned long bitPos[STREAMS],                  \
+                          unsigned char* const dst[STREAMS],              \
+                          const unsigned long count[STREAMS])             \
+{                                                                         \
+  const unsigned short* kernelEntry = kernel->entry;                      \
+  unsigned long pos0 = bitPos[0];                                         \
+  unsigned char* out0 = dst[0];                                           \
+  unsigned char* end0 = dst[0] + count[0];                                \
+  unsigned long rounds, n;                                                \
+  uint64_t window0;                                                       \
+  unsigned int entry, length;                                             \
+  int damaged = FALSE;                                                    \
+                                                                          \
+  rounds = safeRounds(pos0, limit[0], count[0], symbols,                  \
+                      kernel->maxLength);                                 \
+  while(rounds > 0)                                                       \
+  {                                                                       \
+    do                                                                    \
+    {                                                                     \
+      window0 = loadBits(src + (pos0 >> 3)) << (pos0 & 7);                \
+      REPEAT(symbols, step(bits, 0, window0, pos0, out0))                 \
+    } while(--rounds > 0);                                                \
+    if(!damaged)                                                          \
+    {                                                                     \
+      rounds = safeRounds(pos0, limit[0], (unsigned long)(end0 - out0),   \
+                          symbols, kernel->maxLength);                    \
+    }                                                                     \
+  }                                                                       \
+  if(damaged)                                                             \
+  {                                                                       \
+    return 0;                                                             \
+  }                                                                       \
+                                                                          \
+  bitPos[0] = pos0;                                                       \
+  n = (unsigned long)(out0 - dst[0]);                                     \
+  return n + decodeTable(table, src, limit[0], &bitPos[0], out0,          \
+                         count[0] - n);                                   \
+}
+
+/* the fewest safe rounds of the four streams */
+#define STREAM_ROUNDS(symbols)                                            \
+  rounds = safeRounds(pos0, limit[0], (unsigned long)(end0 - out0),       \
+                      symbols, kernel->maxLength);                        \
+  more = safeRounds(pos1, limit[1], (unsigned long)(end1 - out1),         \
+                    symbols, kernel->maxLength);                          \
+  rounds = more < rounds ? more : rounds;                                 \
+  more = safeRounds(pos2, limit[2], (unsigned long)(end2 - out2),         \
+                    symbols, kernel->maxLength);                          \
+  rounds = more < rounds ? more : rounds;                                 \
+  more = safeRounds(pos3, limit[3], (unsigned long)(end3 - out3),         \
+                    symbols, kernel->maxLength);                          \
+  rounds = more < rounds ? more : rounds;
+
+/* defines a kernel for STREAMS streams in lock step, like         */
+/* decodeStreams, with the rounds counted as in SINGLE_KERNEL      */
+#define STREAMS_KERNEL(name, bits, symbols, step)                         \
+static unsigned long name(const struct DecodeTable* table,                \
+                          const struct KernelTable* kernel,               \
+                          const unsigned char* src,                       \
+                          const unsigned long limit[STREAMS],             \
+                          unsigned long bitPos[STREAMS],                  \
+                          unsigned char* const dst[STREAMS],              \
+                          const unsigned long count[STREAMS])             \
+{                                                                         \
+  const unsigned short* kernelEntry = kernel->entry;                      \
+  uint64_t window0, window1, window2, window3;                            \
+  unsigned long pos0 = bitPos[0], pos1 = bitPos[1];                       \
+  unsigned long pos2 = bitPos[2], pos3 = bitPos[3];                       \
+  unsigned char* out0 = dst[0];                                           \
+  unsigned char* out1 = dst[1];                                           \
+  unsigned char* out2 = dst[2];                                           \
+  unsigned char* out3 = dst[3];                                           \
+  unsigned char* end0 = dst[0] + count[0];                                \
+  unsigned char* end1 = dst[1] + count[1];                                \
+  unsigned char* end2 = dst[2] + count[2];                                \
+  unsigned char* end3 = dst[3] + count[3];                                \
+  unsigned char* done[STREAMS];                                           \
+  unsigned long rounds, more, total = 0, n;                               \
+  unsigned int entry, length;                                             \
+  int s, damaged = FALSE;                                                 \
+                                                                          \
+  STREAM_ROUNDS(symbols)                                                  \
+  while(rounds > 0)                                                       \
+  {                                                                       \
+    do                                                                    \
+    {                                                                     \
+      window0 = loadBits(src + (pos0 >> 3)) << (pos0 & 7);                \
+      window1 = loadBits(src + (pos1 >> 3)) << (pos1 & 7);                \
+      window2 = loadBits(src + (pos2 >> 3)) << (pos2 & 7);                \
+      window3 = loadBits(src + (pos3 >> 3)) << (pos3 & 7);                \
+      REPEAT(symbols, step(bits, 0, window0, pos0, out0)                  \
+                      step(bits, 1, window1, pos1, out1)                  \
+                      step(bits, 2, window2, pos2, out2)                  \
+                      step(bits, 3, window3, pos3, out3))                 \
+    } while(--rounds > 0);                                                \
+    if(!damaged)                                                          \
+    {                                                                     \
+      STREAM_ROUNDS(symbols)                                              \
+    }                                                                     \
+  }                                                                       \
+  if(damaged)                                                             \
+  {                                                                       \
+    return 0;                                                             \
+  }                                                                       \
+                                                                          \
+  bitPos[0] = pos0;                                                       \
+  bitPos[1] = pos1;                                                       \
+  bitPos[2] = pos2;                                                       \
+  bitPos[3] = pos3;                                                       \
+  done[0] = out0;                                                         \
+  done[1] = out1;                                                         \
+  done[2] = out2;                                                         \
+  done[3] = out3;                                                         \
+  for(s = 0; s < STREAMS; s++)                                            \
+  {                                                                       \
+    n = (unsigned long)(done[s] - dst[s]);                                \
+    total += n + decodeTable(table, src, limit[s], &bitPos[s],            \
+                             done[s], count[s] - n);                      \
+  }                                                                       \
+  return total;                                                           \
+}
+
+/* the kernels: a round decodes as many symbols of each stream as */
+/* there are whole table widths in the 57 bits of a load          */
+SINGLE_KERNEL(short8x1, 8, 7, SHORT_STEP)
+SINGLE_KERNEL(short10x1, 10, 5, SHORT_STEP)
+SINGLE_KERNEL(short11x1, 11, 5, SHORT_STEP)
+SINGLE_KERNEL(short12x1, 12, 4, SHORT_STEP)
+SINGLE_KERNEL(long8x1, 8, 7, LONG_STEP)
+SINGLE_KERNEL(long10x1, 10, 5, LONG_STEP)
+SINGLE_KERNEL(long11x1, 11, 5, LONG_STEP)
+SINGLE_KERNEL(long12x1, 12, 4, LONG_STEP)
+STREAMS_KERNEL(short8x4, 8, 7, SHORT_STEP)
+STREAMS_KERNEL(short10x4, 10, 5, SHORT_STEP)
+STREAMS_KERNEL(short11x4, 11, 5, SHORT_STEP)
+STREAMS_KERNEL(short12x4, 12, 4, SHORT_STEP)
+STREAMS_KERNEL(long8x4, 8, 7, LONG_STEP)
+STREAMS_KERNEL(long10x4, 10, 5, LONG_STEP)
+STREAMS_KERNEL(long11x4, 11, 5, LONG_STEP)
+STREAMS_KERNEL(long12x4, 12, 4, LONG_STEP)
+
+/* every kernel, the short ones before the long ones and the */
+/* narrow tables before the wide ones                        */
+static const struct Kernel kernelList[NUM_KERNELS] =
+{
+  {"short8x1", 8, 1, TRUE, short8x1},
+  {"short10x1", 10, 1, TRUE, short10x1},
+  {"short11x1", 11, 1, TRUE, short11x1},
+  {"short12x1", 12, 1, TRUE, short12x1},
+  {"short8x4", 8, STREAMS, TRUE, short8x4},
+  {"short10x4", 10, STREAMS, TRUE, short10x4},
+  {"short11x4", 11, STREAMS, TRUE, short11x4},
+  {"short12x4", 12, STREAMS, TRUE, short12x4},
+  {"long8x1", 8, 1, FALSE, long8x1},
+  {"long10x1", 10, 1, FALSE, long10x1},
+  {"long11x1", 11, 1, FALSE, long11x1},
+  {"long12x1", 12, 1, FALSE, long12x1},
+  {"long8x4", 8, STREAMS, FALSE, long8x4},
+  {"long10x4", 10, STREAMS, FALSE, long10x4},
+  {"long11x4", 11, STREAMS, FALSE, long11x4},
+  {"long12x4", 12, STREAMS, FALSE, long12x4}
+};
+
+/********************************************************/
+/* Looks up a kernel by number, for trying them all.    */
+/* in -- number of the kernel                           */
+/* out -- the kernel, or NULL past the last one         */
+/********************************************************/
+const struct Kernel* getKernel(int index)
+{
+  return index >= 0 && index < NUM_KERNELS ? &kernelList[index] : NULL;
+}
+
+/********************************************************/
+/* Longest code of a decode table.                      */
+/* in -- decode table made from canonical code lengths  */
+/* out -- the length, 0 if there are no codes           */
+/********************************************************/
+static int longestCode(const struct DecodeTable* table)
+{
+  int length;
+
+  for(length = MAX_CODE_LENGTH; length > 0; length--)
+  {
+    if(table->count[length] > 0)
+    {
+      break;
+    }
+  }
+  return length;
+}
+
+/*********************************************************/
+/* Tells whether a kernel can decode the codes of a      */
+/* table. A long kernel decodes any codes; a short one   */
+/* only a complete code that fits its table, so that     */
+/* every entry of the table holds a code.                */
+/* in -- the kernel, decode table made from canonical    */
+/*       code lengths                                    */
+/* out -- TRUE or FALSE                                  */
+/*********************************************************/
+int kernelFits(const struct Kernel* kernel, const struct DecodeTable* table)
+{
+  unsigned long space = 0;
+  int longest = longestCode(table), length;
+
+  if(!kernel->shortCodes)
+  {
+    return TRUE;
+  }
+  if(longest == 0 || longest > kernel->bits)
+  {
+    return FALSE;
+  }
+  for(length = 1; length <= longest; length++)
+  {
+    space += (unsigned long)table->count[length] << (longest - length);
+  }
+  return space == 1ul << longest;
+}
+
+/*********************************************************/
+/* Picks the kernel for a table and stream count: the    */
+/* narrowest short kernel that fits, as a narrower table */
+/* takes more symbols per load, or else the long kernel  */
+/* of LONG_KERNEL_BITS.                                  */
+/* in -- decode table made from canonical code lengths,  */
+/*       1 or STREAMS                                    */
+/* out -- the kernel                                     */
+/*********************************************************/
+const struct Kernel* chooseKernel(const struct DecodeTable* table,
+                                  int streams)
+{
+  const struct Kernel* kernel;
+  int i;
+
+  for(i = 0; i < NUM_KERNELS; i++)
+  {
+    kernel = &kernelList[i];
+    if(kernel->streams == streams && kernel->shortCodes
+       && kernelFits(kernel, table))
+    {
+      return kernel;
+    }
+  }
+  for(i = 0; i < NUM_KERNELS; i++)
+  {
+    kernel = &kernelList[i];
+    if(kernel->streams == streams && !kernel->shortCodes
+       && kernel->bits == LONG_KERNEL_BITS)
+    {
+      break;
+    }
+  }
+  return kernel;
+}
+
+/*********************************************************/
+/* Fills the table of a kernel from a decode table, with */
+/* the canonical codes in the order decodeCanonical      */
+/* counts them: the codes of each length follow on from  */
+/* those one bit shorter.                                */
+/* in -- decode table made from canonical code lengths,  */
+/*       table width in bits (at most KERNEL_MAX_BITS),  */
+/*       kernel table to fill                            */
+/* out -- void                                           */
+/*********************************************************/
+void buildKernelTable(const struct DecodeTable* table, int bits,
+                      struct KernelTable* kernel)
+{
+  uint64_t code = 0;
+  unsigned int first, last, i, index = 0;
+  int length;
+
+  memset(kernel->entry, 0, sizeof(unsigned short) << bits);
+  for(length = 1; length <= bits; length++)
+  {
+    for(i = 0; i < table->count[length]; i++, index++, code++)
+    {
+      first = (unsigned int)code << (bits - length);
+      last = first + (1u << (bits - length));
+      for(; first < last; ++first)
+      {
+        kernel->entry[first] = (unsigned short)((length << 8)
+                                                | table->sorted[index]);
+      }
+    }
+    code <<= 1;
+  }
+  kernel->maxLength = longestCode(table);
+  if(kernel->maxLength == 0)
+  {
+    kernel->maxLength = 1;
+  }
+}